@@ -0,0 +1,28 @@
+# Writes every file under SHADER_DIR into OUTPUT as a constexpr table of rg::EmbeddedFile.
+# Run in script mode: cmake -DROOT=... -DSHADER_DIR=resources/shaders -DOUTPUT=... -P EmbedShaders.cmake
+# Names are paths relative to ROOT, the same strings the program passes to rg::shaderSources().
+
+file(GLOB_RECURSE FILES RELATIVE "${ROOT}" "${ROOT}/${SHADER_DIR}/*")
+list(SORT FILES)
+
+set(CONTENT "// Generated by cmake/EmbedShaders.cmake, do not edit.\n\n")
+string(APPEND CONTENT "#ifndef PROJECT_BASE_EMBEDDED_SHADERS_H\n#define PROJECT_BASE_EMBEDDED_SHADERS_H\n\n")
+string(APPEND CONTENT "namespace rg {\n\nconstexpr EmbeddedFile embeddedShaderFiles[] = {\n")
+foreach(NAME ${FILES})
+    file(READ "${ROOT}/${NAME}" SOURCE)
+    string(LENGTH "${SOURCE}" SIZE)
+    string(FIND "${SOURCE}" ")rg_embed\"" CLASH)
+    if(NOT CLASH EQUAL -1)
+        message(FATAL_ERROR "${NAME} contains the raw string delimiter )rg_embed\"")
+    endif()
+    string(APPEND CONTENT "    { \"${NAME}\", R\"rg_embed(${SOURCE})rg_embed\", ${SIZE} },\n")
+endforeach()
+string(APPEND CONTENT "};\n\n}\n\n#endif //PROJECT_BASE_EMBEDDED_SHADERS_H\n")
+
+# only touch the header when something changed, so an unrelated configure doesn't rebuild main.cpp
+if(EXISTS "${OUTPUT}")
+    file(READ "${OUTPUT}" PREVIOUS)
+endif()
+if(NOT "${PREVIOUS}" STREQUAL "${CONTENT}")
+    file(WRITE "${OUTPUT}" "${CONTENT}")
+endif()
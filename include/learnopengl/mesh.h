@@ -8,7 +8,11 @@
 
 #include <learnopengl/shader.h>
 
+#include <cstdint>
+#include <cstring>
+#include <map>
 #include <string>
+#include <tuple>
 #include <vector>
 using namespace std;
 
@@ -41,9 +45,13 @@ public:
     vector<Texture>      textures;
 
     unsigned int VAO;
+    // position-only stream for depth passes, 0 if the mesh was built without one
+    unsigned int depthVAO = 0;
+    // size of that stream on the GPU, compare with vertices.size() * sizeof(Vertex)
+    size_t positionStreamBytes = 0;
     std::string glslIdentifierPrefix;
     // constructor
-    Mesh(vector<Vertex> vertices, vector<unsigned int> indices, vector<Texture> textures)
+    Mesh(vector<Vertex> vertices, vector<unsigned int> indices, vector<Texture> textures, bool positionStream = false)
     {
         this->vertices = vertices;
         this->indices = indices;
@@ -51,10 +59,94 @@ public:
 
         // now that we have all the required data, set the vertex buffers and its attribute pointers.
         setupMesh();
+        if (positionStream)
+            setupPositionStream();
     }
 
     // render the mesh
     void Draw(Shader &shader)
+    {
+        bindTextures(shader);
+
+        // draw mesh
+        glBindVertexArray(VAO);
+        glDrawElements(GL_TRIANGLES, indices.size(), GL_UNSIGNED_INT, 0);
+        glBindVertexArray(0);
+
+        // always good practice to set everything back to defaults once configured.
+        glActiveTexture(GL_TEXTURE0);
+    }
+
+    // render count copies in one call, model matrices come from the instance buffer (INSTANCED shaders)
+    void DrawInstanced(Shader &shader, int count)
+    {
+        bindTextures(shader);
+        glBindVertexArray(VAO);
+        glDrawElementsInstanced(GL_TRIANGLES, indices.size(), GL_UNSIGNED_INT, 0, count);
+        glBindVertexArray(0);
+        glActiveTexture(GL_TEXTURE0);
+    }
+
+    // render positions only (depth pre-pass, shadows, occlusion), no textures are bound.
+    // The shader may only read attribute 0 (and the instance matrix when instanced).
+    void DrawDepth()
+    {
+        glBindVertexArray(depthVAO ? depthVAO : VAO);
+        glDrawElements(GL_TRIANGLES, indices.size(), GL_UNSIGNED_INT, 0);
+        glBindVertexArray(0);
+    }
+
+    void DrawDepthInstanced(int count)
+    {
+        glBindVertexArray(depthVAO ? depthVAO : VAO);
+        glDrawElementsInstanced(GL_TRIANGLES, indices.size(), GL_UNSIGNED_INT, 0, count);
+        glBindVertexArray(0);
+    }
+
+    // per-instance mat4 at attribute locations 5-8, advanced once per instance.
+    // Attached to both VAOs so the depth stream can be instanced as well. offset is where
+    // this mesh's first instance starts in the buffer, streamed buffers move it every frame.
+    // compact: 16 byte rg::CompactInstance entries at 5-7 instead (COMPACT_INSTANCE shaders)
+    void SetInstanceBuffer(unsigned int instanceVBO, size_t offset = 0, bool compact = false)
+    {
+        unsigned int vaos[] = { VAO, depthVAO };
+        for (unsigned int vao : vaos)
+        {
+            if (vao == 0)
+                continue;
+            glBindVertexArray(vao);
+            glBindBuffer(GL_ARRAY_BUFFER, instanceVBO);
+            if (compact)
+            {
+                const GLsizei stride = 16;
+                glVertexAttribPointer(5, 4, GL_HALF_FLOAT, GL_FALSE, stride, (void*)(offset));
+                glVertexAttribPointer(6, 1, GL_HALF_FLOAT, GL_FALSE, stride, (void*)(offset + 8));
+                glVertexAttribIPointer(7, 1, GL_UNSIGNED_SHORT, stride, (void*)(offset + 10));
+                glDisableVertexAttribArray(8);
+                for (unsigned int location = 5; location < 8; location++)
+                {
+                    glEnableVertexAttribArray(location);
+                    glVertexAttribDivisor(location, 1);
+                }
+                continue;
+            }
+            for (unsigned int column = 0; column < 4; column++)
+            {
+                glEnableVertexAttribArray(5 + column);
+                glVertexAttribPointer(5 + column, 4, GL_FLOAT, GL_FALSE, sizeof(glm::mat4), (void*)(offset + column * sizeof(glm::vec4)));
+                glVertexAttribDivisor(5 + column, 1);
+            }
+        }
+        glBindVertexArray(0);
+        glBindBuffer(GL_ARRAY_BUFFER, 0);
+    }
+
+private:
+    // render data
+    unsigned int VBO, EBO;
+    unsigned int depthVBO = 0, depthEBO = 0;
+
+    void bindTextures(Shader &shader)
     {
         // bind appropriate textures
         unsigned int diffuseNr  = 1;
@@ -81,22 +173,8 @@ public:
             // and finally bind the texture
             glBindTexture(GL_TEXTURE_2D, textures[i].id);
         }
-
-
-
-        // draw mesh
-        glBindVertexArray(VAO);
-        glDrawElements(GL_TRIANGLES, indices.size(), GL_UNSIGNED_INT, 0);
-        glBindVertexArray(0);
-
-        // always good practice to set everything back to defaults once configured.
-        glActiveTexture(GL_TEXTURE0);
     }
 
-private:
-    // render data
-    unsigned int VBO, EBO;
-
     // initializes all the buffer objects/arrays
     void setupMesh()
     {
@@ -135,5 +213,47 @@ private:
 
         glBindVertexArray(0);
     }
+
+    // tightly packed 12 byte positions instead of the 56 byte Vertex. Vertices that were only
+    // split because of normals or UVs collapse into one, the index buffer is remapped to match.
+    void setupPositionStream()
+    {
+        vector<glm::vec3> positions;
+        vector<unsigned int> remap(vertices.size());
+        std::map<std::tuple<uint32_t, uint32_t, uint32_t>, unsigned int> unique;
+        for (size_t i = 0; i < vertices.size(); i++)
+        {
+            // compare bit patterns, + 0.0f folds -0 into 0
+            float p[3] = { vertices[i].Position.x + 0.0f, vertices[i].Position.y + 0.0f, vertices[i].Position.z + 0.0f };
+            uint32_t bits[3];
+            memcpy(bits, p, sizeof(bits));
+            auto key = std::make_tuple(bits[0], bits[1], bits[2]);
+            auto found = unique.find(key);
+            if (found == unique.end())
+            {
+                found = unique.insert(std::make_pair(key, (unsigned int) positions.size())).first;
+                positions.push_back(vertices[i].Position);
+            }
+            remap[i] = found->second;
+        }
+        vector<unsigned int> depthIndices(indices.size());
+        for (size_t i = 0; i < indices.size(); i++)
+            depthIndices[i] = remap[indices[i]];
+
+        glGenVertexArrays(1, &depthVAO);
+        glGenBuffers(1, &depthVBO);
+        glGenBuffers(1, &depthEBO);
+
+        glBindVertexArray(depthVAO);
+        glBindBuffer(GL_ARRAY_BUFFER, depthVBO);
+        glBufferData(GL_ARRAY_BUFFER, positions.size() * sizeof(glm::vec3), &positions[0], GL_STATIC_DRAW);
+        glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, depthEBO);
+        glBufferData(GL_ELEMENT_ARRAY_BUFFER, depthIndices.size() * sizeof(unsigned int), &depthIndices[0], GL_STATIC_DRAW);
+        glEnableVertexAttribArray(0);
+        glVertexAttribPointer(0, 3, GL_FLOAT, GL_FALSE, sizeof(glm::vec3), (void*)0);
+        glBindVertexArray(0);
+
+        positionStreamBytes = positions.size() * sizeof(glm::vec3);
+    }
 };
 #endif
\ No newline at end of file
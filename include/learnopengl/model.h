@@ -33,9 +33,11 @@ public:
     vector<Mesh>    meshes;
     string directory;
     bool gammaCorrection;
+    // every mesh also gets a deduplicated position-only stream for DrawDepth
+    bool positionStream;
 
     // constructor, expects a filepath to a 3D model.
-    Model(string const &path, bool gamma = false) : gammaCorrection(gamma)
+    Model(string const &path, bool gamma = false, bool positionStream = false) : gammaCorrection(gamma), positionStream(positionStream)
     {
         loadModel(path);
     }
@@ -47,6 +49,46 @@ public:
             meshes[i].Draw(shader);
     }
 
+    // positions only, the bound shader may only read attribute 0
+    void DrawDepth()
+    {
+        for(unsigned int i = 0; i < meshes.size(); i++)
+            meshes[i].DrawDepth();
+    }
+
+    // instanced variants, see Mesh::SetInstanceBuffer
+    void DrawInstanced(Shader &shader, int count)
+    {
+        for(unsigned int i = 0; i < meshes.size(); i++)
+            meshes[i].DrawInstanced(shader, count);
+    }
+
+    void DrawDepthInstanced(int count)
+    {
+        for(unsigned int i = 0; i < meshes.size(); i++)
+            meshes[i].DrawDepthInstanced(count);
+    }
+
+    void SetInstanceBuffer(unsigned int instanceVBO, size_t offset = 0, bool compact = false)
+    {
+        for (Mesh& mesh: meshes) {
+            mesh.SetInstanceBuffer(instanceVBO, offset, compact);
+        }
+    }
+
+    // true if every mesh has a texture of this type, e.g. "texture_normal"
+    bool HasTextures(const string &type) const
+    {
+        for (const Mesh& mesh: meshes) {
+            bool found = false;
+            for (const Texture& texture: mesh.textures)
+                found = found || texture.type == type;
+            if (!found)
+                return false;
+        }
+        return !meshes.empty();
+    }
+
     void SetShaderTextureNamePrefix(std::string prefix) {
         for (Mesh& mesh: meshes) {
             mesh.glslIdentifierPrefix = prefix;
@@ -179,7 +221,7 @@ private:
 
 
         // return a mesh object created from the extracted mesh data
-        return Mesh(vertices, indices, textures);
+        return Mesh(vertices, indices, textures, positionStream);
     }
 
     // checks all material textures of a given type and loads the textures if they're not loaded yet.
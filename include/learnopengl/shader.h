@@ -9,99 +9,39 @@
 #include <sstream>
 #include <iostream>
 #include <common.h>
+#include <rg/ProgramBinaryCache.h>
+#include <rg/ShaderSources.h>
 class Shader
 {
 public:
-    unsigned int ID;
+    unsigned int ID = 0;
+    Shader() = default;
     // constructor generates the shader on the fly
     // ------------------------------------------------------------------------
     Shader(const char* vertexPath, const char* fragmentPath, const char* geometryPath = nullptr)
     {
-        std::string vertexPathString(vertexPath);
-        std::string fragmentPathString(fragmentPath);
-
-        vertexPath = vertexPathString.c_str();
-        fragmentPath= fragmentPathString.c_str();
-        // 1. retrieve the vertex/fragment source code from filePath
-        std::string vertexCode;
-        std::string fragmentCode;
+        // 1. retrieve the vertex/fragment source code, embedded in the binary or from disk (rg::ShaderSources)
+        std::string vertexCode = rg::shaderSources().read(vertexPath);
+        std::string fragmentCode = rg::shaderSources().read(fragmentPath);
         std::string geometryCode;
-        std::ifstream vShaderFile;
-        std::ifstream fShaderFile;
-        std::ifstream gShaderFile;
-        // ensure ifstream objects can throw exceptions:
-        vShaderFile.exceptions (std::ifstream::failbit | std::ifstream::badbit);
-        fShaderFile.exceptions (std::ifstream::failbit | std::ifstream::badbit);
-        gShaderFile.exceptions (std::ifstream::failbit | std::ifstream::badbit);
-        try 
+        // if geometry shader path is present, also load a geometry shader
+        if (geometryPath != nullptr)
         {
-            // open files
-            vShaderFile.open(vertexPath);
-            fShaderFile.open(fragmentPath);
-            std::stringstream vShaderStream, fShaderStream;
-            // read file's buffer contents into streams
-            vShaderStream << vShaderFile.rdbuf();
-            fShaderStream << fShaderFile.rdbuf();		
-            // close file handlers
-            vShaderFile.close();
-            fShaderFile.close();
-            // convert stream into string
-            vertexCode = vShaderStream.str();
-            fragmentCode = fShaderStream.str();			
-            // if geometry shader path is present, also load a geometry shader
-            if(geometryPath != nullptr)
-            {
-                std::string geometryPathString(geometryPath);
-                geometryPath = geometryPathString.c_str();
-                gShaderFile.open(geometryPath);
-                std::stringstream gShaderStream;
-                gShaderStream << gShaderFile.rdbuf();
-                gShaderFile.close();
-                geometryCode = gShaderStream.str();
-            }
+            geometryCode = rg::shaderSources().read(geometryPath);
         }
-        catch (std::ifstream::failure& e)
+        if (vertexCode.empty() || fragmentCode.empty() || (geometryPath != nullptr && geometryCode.empty()))
         {
             std::cout << "ERROR::SHADER::FILE_NOT_SUCCESFULLY_READ" << std::endl;
         }
-        const char* vShaderCode = vertexCode.c_str();
-        const char * fShaderCode = fragmentCode.c_str();
-        // 2. compile shaders
-        unsigned int vertex, fragment;
-        // vertex shader
-        vertex = glCreateShader(GL_VERTEX_SHADER);
-        glShaderSource(vertex, 1, &vShaderCode, NULL);
-        glCompileShader(vertex);
-        checkCompileErrors(vertex, "VERTEX");
-        // fragment Shader
-        fragment = glCreateShader(GL_FRAGMENT_SHADER);
-        glShaderSource(fragment, 1, &fShaderCode, NULL);
-        glCompileShader(fragment);
-        checkCompileErrors(fragment, "FRAGMENT");
-        // if geometry shader is given, compile geometry shader
-        unsigned int geometry;
-        if(geometryPath != nullptr)
-        {
-            const char * gShaderCode = geometryCode.c_str();
-            geometry = glCreateShader(GL_GEOMETRY_SHADER);
-            glShaderSource(geometry, 1, &gShaderCode, NULL);
-            glCompileShader(geometry);
-            checkCompileErrors(geometry, "GEOMETRY");
-        }
-        // shader Program
-        ID = glCreateProgram();
-        glAttachShader(ID, vertex);
-        glAttachShader(ID, fragment);
-        if(geometryPath != nullptr)
-            glAttachShader(ID, geometry);
-        glLinkProgram(ID);
-        checkCompileErrors(ID, "PROGRAM");
-        // delete the shaders as they're linked into our program now and no longer necessery
-        glDeleteShader(vertex);
-        glDeleteShader(fragment);
-        if(geometryPath != nullptr)
-            glDeleteShader(geometry);
-
+        build(vertexCode.c_str(), fragmentCode.c_str(), geometryPath != nullptr ? geometryCode.c_str() : nullptr);
+    }
+    // program from sources that are already in memory (preprocessed permutations)
+    // ------------------------------------------------------------------------
+    static Shader fromSource(const std::string& vertexCode, const std::string& fragmentCode)
+    {
+        Shader shader;
+        shader.build(vertexCode.c_str(), fragmentCode.c_str(), nullptr);
+        return shader;
     }
     // activate the shader
     // ------------------------------------------------------------------------
@@ -168,10 +108,81 @@ public:
         glUniformMatrix4fv(glGetUniformLocation(ID, name.c_str()), 1, GL_FALSE, &mat[0][0]);
     }
 
+    // build() in two halves, for compiling many programs at once (rg::ShaderBuildQueue).
+    // startBuild sets ID and only issues the compile and link, finishBuild is the first call that
+    // asks the driver for a result. Between the two the driver is free to work in the background.
+    // ------------------------------------------------------------------------
+    struct PendingBuild
+    {
+        unsigned int vertex = 0, fragment = 0, geometry = 0;
+        uint64_t cacheKey = 0;
+        bool cached = false;    // loaded from the program binary cache, nothing left to do
+    };
+    PendingBuild startBuild(const char* vShaderCode, const char* fShaderCode, const char* gShaderCode)
+    {
+        PendingBuild pending;
+        ID = glCreateProgram();
+        // a binary linked by an earlier run skips compilation entirely
+        rg::ProgramBinaryCache& cache = rg::programBinaryCache();
+        pending.cacheKey = cache.enabled() ? cache.key(vShaderCode, fShaderCode, gShaderCode) : 0;
+        if (cache.enabled() && cache.load(pending.cacheKey, ID))
+        {
+            pending.cached = true;
+            return pending;
+        }
+        // 2. compile shaders
+        pending.vertex = glCreateShader(GL_VERTEX_SHADER);
+        glShaderSource(pending.vertex, 1, &vShaderCode, NULL);
+        glCompileShader(pending.vertex);
+        pending.fragment = glCreateShader(GL_FRAGMENT_SHADER);
+        glShaderSource(pending.fragment, 1, &fShaderCode, NULL);
+        glCompileShader(pending.fragment);
+        if(gShaderCode != nullptr)
+        {
+            pending.geometry = glCreateShader(GL_GEOMETRY_SHADER);
+            glShaderSource(pending.geometry, 1, &gShaderCode, NULL);
+            glCompileShader(pending.geometry);
+        }
+        // shader Program
+        glAttachShader(ID, pending.vertex);
+        glAttachShader(ID, pending.fragment);
+        if(pending.geometry)
+            glAttachShader(ID, pending.geometry);
+        if (cache.enabled())
+            cache.prepare(ID);
+        glLinkProgram(ID);
+        return pending;
+    }
+    // returns false if anything failed to compile or link, the log goes to stdout
+    bool finishBuild(const PendingBuild& pending)
+    {
+        if (pending.cached)
+            return true;
+        bool ok = checkCompileErrors(pending.vertex, "VERTEX");
+        ok = checkCompileErrors(pending.fragment, "FRAGMENT") && ok;
+        if(pending.geometry)
+            ok = checkCompileErrors(pending.geometry, "GEOMETRY") && ok;
+        ok = checkCompileErrors(ID, "PROGRAM") && ok;
+        rg::ProgramBinaryCache& cache = rg::programBinaryCache();
+        if (ok && cache.enabled())
+            cache.store(pending.cacheKey, ID);
+        // delete the shaders as they're linked into our program now and no longer necessery
+        glDeleteShader(pending.vertex);
+        glDeleteShader(pending.fragment);
+        if(pending.geometry)
+            glDeleteShader(pending.geometry);
+        return ok;
+    }
+
 private:
+    void build(const char* vShaderCode, const char* fShaderCode, const char* gShaderCode)
+    {
+        finishBuild(startBuild(vShaderCode, fShaderCode, gShaderCode));
+    }
+
     // utility function for checking shader compilation/linking errors.
     // ------------------------------------------------------------------------
-    void checkCompileErrors(GLuint shader, std::string type)
+    bool checkCompileErrors(GLuint shader, std::string type)
     {
         GLint success;
         GLchar infoLog[1024];
@@ -193,6 +204,7 @@ private:
                 std::cout << "ERROR::PROGRAM_LINKING_ERROR of type: " << type << "\n" << infoLog << "\n -- --------------------------------------------------- -- " << std::endl;
             }
         }
+        return success;
     }
 };
 #endif
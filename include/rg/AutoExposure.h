@@ -0,0 +1,142 @@
+//
+// Automatic exposure from a log-luminance histogram, computed and kept entirely on the GPU.
+//
+
+#ifndef PROJECT_BASE_AUTOEXPOSURE_H
+#define PROJECT_BASE_AUTOEXPOSURE_H
+
+#include <glad/glad.h>
+#include <rg/RenderGraph.h>
+
+namespace rg {
+
+// GL 3.3 has no compute shaders, so the histogram is built by scattering one point per
+// sample into a HistogramBins x 1 float target with additive blending. A second pass
+// reduces the histogram into a 1x1 exposure texture, blending it with the previous
+// frame's value for eye adaptation. The tone mapper samples that texture directly; the
+// CPU only sees the value through a ring of pixel pack buffers guarded by fences.
+// The histogram is a transient render graph texture, the two exposure textures persist
+// and get imported into the graph every frame.
+class AutoExposure {
+public:
+    static const int HistogramBins = 64;
+    static const int SamplesX = 128;
+    static const int SamplesY = 72;
+    static const int ReadbackCount = 3;
+
+    bool enabled = true;
+    float minLogLuminance = -10.0f;
+    float maxLogLuminance = 6.0f;
+    float lowPercent = 0.5f;    // darkest part of the histogram that is ignored
+    float highPercent = 0.95f;  // and the brightest
+    float adaptationSpeed = 1.5f;
+    float compensation = 0.0f;  // EV stops on top of the metered value
+    // last exposure that made it back to the CPU, a few frames old
+    float lastExposure = 0.0f;
+
+    static TextureDesc histogramDesc() { return TextureDesc(HistogramBins, 1, GL_R32F, GL_RED, GL_FLOAT, GL_NEAREST); }
+    static TextureDesc exposureDesc() { return TextureDesc(1, 1, GL_R32F, GL_RED, GL_FLOAT, GL_NEAREST); }
+
+    void init() {
+        glGenVertexArrays(1, &m_PointsVAO);
+
+        // start from something sane instead of zero so the first frames aren't black
+        const float initialExposure = 0.07f;
+        glGenTextures(2, m_ExposureTexture);
+        for (int i = 0; i < 2; i++) {
+            glBindTexture(GL_TEXTURE_2D, m_ExposureTexture[i]);
+            glTexImage2D(GL_TEXTURE_2D, 0, GL_R32F, 1, 1, 0, GL_RED, GL_FLOAT, &initialExposure);
+            glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_NEAREST);
+            glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
+        }
+        glBindTexture(GL_TEXTURE_2D, 0);
+
+        glGenBuffers(ReadbackCount, m_ReadbackPBO);
+        for (int i = 0; i < ReadbackCount; i++) {
+            glBindBuffer(GL_PIXEL_PACK_BUFFER, m_ReadbackPBO[i]);
+            glBufferData(GL_PIXEL_PACK_BUFFER, sizeof(float), NULL, GL_STREAM_READ);
+        }
+        glBindBuffer(GL_PIXEL_PACK_BUFFER, 0);
+    }
+
+    // texture holding the exposure the tone mapper should use this frame
+    unsigned int exposureTexture() const { return m_ExposureTexture[m_Current]; }
+
+    // flips the exposure textures at the start of a frame and returns last frame's,
+    // which the reduction pass reads on unit 1 (histogram goes on unit 0)
+    unsigned int swap() {
+        unsigned int previous = m_ExposureTexture[m_Current];
+        m_Current = 1 - m_Current;
+        return previous;
+    }
+
+    // scatter pass into the bound histogram target, histogramShader must be in use
+    // with the scene texture on unit 0
+    void buildHistogram() {
+        glClearColor(0.0f, 0.0f, 0.0f, 0.0f);
+        glClear(GL_COLOR_BUFFER_BIT);
+        glDisable(GL_DEPTH_TEST);
+        glEnable(GL_BLEND);
+        glBlendFunc(GL_ONE, GL_ONE);
+        glBindVertexArray(m_PointsVAO);
+        glDrawArrays(GL_POINTS, 0, SamplesX * SamplesY);
+        glBindVertexArray(0);
+        glDisable(GL_BLEND);
+        glEnable(GL_DEPTH_TEST);
+    }
+
+    // queues an asynchronous copy of the new exposure from the bound framebuffer
+    // and picks up any copies that finished
+    void readback() {
+        if (m_Fence[m_ReadbackSlot] == 0) {
+            glBindBuffer(GL_PIXEL_PACK_BUFFER, m_ReadbackPBO[m_ReadbackSlot]);
+            glReadPixels(0, 0, 1, 1, GL_RED, GL_FLOAT, (void*) 0);
+            glBindBuffer(GL_PIXEL_PACK_BUFFER, 0);
+            m_Fence[m_ReadbackSlot] = glFenceSync(GL_SYNC_GPU_COMMANDS_COMPLETE, 0);
+            m_ReadbackSlot = (m_ReadbackSlot + 1) % ReadbackCount;
+        }
+        for (int i = 0; i < ReadbackCount; i++) {
+            if (m_Fence[i] == 0) {
+                continue;
+            }
+            // zero timeout: only ask, never wait
+            GLenum state = glClientWaitSync(m_Fence[i], 0, 0);
+            if (state != GL_ALREADY_SIGNALED && state != GL_CONDITION_SATISFIED) {
+                continue;
+            }
+            glDeleteSync(m_Fence[i]);
+            m_Fence[i] = 0;
+            glBindBuffer(GL_PIXEL_PACK_BUFFER, m_ReadbackPBO[i]);
+            float* value = (float*) glMapBufferRange(GL_PIXEL_PACK_BUFFER, 0, sizeof(float), GL_MAP_READ_BIT);
+            if (value) {
+                lastExposure = *value;
+                glUnmapBuffer(GL_PIXEL_PACK_BUFFER);
+            }
+            glBindBuffer(GL_PIXEL_PACK_BUFFER, 0);
+        }
+    }
+
+    void release() {
+        for (int i = 0; i < ReadbackCount; i++) {
+            if (m_Fence[i]) {
+                glDeleteSync(m_Fence[i]);
+                m_Fence[i] = 0;
+            }
+        }
+        glDeleteBuffers(ReadbackCount, m_ReadbackPBO);
+        glDeleteTextures(2, m_ExposureTexture);
+        glDeleteVertexArrays(1, &m_PointsVAO);
+    }
+
+private:
+    unsigned int m_PointsVAO = 0; // no attributes, the vertex shader works from gl_VertexID
+    unsigned int m_ExposureTexture[2] = {0, 0};
+    int m_Current = 0;
+    unsigned int m_ReadbackPBO[ReadbackCount] = {};
+    GLsync m_Fence[ReadbackCount] = {};
+    int m_ReadbackSlot = 0;
+};
+
+}
+
+#endif //PROJECT_BASE_AUTOEXPOSURE_H
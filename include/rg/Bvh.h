@@ -0,0 +1,590 @@
+//
+// Bounding volume hierarchies over triangles and over placed copies of them, for ray queries.
+//
+
+#ifndef PROJECT_BASE_BVH_H
+#define PROJECT_BASE_BVH_H
+
+#include <glm/glm.hpp>
+#include <algorithm>
+#include <cmath>
+#include <cstdint>
+#include <vector>
+#if defined(__x86_64__) || defined(__i386__)
+#include <immintrin.h>
+#define RG_BVH_SIMD 1
+#endif
+
+namespace rg {
+
+struct Ray {
+    glm::vec3 origin;
+    glm::vec3 direction;   // any length, t is measured in it
+    float tMax;
+};
+
+struct RayHit {
+    static const uint32_t None = 0xFFFFFFFFu;
+    float t;
+    uint32_t instance;   // SceneBvh instance, None = nothing was hit
+    uint32_t triangle;   // index of the triangle in what the mesh was built from
+    float u, v;          // barycentrics of the hit point
+    bool hit() const { return instance != None; }
+};
+
+// Two to a cache line. Children are allocated in pairs, an inner node keeps the index of the
+// left one and the right one follows it.
+struct BvhNode {
+    glm::vec3 min;
+    uint32_t first;   // inner: left child, leaf: first primitive
+    glm::vec3 max;
+    uint32_t count;   // primitives, 0 for inner nodes
+};
+
+static_assert(sizeof(BvhNode) == 32, "BvhNode is packed two to a cache line");
+
+// Binned SAH build over anything with a box, primitive i spans [mins[i], maxs[i]]. order gets
+// the primitives in the order leaves reference them. A node is split where the surface area
+// heuristic finds it cheapest, and kept as a leaf once splitting costs more than testing every
+// primitive in it, up to maxLeaf primitives. Depth is capped so traversal can use a fixed stack.
+const int BvhMaxDepth = 64;
+
+inline void buildBvh(const std::vector<glm::vec3>& mins, const std::vector<glm::vec3>& maxs, uint32_t maxLeaf,
+                     std::vector<BvhNode>& nodes, std::vector<uint32_t>& order) {
+    const int Bins = 16;
+    const uint32_t count = (uint32_t) mins.size();
+    auto area = [](const glm::vec3& min, const glm::vec3& max) {
+        const glm::vec3 e = glm::max(max - min, glm::vec3(0.0f));
+        return e.x * e.y + e.y * e.z + e.z * e.x;
+    };
+    std::vector<glm::vec3> centroids(count);
+    order.resize(count);
+    for (uint32_t i = 0; i < count; i++) {
+        centroids[i] = (mins[i] + maxs[i]) * 0.5f;
+        order[i] = i;
+    }
+    nodes.clear();
+    nodes.reserve(std::max(1u, 2 * count));
+    nodes.push_back({ glm::vec3(0.0f), 0, glm::vec3(0.0f), count });
+    if (count == 0) {
+        return;
+    }
+
+    struct Pending {
+        uint32_t node;
+        int depth;
+    };
+    std::vector<Pending> pending = { { 0, 0 } };
+    while (!pending.empty()) {
+        const Pending current = pending.back();
+        pending.pop_back();
+        BvhNode& node = nodes[current.node];
+        const uint32_t first = node.first, n = node.count;
+
+        glm::vec3 centroidMin(INFINITY), centroidMax(-INFINITY);
+        node.min = glm::vec3(INFINITY);
+        node.max = glm::vec3(-INFINITY);
+        for (uint32_t i = first; i < first + n; i++) {
+            node.min = glm::min(node.min, mins[order[i]]);
+            node.max = glm::max(node.max, maxs[order[i]]);
+            centroidMin = glm::min(centroidMin, centroids[order[i]]);
+            centroidMax = glm::max(centroidMax, centroids[order[i]]);
+        }
+        if (n <= 1 || current.depth >= BvhMaxDepth - 1) {
+            continue;
+        }
+
+        // cheapest of Bins - 1 planes on each axis, in units of one primitive test
+        int bestAxis = -1, bestBin = 0;
+        float bestCost = INFINITY;
+        for (int axis = 0; axis < 3; axis++) {
+            const float extent = centroidMax[axis] - centroidMin[axis];
+            if (extent <= 0.0f) {
+                continue;
+            }
+            struct Bin {
+                glm::vec3 min = glm::vec3(INFINITY), max = glm::vec3(-INFINITY);
+                uint32_t count = 0;
+            } bins[Bins];
+            const float scale = Bins / extent;
+            for (uint32_t i = first; i < first + n; i++) {
+                const uint32_t p = order[i];
+                Bin& bin = bins[std::min(Bins - 1, (int) ((centroids[p][axis] - centroidMin[axis]) * scale))];
+                bin.min = glm::min(bin.min, mins[p]);
+                bin.max = glm::max(bin.max, maxs[p]);
+                bin.count++;
+            }
+            float rightCost[Bins];
+            glm::vec3 rmin(INFINITY), rmax(-INFINITY);
+            uint32_t rightCount = 0;
+            for (int b = Bins - 1; b > 0; b--) {
+                rmin = glm::min(rmin, bins[b].min);
+                rmax = glm::max(rmax, bins[b].max);
+                rightCount += bins[b].count;
+                rightCost[b] = rightCount ? area(rmin, rmax) * rightCount : 0.0f;
+            }
+            glm::vec3 lmin(INFINITY), lmax(-INFINITY);
+            uint32_t leftCount = 0;
+            for (int b = 1; b < Bins; b++) {
+                lmin = glm::min(lmin, bins[b - 1].min);
+                lmax = glm::max(lmax, bins[b - 1].max);
+                leftCount += bins[b - 1].count;
+                if (leftCount == 0 || leftCount == n) {
+                    continue;
+                }
+                const float cost = area(lmin, lmax) * leftCount + rightCost[b];
+                if (cost < bestCost) {
+                    bestCost = cost;
+                    bestAxis = axis;
+                    bestBin = b;
+                }
+            }
+        }
+
+        // one box test to get into the children, against testing everything here
+        const float nodeArea = area(node.min, node.max);
+        const bool split = bestAxis >= 0 && nodeArea + bestCost < nodeArea * n;
+        if (!split && n <= maxLeaf) {
+            continue;
+        }
+        uint32_t middle;
+        if (bestAxis >= 0) {
+            const float scale = Bins / (centroidMax[bestAxis] - centroidMin[bestAxis]);
+            middle = (uint32_t) (std::partition(order.begin() + first, order.begin() + first + n, [&](uint32_t p) {
+                return std::min(Bins - 1, (int) ((centroids[p][bestAxis] - centroidMin[bestAxis]) * scale)) < bestBin;
+            }) - order.begin());
+        } else {
+            // every centroid in the same spot and too many for a leaf, halves are as good as any
+            middle = first + n / 2;
+        }
+
+        const uint32_t left = (uint32_t) nodes.size();
+        nodes.push_back({ glm::vec3(0.0f), first, glm::vec3(0.0f), middle - first });
+        nodes.push_back({ glm::vec3(0.0f), middle, glm::vec3(0.0f), first + n - middle });
+        BvhNode& parent = nodes[current.node];
+        parent.first = left;
+        parent.count = 0;
+        pending.push_back({ left, current.depth + 1 });
+        pending.push_back({ left + 1, current.depth + 1 });
+    }
+}
+
+#ifdef RG_BVH_SIMD
+// Four rays side by side for the SSE paths. Rays that start close together and point the same
+// way (probes from one vehicle, pixels of a small screen area) mostly visit the same nodes, so
+// one box or triangle test serves all four.
+struct RayPacket {
+    alignas(16) float ox[4], oy[4], oz[4];
+    alignas(16) float dx[4], dy[4], dz[4];
+    alignas(16) float rx[4], ry[4], rz[4];   // 1 / direction
+    alignas(16) float t[4];                  // closest hit so far, or tMax
+    uint32_t triangle[4];
+    float u[4], v[4];
+    int active;                              // lanes in use
+
+    void set(int lane, const glm::vec3& origin, const glm::vec3& direction) {
+        ox[lane] = origin.x; oy[lane] = origin.y; oz[lane] = origin.z;
+        dx[lane] = direction.x; dy[lane] = direction.y; dz[lane] = direction.z;
+        rx[lane] = 1.0f / direction.x; ry[lane] = 1.0f / direction.y; rz[lane] = 1.0f / direction.z;
+    }
+};
+#endif
+
+// Slab test against a node, entry distance or INFINITY if the ray misses it before tMax.
+inline float rayEntersBox(const glm::vec3& origin, const glm::vec3& inverseDirection, float tMax, const BvhNode& node) {
+    const glm::vec3 t0 = (node.min - origin) * inverseDirection;
+    const glm::vec3 t1 = (node.max - origin) * inverseDirection;
+    const glm::vec3 near = glm::min(t0, t1), far = glm::max(t0, t1);
+    const float enter = std::max(std::max(near.x, near.y), std::max(near.z, 0.0f));
+    const float exit = std::min(std::min(far.x, far.y), std::min(far.z, tMax));
+    return enter <= exit ? enter : INFINITY;
+}
+
+// Triangles of one mesh, the bottom level. Built once from positions, the same tree serves
+// every placed copy of the mesh through SceneBvh.
+class TriangleBvh {
+public:
+    // indices are triangles, three to one, into positions
+    void build(const std::vector<glm::vec3>& positions, const std::vector<uint32_t>& indices) {
+        const size_t count = indices.size() / 3;
+        std::vector<glm::vec3> mins(count), maxs(count);
+        for (size_t i = 0; i < count; i++) {
+            const glm::vec3& a = positions[indices[3 * i]];
+            const glm::vec3& b = positions[indices[3 * i + 1]];
+            const glm::vec3& c = positions[indices[3 * i + 2]];
+            mins[i] = glm::min(a, glm::min(b, c));
+            maxs[i] = glm::max(a, glm::max(b, c));
+        }
+        std::vector<uint32_t> order;
+        buildBvh(mins, maxs, 4, m_Nodes, order);
+        // stored in leaf order with the edges precomputed, a leaf's triangles are adjacent
+        m_Triangles.resize(count);
+        for (size_t i = 0; i < count; i++) {
+            const uint32_t t = order[i];
+            const glm::vec3& a = positions[indices[3 * t]];
+            m_Triangles[i] = { a, t, positions[indices[3 * t + 1]] - a, 0.0f, positions[indices[3 * t + 2]] - a, 0.0f };
+        }
+    }
+
+    bool empty() const { return m_Triangles.empty(); }
+    size_t triangleCount() const { return m_Triangles.size(); }
+    size_t nodeCount() const { return m_Nodes.size(); }
+    const BvhNode& root() const { return m_Nodes[0]; }
+
+    // closest triangle before hit.t, updates t, triangle, u and v; true if anything was hit
+    bool intersect(const Ray& ray, RayHit& hit) const {
+        if (empty()) {
+            return false;
+        }
+        const glm::vec3 inverseDirection = 1.0f / ray.direction;
+        bool found = false;
+        uint32_t stack[BvhMaxDepth + 1];
+        int top = 0;
+        stack[top++] = 0;
+        while (top > 0) {
+            const BvhNode& node = m_Nodes[stack[--top]];
+            if (rayEntersBox(ray.origin, inverseDirection, hit.t, node) == INFINITY) {
+                continue;
+            }
+            if (node.count) {
+                for (uint32_t i = node.first; i < node.first + node.count; i++) {
+                    found |= intersectTriangle(m_Triangles[i], ray, hit);
+                }
+                continue;
+            }
+            // the child further along the ray goes on the stack first
+            const BvhNode& left = m_Nodes[node.first];
+            const BvhNode& right = m_Nodes[node.first + 1];
+            const bool leftFirst = glm::dot((left.min + left.max) - (right.min + right.max), ray.direction) <= 0.0f;
+            stack[top++] = leftFirst ? node.first + 1 : node.first;
+            stack[top++] = leftFirst ? node.first : node.first + 1;
+        }
+        return found;
+    }
+
+#ifdef RG_BVH_SIMD
+    // closest hits of the packet's active lanes before their t, returns the lanes that hit
+    int intersect(RayPacket& packet) const {
+        if (empty() || !packet.active) {
+            return 0;
+        }
+        const __m128 ox = _mm_load_ps(packet.ox), oy = _mm_load_ps(packet.oy), oz = _mm_load_ps(packet.oz);
+        const __m128 rx = _mm_load_ps(packet.rx), ry = _mm_load_ps(packet.ry), rz = _mm_load_ps(packet.rz);
+        // children are ordered by the first active ray
+        const int lead = __builtin_ctz(packet.active);
+        const glm::vec3 leadDirection(packet.dx[lead], packet.dy[lead], packet.dz[lead]);
+        int found = 0;
+        uint32_t stack[BvhMaxDepth + 1];
+        int top = 0;
+        stack[top++] = 0;
+        while (top > 0) {
+            const BvhNode& node = m_Nodes[stack[--top]];
+            const __m128 t0x = _mm_mul_ps(_mm_sub_ps(_mm_set1_ps(node.min.x), ox), rx);
+            const __m128 t1x = _mm_mul_ps(_mm_sub_ps(_mm_set1_ps(node.max.x), ox), rx);
+            const __m128 t0y = _mm_mul_ps(_mm_sub_ps(_mm_set1_ps(node.min.y), oy), ry);
+            const __m128 t1y = _mm_mul_ps(_mm_sub_ps(_mm_set1_ps(node.max.y), oy), ry);
+            const __m128 t0z = _mm_mul_ps(_mm_sub_ps(_mm_set1_ps(node.min.z), oz), rz);
+            const __m128 t1z = _mm_mul_ps(_mm_sub_ps(_mm_set1_ps(node.max.z), oz), rz);
+            const __m128 enter = _mm_max_ps(_mm_max_ps(_mm_min_ps(t0x, t1x), _mm_min_ps(t0y, t1y)),
+                                            _mm_max_ps(_mm_min_ps(t0z, t1z), _mm_setzero_ps()));
+            const __m128 exit = _mm_min_ps(_mm_min_ps(_mm_max_ps(t0x, t1x), _mm_max_ps(t0y, t1y)),
+                                           _mm_min_ps(_mm_max_ps(t0z, t1z), _mm_load_ps(packet.t)));
+            const int lanes = _mm_movemask_ps(_mm_cmple_ps(enter, exit)) & packet.active;
+            if (!lanes) {
+                continue;
+            }
+            if (node.count) {
+                for (uint32_t i = node.first; i < node.first + node.count; i++) {
+                    found |= intersectTriangle(m_Triangles[i], packet, lanes);
+                }
+                continue;
+            }
+            const BvhNode& left = m_Nodes[node.first];
+            const BvhNode& right = m_Nodes[node.first + 1];
+            const bool leftFirst = glm::dot((left.min + left.max) - (right.min + right.max), leadDirection) <= 0.0f;
+            stack[top++] = leftFirst ? node.first + 1 : node.first;
+            stack[top++] = leftFirst ? node.first : node.first + 1;
+        }
+        return found;
+    }
+#endif
+
+private:
+    struct Triangle {
+        glm::vec3 v0;
+        uint32_t index;
+        glm::vec3 e1;
+        float pad1;
+        glm::vec3 e2;
+        float pad2;
+    };
+
+    // Moller-Trumbore, both sides
+    static bool intersectTriangle(const Triangle& tri, const Ray& ray, RayHit& hit) {
+        const glm::vec3 p = glm::cross(ray.direction, tri.e2);
+        const float det = glm::dot(tri.e1, p);
+        if (std::abs(det) < 1e-12f) {
+            return false;
+        }
+        const float inverseDet = 1.0f / det;
+        const glm::vec3 s = ray.origin - tri.v0;
+        const float u = glm::dot(s, p) * inverseDet;
+        if (u < 0.0f || u > 1.0f) {
+            return false;
+        }
+        const glm::vec3 q = glm::cross(s, tri.e1);
+        const float v = glm::dot(ray.direction, q) * inverseDet;
+        if (v < 0.0f || u + v > 1.0f) {
+            return false;
+        }
+        const float t = glm::dot(tri.e2, q) * inverseDet;
+        if (t < 0.0f || t >= hit.t) {
+            return false;
+        }
+        hit.t = t;
+        hit.triangle = tri.index;
+        hit.u = u;
+        hit.v = v;
+        return true;
+    }
+
+#ifdef RG_BVH_SIMD
+    // the same test for the lanes of a packet, returns the lanes that hit
+    static int intersectTriangle(const Triangle& tri, RayPacket& packet, int lanes) {
+        const __m128 dx = _mm_load_ps(packet.dx), dy = _mm_load_ps(packet.dy), dz = _mm_load_ps(packet.dz);
+        const __m128 e1x = _mm_set1_ps(tri.e1.x), e1y = _mm_set1_ps(tri.e1.y), e1z = _mm_set1_ps(tri.e1.z);
+        const __m128 e2x = _mm_set1_ps(tri.e2.x), e2y = _mm_set1_ps(tri.e2.y), e2z = _mm_set1_ps(tri.e2.z);
+        // p = d x e2
+        const __m128 px = _mm_sub_ps(_mm_mul_ps(dy, e2z), _mm_mul_ps(dz, e2y));
+        const __m128 py = _mm_sub_ps(_mm_mul_ps(dz, e2x), _mm_mul_ps(dx, e2z));
+        const __m128 pz = _mm_sub_ps(_mm_mul_ps(dx, e2y), _mm_mul_ps(dy, e2x));
+        const __m128 det = _mm_add_ps(_mm_add_ps(_mm_mul_ps(e1x, px), _mm_mul_ps(e1y, py)), _mm_mul_ps(e1z, pz));
+        const __m128 inverseDet = _mm_div_ps(_mm_set1_ps(1.0f), det);
+        // s = o - v0
+        const __m128 sx = _mm_sub_ps(_mm_load_ps(packet.ox), _mm_set1_ps(tri.v0.x));
+        const __m128 sy = _mm_sub_ps(_mm_load_ps(packet.oy), _mm_set1_ps(tri.v0.y));
+        const __m128 sz = _mm_sub_ps(_mm_load_ps(packet.oz), _mm_set1_ps(tri.v0.z));
+        const __m128 u = _mm_mul_ps(_mm_add_ps(_mm_add_ps(_mm_mul_ps(sx, px), _mm_mul_ps(sy, py)), _mm_mul_ps(sz, pz)), inverseDet);
+        // q = s x e1
+        const __m128 qx = _mm_sub_ps(_mm_mul_ps(sy, e1z), _mm_mul_ps(sz, e1y));
+        const __m128 qy = _mm_sub_ps(_mm_mul_ps(sz, e1x), _mm_mul_ps(sx, e1z));
+        const __m128 qz = _mm_sub_ps(_mm_mul_ps(sx, e1y), _mm_mul_ps(sy, e1x));
+        const __m128 v = _mm_mul_ps(_mm_add_ps(_mm_add_ps(_mm_mul_ps(dx, qx), _mm_mul_ps(dy, qy)), _mm_mul_ps(dz, qz)), inverseDet);
+        const __m128 t = _mm_mul_ps(_mm_add_ps(_mm_add_ps(_mm_mul_ps(e2x, qx), _mm_mul_ps(e2y, qy)), _mm_mul_ps(e2z, qz)), inverseDet);
+
+        const __m128 zero = _mm_setzero_ps(), one = _mm_set1_ps(1.0f);
+        const __m128 absDet = _mm_andnot_ps(_mm_set1_ps(-0.0f), det);
+        __m128 accept = _mm_cmpge_ps(absDet, _mm_set1_ps(1e-12f));
+        accept = _mm_and_ps(accept, _mm_cmpge_ps(u, zero));
+        accept = _mm_and_ps(accept, _mm_cmpge_ps(v, zero));
+        accept = _mm_and_ps(accept, _mm_cmple_ps(_mm_add_ps(u, v), one));
+        accept = _mm_and_ps(accept, _mm_cmpge_ps(t, zero));
+        accept = _mm_and_ps(accept, _mm_cmplt_ps(t, _mm_load_ps(packet.t)));
+        const int hits = _mm_movemask_ps(accept) & lanes;
+        if (!hits) {
+            return 0;
+        }
+        _mm_store_ps(packet.t, _mm_or_ps(_mm_and_ps(accept, t), _mm_andnot_ps(accept, _mm_load_ps(packet.t))));
+        alignas(16) float us[4], vs[4];
+        _mm_store_ps(us, u);
+        _mm_store_ps(vs, v);
+        for (int lane = 0; lane < 4; lane++) {
+            if (hits & (1 << lane)) {
+                packet.triangle[lane] = tri.index;
+                packet.u[lane] = us[lane];
+                packet.v[lane] = vs[lane];
+            }
+        }
+        return hits;
+    }
+#endif
+
+    std::vector<BvhNode> m_Nodes;
+    std::vector<Triangle> m_Triangles;   // in leaf order
+};
+
+// Placed copies of meshes, the top level: a tree over the instances' world boxes, each leaf
+// instance takes the ray into its mesh's space and continues in the mesh's own tree. The
+// direction is transformed without normalizing, so t means the same in both spaces. Meshes
+// must outlive the scene; after instances are added or moved, build() again.
+class SceneBvh {
+public:
+    uint32_t add(const TriangleBvh& mesh, const glm::mat4& world) {
+        m_Instances.push_back({ &mesh, world, glm::inverse(world) });
+        return (uint32_t) (m_Instances.size() - 1);
+    }
+
+    void setWorld(uint32_t instance, const glm::mat4& world) {
+        m_Instances[instance].world = world;
+        m_Instances[instance].inverse = glm::inverse(world);
+    }
+
+    void clear() {
+        m_Instances.clear();
+        m_Nodes.clear();
+    }
+
+    void build() {
+        std::vector<glm::vec3> mins(m_Instances.size()), maxs(m_Instances.size());
+        for (size_t i = 0; i < m_Instances.size(); i++) {
+            const Instance& instance = m_Instances[i];
+            if (instance.mesh->empty()) {
+                // nothing to hit, a point keeps the tree well formed
+                mins[i] = maxs[i] = glm::vec3(instance.world[3]);
+                continue;
+            }
+            mins[i] = glm::vec3(INFINITY);
+            maxs[i] = glm::vec3(-INFINITY);
+            const BvhNode& root = instance.mesh->root();
+            for (int corner = 0; corner < 8; corner++) {
+                const glm::vec3 local((corner & 1) ? root.max.x : root.min.x, (corner & 2) ? root.max.y : root.min.y,
+                                      (corner & 4) ? root.max.z : root.min.z);
+                const glm::vec3 p = glm::vec3(instance.world * glm::vec4(local, 1.0f));
+                mins[i] = glm::min(mins[i], p);
+                maxs[i] = glm::max(maxs[i], p);
+            }
+        }
+        std::vector<uint32_t> order;
+        buildBvh(mins, maxs, 1, m_Nodes, order);
+        // leaves reference instances through order, kept as is so ids stay what add() returned
+        m_Order = std::move(order);
+    }
+
+    size_t size() const { return m_Instances.size(); }
+    const glm::mat4& world(uint32_t instance) const { return m_Instances[instance].world; }
+
+    // closest hit before ray.tMax
+    RayHit intersect(const Ray& ray) const {
+        RayHit hit = { ray.tMax, RayHit::None, RayHit::None, 0.0f, 0.0f };
+        if (m_Nodes.empty() || m_Instances.empty()) {
+            return hit;
+        }
+        const glm::vec3 inverseDirection = 1.0f / ray.direction;
+        uint32_t stack[BvhMaxDepth + 1];
+        int top = 0;
+        stack[top++] = 0;
+        while (top > 0) {
+            const BvhNode& node = m_Nodes[stack[--top]];
+            if (rayEntersBox(ray.origin, inverseDirection, hit.t, node) == INFINITY) {
+                continue;
+            }
+            if (node.count) {
+                for (uint32_t i = node.first; i < node.first + node.count; i++) {
+                    const Instance& instance = m_Instances[m_Order[i]];
+                    const Ray local = { glm::vec3(instance.inverse * glm::vec4(ray.origin, 1.0f)),
+                                        glm::vec3(instance.inverse * glm::vec4(ray.direction, 0.0f)), hit.t };
+                    if (instance.mesh->intersect(local, hit)) {
+                        hit.instance = m_Order[i];
+                    }
+                }
+                continue;
+            }
+            const BvhNode& left = m_Nodes[node.first];
+            const BvhNode& right = m_Nodes[node.first + 1];
+            const bool leftFirst = glm::dot((left.min + left.max) - (right.min + right.max), ray.direction) <= 0.0f;
+            stack[top++] = leftFirst ? node.first + 1 : node.first;
+            stack[top++] = leftFirst ? node.first : node.first + 1;
+        }
+        return hit;
+    }
+
+    // A batch, in packets of four consecutive rays; rays that belong together should be next to
+    // each other. Read only, separate ranges of one batch can run on different threads.
+    void intersect(const Ray* rays, RayHit* hits, size_t count) const {
+        size_t i = 0;
+#ifdef RG_BVH_SIMD
+        for (; i < count; i += 4) {
+            intersect4(rays + i, hits + i, (int) std::min<size_t>(4, count - i));
+        }
+#endif
+        for (; i < count; i++) {
+            hits[i] = intersect(rays[i]);
+        }
+    }
+
+private:
+    struct Instance {
+        const TriangleBvh* mesh;
+        glm::mat4 world;
+        glm::mat4 inverse;
+    };
+
+#ifdef RG_BVH_SIMD
+    void intersect4(const Ray* rays, RayHit* hits, int count) const {
+        RayPacket packet;
+        uint32_t instances[4] = { RayHit::None, RayHit::None, RayHit::None, RayHit::None };
+        packet.active = (1 << count) - 1;
+        for (int lane = 0; lane < 4; lane++) {
+            // spare lanes repeat the first ray, masked out
+            const Ray& ray = rays[lane < count ? lane : 0];
+            packet.set(lane, ray.origin, ray.direction);
+            packet.t[lane] = ray.tMax;
+        }
+        if (!m_Nodes.empty() && !m_Instances.empty()) {
+            const __m128 ox = _mm_load_ps(packet.ox), oy = _mm_load_ps(packet.oy), oz = _mm_load_ps(packet.oz);
+            const __m128 rx = _mm_load_ps(packet.rx), ry = _mm_load_ps(packet.ry), rz = _mm_load_ps(packet.rz);
+            const glm::vec3 leadDirection = rays[0].direction;
+            uint32_t stack[BvhMaxDepth + 1];
+            int top = 0;
+            stack[top++] = 0;
+            while (top > 0) {
+                const BvhNode& node = m_Nodes[stack[--top]];
+                const __m128 t0x = _mm_mul_ps(_mm_sub_ps(_mm_set1_ps(node.min.x), ox), rx);
+                const __m128 t1x = _mm_mul_ps(_mm_sub_ps(_mm_set1_ps(node.max.x), ox), rx);
+                const __m128 t0y = _mm_mul_ps(_mm_sub_ps(_mm_set1_ps(node.min.y), oy), ry);
+                const __m128 t1y = _mm_mul_ps(_mm_sub_ps(_mm_set1_ps(node.max.y), oy), ry);
+                const __m128 t0z = _mm_mul_ps(_mm_sub_ps(_mm_set1_ps(node.min.z), oz), rz);
+                const __m128 t1z = _mm_mul_ps(_mm_sub_ps(_mm_set1_ps(node.max.z), oz), rz);
+                const __m128 enter = _mm_max_ps(_mm_max_ps(_mm_min_ps(t0x, t1x), _mm_min_ps(t0y, t1y)),
+                                                _mm_max_ps(_mm_min_ps(t0z, t1z), _mm_setzero_ps()));
+                const __m128 exit = _mm_min_ps(_mm_min_ps(_mm_max_ps(t0x, t1x), _mm_max_ps(t0y, t1y)),
+                                               _mm_min_ps(_mm_max_ps(t0z, t1z), _mm_load_ps(packet.t)));
+                const int lanes = _mm_movemask_ps(_mm_cmple_ps(enter, exit)) & packet.active;
+                if (!lanes) {
+                    continue;
+                }
+                if (node.count) {
+                    for (uint32_t i = node.first; i < node.first + node.count; i++) {
+                        // the packet in the mesh's space, only the lanes that reached the leaf
+                        const Instance& instance = m_Instances[m_Order[i]];
+                        RayPacket local = packet;
+                        local.active = lanes;
+                        for (int lane = 0; lane < 4; lane++) {
+                            local.set(lane, glm::vec3(instance.inverse * glm::vec4(packet.ox[lane], packet.oy[lane], packet.oz[lane], 1.0f)),
+                                      glm::vec3(instance.inverse * glm::vec4(packet.dx[lane], packet.dy[lane], packet.dz[lane], 0.0f)));
+                        }
+                        const int found = instance.mesh->intersect(local);
+                        for (int lane = 0; lane < 4; lane++) {
+                            if (found & (1 << lane)) {
+                                packet.t[lane] = local.t[lane];
+                                packet.triangle[lane] = local.triangle[lane];
+                                packet.u[lane] = local.u[lane];
+                                packet.v[lane] = local.v[lane];
+                                instances[lane] = m_Order[i];
+                            }
+                        }
+                    }
+                    continue;
+                }
+                const BvhNode& left = m_Nodes[node.first];
+                const BvhNode& right = m_Nodes[node.first + 1];
+                const bool leftFirst = glm::dot((left.min + left.max) - (right.min + right.max), leadDirection) <= 0.0f;
+                stack[top++] = leftFirst ? node.first + 1 : node.first;
+                stack[top++] = leftFirst ? node.first : node.first + 1;
+            }
+        }
+        for (int lane = 0; lane < count; lane++) {
+            hits[lane] = { packet.t[lane], instances[lane], instances[lane] == RayHit::None ? RayHit::None : packet.triangle[lane],
+                           packet.u[lane], packet.v[lane] };
+        }
+    }
+#endif
+
+    std::vector<Instance> m_Instances;
+    std::vector<BvhNode> m_Nodes;
+    std::vector<uint32_t> m_Order;   // instances in leaf order
+};
+
+}
+
+#endif //PROJECT_BASE_BVH_H
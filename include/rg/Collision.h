@@ -0,0 +1,190 @@
+//
+// Oriented boxes and spheres: overlap tests, penetration and contact bookkeeping.
+//
+
+#ifndef PROJECT_BASE_COLLISION_H
+#define PROJECT_BASE_COLLISION_H
+
+#include <glm/glm.hpp>
+#include <rg/Components.h>
+#include <rg/SpatialGrid.h>
+#include <cmath>
+#include <cstdint>
+#include <vector>
+#if defined(__x86_64__) || defined(__i386__)
+#include <immintrin.h>
+#define RG_COLLISION_SIMD 1
+#endif
+
+namespace rg {
+
+struct OrientedBox {
+    glm::vec3 center;
+    glm::vec3 axes[3];   // unit length
+    glm::vec3 halfExtents;
+
+    // a collider box carried by a world matrix, rotation and per-axis scale are taken apart
+    static OrientedBox fromCollider(const glm::mat4& world, const Collider& collider) {
+        OrientedBox box;
+        box.center = glm::vec3(world * glm::vec4(collider.center, 1.0f));
+        for (int i = 0; i < 3; i++) {
+            const glm::vec3 column(world[i]);
+            const float length = glm::length(column);
+            box.axes[i] = column / length;
+            box.halfExtents[i] = collider.halfExtents[i] * length;
+        }
+        return box;
+    }
+
+    // axis aligned box around it, for the broadphase
+    void bounds(glm::vec3& min, glm::vec3& max) const {
+        glm::vec3 extent(0.0f);
+        for (int i = 0; i < 3; i++) {
+            extent += glm::abs(axes[i]) * halfExtents[i];
+        }
+        min = center - extent;
+        max = center + extent;
+    }
+};
+
+// How far a has to move along normal to stop touching b.
+struct Contact {
+    glm::vec3 normal;
+    float depth;
+};
+
+// Separating axis test over the 3 + 3 face normals and the 9 edge cross products. On overlap
+// the axis with the least penetration gives the contact, oriented from b towards a.
+inline bool boxesOverlap(const OrientedBox& a, const OrientedBox& b, Contact& contact) {
+    const glm::vec3 offset = a.center - b.center;
+    contact.depth = INFINITY;
+    auto test = [&](glm::vec3 axis) {
+        const float length = glm::length(axis);
+        // parallel edges give no axis, the face normals cover that case
+        if (length < 1e-5f) {
+            return true;
+        }
+        axis /= length;
+        float ra = 0.0f, rb = 0.0f;
+        for (int i = 0; i < 3; i++) {
+            ra += std::abs(glm::dot(a.axes[i], axis)) * a.halfExtents[i];
+            rb += std::abs(glm::dot(b.axes[i], axis)) * b.halfExtents[i];
+        }
+        const float distance = glm::dot(offset, axis);
+        const float overlap = ra + rb - std::abs(distance);
+        if (overlap < 0.0f) {
+            return false;
+        }
+        if (overlap < contact.depth) {
+            contact.depth = overlap;
+            contact.normal = distance < 0.0f ? -axis : axis;
+        }
+        return true;
+    };
+    for (int i = 0; i < 3; i++) {
+        if (!test(a.axes[i]) || !test(b.axes[i])) {
+            return false;
+        }
+    }
+    for (int i = 0; i < 3; i++) {
+        for (int j = 0; j < 3; j++) {
+            if (!test(glm::cross(a.axes[i], b.axes[j]))) {
+                return false;
+            }
+        }
+    }
+    return true;
+}
+
+inline bool sphereTouchesBox(const OrientedBox& box, const glm::vec3& center, float radius) {
+    const glm::vec3 d = center - box.center;
+    float distance = 0.0f;
+    for (int i = 0; i < 3; i++) {
+        const float local = glm::dot(d, box.axes[i]);
+        const float outside = std::abs(local) - box.halfExtents[i];
+        if (outside > 0.0f) {
+            distance += outside * outside;
+        }
+    }
+    return distance <= radius * radius;
+}
+
+// Narrowphase over a broadphase cell: appends the ids of the items whose sphere touches the box.
+// Four items per iteration with SSE, the items are read in order so each cell streams
+// through the cache once.
+inline void spheresTouchingBox(const OrientedBox& box, const SpatialGrid::Item* items, size_t count, std::vector<uint32_t>& hits) {
+    size_t i = 0;
+#ifdef RG_COLLISION_SIMD
+    const __m128 cx = _mm_set1_ps(box.center.x), cy = _mm_set1_ps(box.center.y), cz = _mm_set1_ps(box.center.z);
+    const __m128 signMask = _mm_set1_ps(-0.0f), zero = _mm_setzero_ps();
+    __m128 ax[3], ay[3], az[3], h[3];
+    for (int a = 0; a < 3; a++) {
+        ax[a] = _mm_set1_ps(box.axes[a].x);
+        ay[a] = _mm_set1_ps(box.axes[a].y);
+        az[a] = _mm_set1_ps(box.axes[a].z);
+        h[a] = _mm_set1_ps(box.halfExtents[a]);
+    }
+    for (; i + 4 <= count; i += 4) {
+        const SpatialGrid::Item* s = items + i;
+        const __m128 dx = _mm_sub_ps(_mm_setr_ps(s[0].center.x, s[1].center.x, s[2].center.x, s[3].center.x), cx);
+        const __m128 dy = _mm_sub_ps(_mm_setr_ps(s[0].center.y, s[1].center.y, s[2].center.y, s[3].center.y), cy);
+        const __m128 dz = _mm_sub_ps(_mm_setr_ps(s[0].center.z, s[1].center.z, s[2].center.z, s[3].center.z), cz);
+        const __m128 r = _mm_setr_ps(s[0].radius, s[1].radius, s[2].radius, s[3].radius);
+        __m128 distance = zero;
+        for (int a = 0; a < 3; a++) {
+            const __m128 local = _mm_add_ps(_mm_add_ps(_mm_mul_ps(dx, ax[a]), _mm_mul_ps(dy, ay[a])), _mm_mul_ps(dz, az[a]));
+            const __m128 outside = _mm_max_ps(_mm_sub_ps(_mm_andnot_ps(signMask, local), h[a]), zero);
+            distance = _mm_add_ps(distance, _mm_mul_ps(outside, outside));
+        }
+        int mask = _mm_movemask_ps(_mm_cmple_ps(distance, _mm_mul_ps(r, r)));
+        while (mask) {
+            const int lane = __builtin_ctz(mask);
+            hits.push_back(s[lane].id);
+            mask &= mask - 1;
+        }
+    }
+#endif
+    for (; i < count; i++) {
+        if (sphereTouchesBox(box, items[i].center, items[i].radius)) {
+            hits.push_back(items[i].id);
+        }
+    }
+}
+
+// Ids touching this step versus the step before, so a contact is reported once when it starts
+// rather than every step it lasts.
+class ContactSet {
+public:
+    void begin() {
+        m_Now.clear();
+    }
+
+    // true if id was not touching the step before
+    bool add(uint32_t id) {
+        if (id >= m_Touching.size()) {
+            m_Touching.resize(id + 1, 0);
+        }
+        m_Now.push_back(id);
+        return !m_Touching[id];
+    }
+
+    void end() {
+        for (uint32_t id : m_Before) {
+            m_Touching[id] = 0;
+        }
+        for (uint32_t id : m_Now) {
+            m_Touching[id] = 1;
+        }
+        std::swap(m_Before, m_Now);
+    }
+
+    size_t touching() const { return m_Before.size(); }
+
+private:
+    std::vector<uint8_t> m_Touching;   // by id
+    std::vector<uint32_t> m_Before, m_Now;
+};
+
+}
+
+#endif //PROJECT_BASE_COLLISION_H
@@ -0,0 +1,42 @@
+//
+// 16 byte instance format for instances that only need position, yaw and uniform scale.
+//
+
+#ifndef PROJECT_BASE_COMPACTINSTANCE_H
+#define PROJECT_BASE_COMPACTINSTANCE_H
+
+#include <glm/glm.hpp>
+#include <glm/gtc/packing.hpp>
+#include <cstdint>
+
+namespace rg {
+
+// A quarter of a mat4. Everything is a half float except the variation, the vertex shader
+// rebuilds the matrix (include/transform.glsl, COMPACT_INSTANCE). Halves keep about three
+// significant digits: 0.03 units at 50 from the origin, fine for a crowd, not for anything
+// that has to line up with other geometry - that stays on the mat4 path.
+struct CompactInstance {
+    uint16_t position[3];   // attribute 5 .xyz
+    uint16_t yaw;           // attribute 5 .w, radians around +Y
+    uint16_t scale;         // attribute 6
+    uint16_t variation;     // attribute 7, integer, free for the shaders to pick a look by
+    uint32_t reserved;      // keeps instances 16 byte aligned
+};
+
+static_assert(sizeof(CompactInstance) == 16, "CompactInstance is uploaded as is");
+
+inline CompactInstance packCompactInstance(const glm::vec3& position, float yaw, float scale, uint16_t variation) {
+    CompactInstance instance;
+    instance.position[0] = glm::packHalf1x16(position.x);
+    instance.position[1] = glm::packHalf1x16(position.y);
+    instance.position[2] = glm::packHalf1x16(position.z);
+    instance.yaw = glm::packHalf1x16(yaw);
+    instance.scale = glm::packHalf1x16(scale);
+    instance.variation = variation;
+    instance.reserved = 0;
+    return instance;
+}
+
+}
+
+#endif //PROJECT_BASE_COMPACTINSTANCE_H
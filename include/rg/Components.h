@@ -0,0 +1,80 @@
+//
+// Scene components stored in rg::EntityWorld. Plain data, systems live where they are used.
+//
+
+#ifndef PROJECT_BASE_COMPONENTS_H
+#define PROJECT_BASE_COMPONENTS_H
+
+#include <glm/glm.hpp>
+#include <glm/gtc/quaternion.hpp>
+#include <cstdint>
+
+namespace rg {
+
+// the transform itself is built into EntityWorld, see TransformStore
+
+const uint32_t RenderCullFace = 1u << 0;
+
+struct Renderable {
+    uint32_t model;      // index into the scene's shared model table
+    uint32_t features;   // permutation bits that follow from the asset (rg::Feature*)
+    uint32_t flags;      // Render*
+};
+
+// drawn in one instanced call together with every other instanced entity of its model
+struct Instanced {
+    uint16_t variation = 0;   // handed to the shaders with compact instances
+};
+
+// bounding sphere around the transform's origin, in world units
+struct Bounds {
+    float radius;
+};
+
+// solid box in the entity's local space, carried by its world matrix (see rg::OrientedBox)
+struct Collider {
+    glm::vec3 center;
+    glm::vec3 halfExtents;
+};
+
+const uint32_t LightSpot = 0;
+const uint32_t LightPoint = 1;
+
+// position comes from the transform (or the attachment), uniform is the struct name in the shader
+struct Light {
+    uint32_t type;
+    const char* uniform;
+    glm::vec3 direction;
+    glm::vec3 ambient;
+    glm::vec3 diffuse;
+    glm::vec3 specular;
+    float constant;
+    float linear;
+    float quadratic;
+    float cutOff;        // spot lights only, cosines
+    float outerCutOff;
+};
+
+struct Vehicle {
+    float speed;
+    float steer;
+    glm::vec3 forward;
+};
+
+// transform at the start of the last fixed simulation step, rendering blends from it to the
+// current transform (see FixedTimestep::alpha)
+struct Motion {
+    glm::vec3 previousPosition;
+    glm::quat previousRotation;
+};
+
+// world matrix = node's world matrix in a TransformHierarchy * translate(offset),
+// instead of the entity's own transform
+struct Attachment {
+    int node;
+    glm::vec3 offset;
+};
+
+}
+
+#endif //PROJECT_BASE_COMPONENTS_H
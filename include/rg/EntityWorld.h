@@ -0,0 +1,278 @@
+//
+// Archetype entity/component storage: entities with the same set of components share contiguous arrays.
+//
+
+#ifndef PROJECT_BASE_ENTITYWORLD_H
+#define PROJECT_BASE_ENTITYWORLD_H
+
+#include <glm/glm.hpp>
+#include <glm/gtc/quaternion.hpp>
+#include <atomic>
+#include <cstdint>
+#include <cstring>
+#include <map>
+#include <memory>
+#include <type_traits>
+#include <vector>
+#include <rg/Error.h>
+#include <rg/TransformStore.h>
+
+namespace rg {
+
+struct Entity {
+    uint32_t index = 0xFFFFFFFFu;
+    uint32_t generation = 0;
+
+    bool operator==(const Entity& o) const { return index == o.index && generation == o.generation; }
+    bool operator!=(const Entity& o) const { return !(*this == o); }
+};
+
+// Every entity has a transform. It lives in its archetype's TransformStore (SoA), so systems
+// hand whole archetypes to the SIMD matrix kernel without copying. Other components are
+// trivially copyable structs, one tightly packed array per component type per archetype.
+// Adding or removing a component moves the entity to another archetype (swap-remove on
+// the old one), the arrays only ever grow geometrically: no per-entity allocations and no
+// pointers to follow while iterating. Entity handles carry a generation, stale ones are
+// detected by alive().
+class EntityWorld {
+public:
+    static const int MaxComponents = 32;
+
+    template<typename... C>
+    Entity create(const glm::vec3& position, const glm::quat& rotation, const glm::vec3& scale, const C&... components) {
+        const uint32_t mask = maskOf<C...>();
+        Archetype& archetype = archetypeFor(mask);
+        const Entity entity = allocate();
+        const uint32_t row = (uint32_t) archetype.entities.size();
+        archetype.entities.push_back(entity);
+        archetype.transforms.add(position, rotation, scale);
+        int expand[] = { 0, (archetype.template push<C>(components), 0)... };
+        (void) expand;
+        m_Slots[entity.index].archetype = archetype.index;
+        m_Slots[entity.index].row = row;
+        return entity;
+    }
+
+    void destroy(Entity entity) {
+        ASSERT(alive(entity), "EntityWorld: destroying a dead entity");
+        Slot& slot = m_Slots[entity.index];
+        removeRow(*m_Archetypes[slot.archetype], slot.row);
+        slot.generation++;
+        m_Free.push_back(entity.index);
+    }
+
+    bool alive(Entity entity) const {
+        return entity.index < m_Slots.size() && m_Slots[entity.index].generation == entity.generation;
+    }
+
+    template<typename C>
+    bool has(Entity entity) const {
+        return (m_Archetypes[m_Slots[entity.index].archetype]->mask & bit<C>()) != 0;
+    }
+
+    template<typename C>
+    C& get(Entity entity) {
+        ASSERT(alive(entity) && has<C>(entity), "EntityWorld: entity has no such component");
+        const Slot& slot = m_Slots[entity.index];
+        return m_Archetypes[slot.archetype]->template column<C>()[slot.row];
+    }
+
+    template<typename C>
+    void add(Entity entity, const C& component) {
+        ASSERT(!has<C>(entity), "EntityWorld: component already present");
+        const uint32_t row = move(entity, m_Archetypes[m_Slots[entity.index].archetype]->mask | bit<C>());
+        Archetype& target = *m_Archetypes[m_Slots[entity.index].archetype];
+        target.template column<C>()[row] = component;
+    }
+
+    template<typename C>
+    void remove(Entity entity) {
+        ASSERT(has<C>(entity), "EntityWorld: component not present");
+        move(entity, m_Archetypes[m_Slots[entity.index].archetype]->mask & ~bit<C>());
+    }
+
+    // transform of a single entity; systems that touch many should use each()
+    TransformStore& transforms(Entity entity, TransformStore::Handle& row) {
+        const Slot& slot = m_Slots[entity.index];
+        row = slot.row;
+        return m_Archetypes[slot.archetype]->transforms;
+    }
+    glm::vec3 position(Entity entity) { TransformStore::Handle row; return transforms(entity, row).position(row); }
+    void setPosition(Entity entity, const glm::vec3& p) { TransformStore::Handle row; transforms(entity, row).setPosition(row, p); }
+    void setRotation(Entity entity, const glm::quat& q) { TransformStore::Handle row; transforms(entity, row).setRotation(row, q); }
+    glm::mat4 matrix(Entity entity) { TransformStore::Handle row; return transforms(entity, row).matrix(row); }
+
+    // f(TransformStore&, const Entity*, size_t count, C*...) once per archetype that has all
+    // of C and none of the components in without (see maskOf), with count > 0; the arrays
+    // are indexed by the same row as the transform store
+    template<typename... C, typename F>
+    void each(F f, uint32_t without = 0) {
+        const uint32_t mask = maskOf<C...>();
+        for (auto& archetype : m_Archetypes) {
+            if ((archetype->mask & mask) == mask && !(archetype->mask & without) && !archetype->entities.empty()) {
+                f(archetype->transforms, (const Entity*) archetype->entities.data(), archetype->entities.size(),
+                  archetype->template column<C>()...);
+            }
+        }
+    }
+
+    template<typename... C>
+    static uint32_t maskOf() {
+        uint32_t mask = 0;
+        int expand[] = { 0, (mask |= bit<C>(), 0)... };
+        (void) expand;
+        return mask;
+    }
+
+    size_t entityCount() const { return m_Slots.size() - m_Free.size(); }
+    size_t archetypeCount() const { return m_Archetypes.size(); }
+
+private:
+    struct Column {
+        size_t elementSize = 0;
+        std::vector<unsigned char> bytes;
+    };
+
+    struct Archetype {
+        uint32_t index = 0;
+        uint32_t mask = 0;
+        std::vector<Entity> entities;
+        TransformStore transforms;
+        Column columns[MaxComponents];
+
+        template<typename C>
+        C* column() { return (C*) columns[EntityWorld::componentId<C>()].bytes.data(); }
+
+        template<typename C>
+        void push(const C& component) {
+            Column& c = columns[EntityWorld::componentId<C>()];
+            const size_t at = c.bytes.size();
+            c.bytes.resize(at + sizeof(C));
+            std::memcpy(&c.bytes[at], &component, sizeof(C));
+        }
+    };
+
+    struct Slot {
+        uint32_t archetype = 0;
+        uint32_t row = 0;
+        uint32_t generation = 0;
+    };
+
+    std::vector<std::unique_ptr<Archetype>> m_Archetypes;
+    std::map<uint32_t, uint32_t> m_ArchetypeByMask;
+    std::vector<Slot> m_Slots;
+    std::vector<uint32_t> m_Free;
+
+    // Shared by every world; worlds on different threads may register their types concurrently.
+    // The counter hands out unique ids, and a size is published before componentId returns the
+    // id it belongs to, so a world only ever reads the sizes of ids it was given.
+    static std::atomic<int>& componentCount() {
+        static std::atomic<int> count(0);
+        return count;
+    }
+
+    static std::atomic<size_t>& componentSize(int id) {
+        static std::atomic<size_t> sizes[MaxComponents] = {};
+        return sizes[id];
+    }
+
+    template<typename C>
+    static int componentId() {
+        static_assert(std::is_trivially_copyable<C>::value, "components are moved with memcpy");
+        static const int id = registerComponent(sizeof(C));
+        return id;
+    }
+
+    static int registerComponent(size_t size) {
+        const int id = componentCount()++;
+        ASSERT(id < MaxComponents, "EntityWorld: too many component types");
+        componentSize(id).store(size, std::memory_order_release);
+        return id;
+    }
+
+    template<typename C>
+    static uint32_t bit() { return 1u << componentId<C>(); }
+
+    Archetype& archetypeFor(uint32_t mask) {
+        auto found = m_ArchetypeByMask.find(mask);
+        if (found != m_ArchetypeByMask.end()) {
+            return *m_Archetypes[found->second];
+        }
+        std::unique_ptr<Archetype> archetype(new Archetype());
+        archetype->index = (uint32_t) m_Archetypes.size();
+        archetype->mask = mask;
+        // only the ids in mask, another thread may be registering one that is not
+        for (uint32_t bits = mask; bits; bits &= bits - 1) {
+            const int id = __builtin_ctz(bits);
+            archetype->columns[id].elementSize = componentSize(id).load(std::memory_order_acquire);
+        }
+        m_ArchetypeByMask[mask] = archetype->index;
+        m_Archetypes.push_back(std::move(archetype));
+        return *m_Archetypes.back();
+    }
+
+    Entity allocate() {
+        Entity entity;
+        if (!m_Free.empty()) {
+            entity.index = m_Free.back();
+            m_Free.pop_back();
+        } else {
+            entity.index = (uint32_t) m_Slots.size();
+            m_Slots.push_back(Slot());
+        }
+        entity.generation = m_Slots[entity.index].generation;
+        return entity;
+    }
+
+    // swap-remove, fixing the slot of the entity that moved into row
+    void removeRow(Archetype& archetype, uint32_t row) {
+        const uint32_t last = (uint32_t) archetype.entities.size() - 1;
+        archetype.transforms.removeSwap(row);
+        for (Column& column : archetype.columns) {
+            if (column.elementSize == 0) {
+                continue;
+            }
+            if (row != last) {
+                std::memcpy(&column.bytes[row * column.elementSize], &column.bytes[last * column.elementSize], column.elementSize);
+            }
+            column.bytes.resize(last * column.elementSize);
+        }
+        archetype.entities[row] = archetype.entities[last];
+        archetype.entities.pop_back();
+        if (row != last) {
+            m_Slots[archetype.entities[row].index].row = row;
+        }
+    }
+
+    // copies the entity into the archetype for mask, returns its new row
+    uint32_t move(Entity entity, uint32_t mask) {
+        Slot& slot = m_Slots[entity.index];
+        // archetypeFor may grow m_Archetypes, take the source by index afterwards
+        Archetype& target = archetypeFor(mask);
+        Archetype& source = *m_Archetypes[slot.archetype];
+        const uint32_t row = (uint32_t) target.entities.size();
+        target.entities.push_back(entity);
+        target.transforms.add(source.transforms.position(slot.row), source.transforms.rotation(slot.row),
+                              source.transforms.scale(slot.row));
+        for (int id = 0; id < MaxComponents; id++) {
+            Column& to = target.columns[id];
+            if (to.elementSize == 0) {
+                continue;
+            }
+            const size_t at = to.bytes.size();
+            to.bytes.resize(at + to.elementSize);
+            const Column& from = source.columns[id];
+            if (from.elementSize) {
+                std::memcpy(&to.bytes[at], &from.bytes[slot.row * from.elementSize], to.elementSize);
+            }
+        }
+        removeRow(source, slot.row);
+        slot.archetype = target.index;
+        slot.row = row;
+        return row;
+    }
+};
+
+}
+
+#endif //PROJECT_BASE_ENTITYWORLD_H
@@ -0,0 +1,54 @@
+//
+// Accumulator for a fixed-rate simulation driven by a variable frame rate.
+//
+
+#ifndef PROJECT_BASE_FIXEDTIMESTEP_H
+#define PROJECT_BASE_FIXEDTIMESTEP_H
+
+#include <algorithm>
+#include <cmath>
+
+namespace rg {
+
+// Every frame adds its real duration, the simulation then runs as many whole steps as fit.
+// Whatever is left is the fraction of a step that rendering is ahead of the last simulated
+// state, alpha() is used to blend between the last two states so motion stays smooth at any
+// frame rate. The same inputs always produce the same states, regardless of vsync or load.
+class FixedTimestep {
+public:
+    explicit FixedTimestep(double hz = 120.0, int maxSteps = 8)
+            : m_Step(1.0 / hz), m_MaxSteps(maxSteps) {}
+
+    // steps to simulate for a frame that took frameSeconds. A hitch that would need more
+    // than maxSteps drops the rest: the simulation falls behind real time for a moment
+    // instead of every following frame getting slower trying to catch up.
+    int advance(double frameSeconds) {
+        m_Accumulator += std::max(0.0, frameSeconds);
+        int steps = (int) (m_Accumulator / m_Step);
+        m_Accumulator -= steps * m_Step;
+        if (steps > m_MaxSteps) {
+            m_DroppedSteps += steps - m_MaxSteps;
+            steps = m_MaxSteps;
+        }
+        m_LastSteps = steps;
+        return steps;
+    }
+
+    float stepSeconds() const { return (float) m_Step; }
+    double hz() const { return 1.0 / m_Step; }
+    // 0 = the previous simulated state, 1 = the current one
+    float alpha() const { return (float) std::min(1.0, m_Accumulator / m_Step); }
+    int lastSteps() const { return m_LastSteps; }
+    long droppedSteps() const { return m_DroppedSteps; }
+
+private:
+    double m_Step;
+    int m_MaxSteps;
+    double m_Accumulator = 0.0;
+    int m_LastSteps = 0;
+    long m_DroppedSteps = 0;
+};
+
+}
+
+#endif //PROJECT_BASE_FIXEDTIMESTEP_H
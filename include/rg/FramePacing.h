@@ -0,0 +1,133 @@
+//
+// Frame pacing modes, late latched camera state and input-to-present latency.
+//
+
+#ifndef PROJECT_BASE_FRAMEPACING_H
+#define PROJECT_BASE_FRAMEPACING_H
+
+#include <GLFW/glfw3.h>
+#include <algorithm>
+#include <chrono>
+#include <cstdint>
+#include <mutex>
+#include <thread>
+
+namespace rg {
+
+enum class PacingMode {
+    VSync,      // swap interval 1
+    Adaptive,   // swap interval -1, tears instead of waiting a whole refresh when a frame is late
+    Capped,     // no vsync, the game thread waits for a fixed frame rate
+    Uncapped
+};
+
+// Lives on the game thread, the swap interval is applied by whoever owns the context.
+class FramePacer {
+public:
+    PacingMode mode = PacingMode::VSync;
+    int cappedFps = 60;
+    double spinMs = 1.5;   // the last bit before the deadline is spun, sleep is too coarse for it
+
+    // Called before input is sampled: in capped mode the frame starts on its deadline, so the
+    // wait happens before the input is read and not between reading it and showing it.
+    void waitForFrame() {
+        if (mode != PacingMode::Capped || cappedFps <= 0) {
+            m_Next = 0.0;
+            return;
+        }
+        const double period = 1.0 / cappedFps;
+        double now = glfwGetTime();
+        // first capped frame or more than a frame behind: start counting from here
+        if (m_Next == 0.0 || now - m_Next > period) {
+            m_Next = now;
+        }
+        const double sleepUntil = m_Next - spinMs / 1000.0;
+        if (now < sleepUntil) {
+            std::this_thread::sleep_for(std::chrono::duration<double>(sleepUntil - now));
+        }
+        while (glfwGetTime() < m_Next) {
+            std::this_thread::yield();
+        }
+        m_Next += period;
+    }
+
+    // tearControl: the driver has WGL/GLX_EXT_swap_control_tear, otherwise adaptive is plain vsync
+    static int swapInterval(PacingMode mode, bool tearControl) {
+        switch (mode) {
+            case PacingMode::VSync: return 1;
+            case PacingMode::Adaptive: return tearControl ? -1 : 1;
+            case PacingMode::Capped: return 0;
+            case PacingMode::Uncapped: return 0;
+        }
+        return 1;
+    }
+
+    static bool tearControlSupported() {
+        return glfwExtensionSupported("WGL_EXT_swap_control_tear") || glfwExtensionSupported("GLX_EXT_swap_control_tear");
+    }
+
+private:
+    double m_Next = 0.0;
+};
+
+// The newest value of something the game thread keeps updating, read by the render thread
+// right before it submits. Every publish gets a sequence number so the reader can tell
+// whether it is newer than what it already has.
+template<typename T>
+class LateLatch {
+public:
+    uint64_t publish(const T& value) {
+        std::lock_guard<std::mutex> lock(m_Mutex);
+        m_Value = value;
+        return ++m_Sequence;
+    }
+
+    // copies the value if anything newer than `after` was published
+    bool latest(uint64_t after, T& value) const {
+        std::lock_guard<std::mutex> lock(m_Mutex);
+        if (m_Sequence <= after) {
+            return false;
+        }
+        value = m_Value;
+        return true;
+    }
+
+private:
+    T m_Value;
+    uint64_t m_Sequence = 0;
+    mutable std::mutex m_Mutex;
+};
+
+// Time from sampling input to the swap that shows it, as seen from the CPU: the swap
+// returning is the closest the application gets to the frame being presented.
+class LatencyMeter {
+public:
+    void record(double inputTime, double presentTime) {
+        const float ms = (float) ((presentTime - inputTime) * 1000.0);
+        m_LastMs = ms;
+        m_AverageMs = m_Samples == 0 ? ms : m_AverageMs + (ms - m_AverageMs) * 0.05f;
+        m_WindowMax = std::max(m_WindowMax, ms);
+        if (++m_Samples % window == 0) {
+            m_MaxMs = m_WindowMax;
+            m_WindowMax = 0.0f;
+        }
+    }
+
+    float lastMs() const { return m_LastMs; }
+    float averageMs() const { return m_AverageMs; }
+    // worst frame of the last full window
+    float maxMs() const { return m_Samples < window ? m_WindowMax : m_MaxMs; }
+
+    static const int window = 120;
+
+private:
+    float m_LastMs = 0.0f;
+    float m_AverageMs = 0.0f;
+    float m_MaxMs = 0.0f;
+    float m_WindowMax = 0.0f;
+    long m_Samples = 0;
+};
+
+}
+
+#endif //PROJECT_BASE_FRAMEPACING_H
@@ -0,0 +1,84 @@
+//
+// Frame packets from the game thread to the render thread, double buffered.
+//
+
+#ifndef PROJECT_BASE_FRAMEPIPELINE_H
+#define PROJECT_BASE_FRAMEPIPELINE_H
+
+#include <GLFW/glfw3.h>
+#include <condition_variable>
+#include <mutex>
+
+namespace rg {
+
+// Two packets: the game thread fills one while the render thread draws the other, so the
+// simulation of frame N+1 overlaps GL submission and swap of frame N. A packet is never
+// touched by the game thread between submit() and the render thread's release(), the render
+// thread only ever reads it. The game thread runs at most one frame ahead, beginWrite()
+// blocks until the render thread is done with the older packet.
+template<typename Packet>
+class FramePipeline {
+public:
+    // game thread
+    Packet& beginWrite() {
+        std::unique_lock<std::mutex> lock(m_Mutex);
+        const double begin = glfwGetTime();
+        m_Changed.wait(lock, [&]() { return m_State[m_Write] == Free; });
+        m_GameWaitMs = (float) ((glfwGetTime() - begin) * 1000.0);
+        return m_Packets[m_Write];
+    }
+
+    void submit() {
+        std::lock_guard<std::mutex> lock(m_Mutex);
+        m_State[m_Write] = Ready;
+        m_Write ^= 1;
+        m_Changed.notify_all();
+    }
+
+    // render thread: the oldest submitted packet, nullptr once stopped and everything submitted was drawn
+    const Packet* acquire() {
+        std::unique_lock<std::mutex> lock(m_Mutex);
+        const double begin = glfwGetTime();
+        m_Changed.wait(lock, [&]() { return m_State[m_Read] == Ready || m_Stopped; });
+        m_RenderWaitMs = (float) ((glfwGetTime() - begin) * 1000.0);
+        if (m_State[m_Read] != Ready) {
+            return nullptr;
+        }
+        m_State[m_Read] = Reading;
+        return &m_Packets[m_Read];
+    }
+
+    void release() {
+        std::lock_guard<std::mutex> lock(m_Mutex);
+        m_State[m_Read] = Free;
+        m_Read ^= 1;
+        m_Changed.notify_all();
+    }
+
+    void stop() {
+        std::lock_guard<std::mutex> lock(m_Mutex);
+        m_Stopped = true;
+        m_Changed.notify_all();
+    }
+
+    // how long each side last waited for the other, for the performance window
+    float gameWaitMs() const { std::lock_guard<std::mutex> lock(m_Mutex); return m_GameWaitMs; }
+    float renderWaitMs() const { std::lock_guard<std::mutex> lock(m_Mutex); return m_RenderWaitMs; }
+
+private:
+    enum State { Free, Ready, Reading };
+
+    Packet m_Packets[2];
+    State m_State[2] = { Free, Free };
+    int m_Write = 0;
+    int m_Read = 0;
+    bool m_Stopped = false;
+    float m_GameWaitMs = 0.0f;
+    float m_RenderWaitMs = 0.0f;
+    mutable std::mutex m_Mutex;
+    std::condition_variable m_Changed;
+};
+
+}
+
+#endif //PROJECT_BASE_FRAMEPIPELINE_H
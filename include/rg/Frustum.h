@@ -0,0 +1,65 @@
+//
+// View frustum planes for CPU-side culling.
+//
+
+#ifndef PROJECT_BASE_FRUSTUM_H
+#define PROJECT_BASE_FRUSTUM_H
+
+#include <glm/glm.hpp>
+
+namespace rg {
+
+// Planes are extracted from projection * view (Gribb/Hartmann), normals point inwards and are
+// normalized so sphere tests can compare distances directly.
+struct Frustum {
+    glm::vec4 planes[6];
+
+    static Frustum fromMatrix(const glm::mat4& viewProjection) {
+        Frustum frustum;
+        glm::vec4 rows[4];
+        for (int i = 0; i < 4; i++) {
+            rows[i] = glm::vec4(viewProjection[0][i], viewProjection[1][i], viewProjection[2][i], viewProjection[3][i]);
+        }
+        for (int i = 0; i < 3; i++) {
+            frustum.planes[2 * i] = rows[3] + rows[i];
+            frustum.planes[2 * i + 1] = rows[3] - rows[i];
+        }
+        for (glm::vec4& plane : frustum.planes) {
+            plane = plane * (1.0f / glm::length(glm::vec3(plane)));
+        }
+        return frustum;
+    }
+
+    bool intersectsSphere(const glm::vec3& center, float radius) const {
+        for (const glm::vec4& plane : planes) {
+            if (glm::dot(glm::vec3(plane), center) + plane.w < -radius) {
+                return false;
+            }
+        }
+        return true;
+    }
+
+    enum Containment { Outside, Intersects, Inside };
+
+    // axis aligned box, tested with the corner furthest along each plane's normal and the one
+    // furthest against it. Inside means all of the box is, whatever is in it needs no more tests.
+    Containment classifyBox(const glm::vec3& min, const glm::vec3& max) const {
+        Containment result = Inside;
+        for (const glm::vec4& plane : planes) {
+            const glm::vec3 normal(plane);
+            const glm::vec3 furthest(normal.x >= 0.0f ? max.x : min.x, normal.y >= 0.0f ? max.y : min.y, normal.z >= 0.0f ? max.z : min.z);
+            const glm::vec3 nearest(normal.x >= 0.0f ? min.x : max.x, normal.y >= 0.0f ? min.y : max.y, normal.z >= 0.0f ? min.z : max.z);
+            if (glm::dot(normal, furthest) + plane.w < 0.0f) {
+                return Outside;
+            }
+            if (glm::dot(normal, nearest) + plane.w < 0.0f) {
+                result = Intersects;
+            }
+        }
+        return result;
+    }
+};
+
+}
+
+#endif //PROJECT_BASE_FRUSTUM_H
@@ -0,0 +1,82 @@
+//
+// Optional GL entry points beyond the 3.3 core that glad was generated for.
+//
+
+#ifndef PROJECT_BASE_GLEXTENSIONS_H
+#define PROJECT_BASE_GLEXTENSIONS_H
+
+#include <glad/glad.h>
+#include <GLFW/glfw3.h>
+
+// ARB_get_program_binary (core in 4.1)
+#ifndef GL_PROGRAM_BINARY_RETRIEVABLE_HINT
+#define GL_PROGRAM_BINARY_RETRIEVABLE_HINT 0x8257
+#define GL_PROGRAM_BINARY_LENGTH 0x8741
+#define GL_NUM_PROGRAM_BINARY_FORMATS 0x87FE
+#endif
+// KHR/ARB_parallel_shader_compile, same enum value in both
+#ifndef GL_COMPLETION_STATUS_KHR
+#define GL_COMPLETION_STATUS_KHR 0x91B1
+#endif
+// ARB_buffer_storage (core in 4.4)
+#ifndef GL_MAP_PERSISTENT_BIT
+#define GL_MAP_PERSISTENT_BIT 0x0040
+#define GL_MAP_COHERENT_BIT 0x0080
+#endif
+
+namespace rg {
+
+typedef void (APIENTRYP PFNRGGETPROGRAMBINARYPROC)(GLuint program, GLsizei bufSize, GLsizei* length, GLenum* binaryFormat, void* binary);
+typedef void (APIENTRYP PFNRGPROGRAMBINARYPROC)(GLuint program, GLenum binaryFormat, const void* binary, GLsizei length);
+typedef void (APIENTRYP PFNRGPROGRAMPARAMETERIPROC)(GLuint program, GLenum pname, GLint value);
+typedef void (APIENTRYP PFNRGMAXSHADERCOMPILERTHREADSPROC)(GLuint count);
+typedef void (APIENTRYP PFNRGBUFFERSTORAGEPROC)(GLenum target, GLsizeiptr size, const void* data, GLbitfield flags);
+
+// Filled in once after gladLoadGLLoader, every feature flag is false if the driver doesn't
+// expose it, callers keep a core 3.3 path for that case.
+struct GLExtensions {
+    bool programBinary = false;
+    PFNRGGETPROGRAMBINARYPROC GetProgramBinary = nullptr;
+    PFNRGPROGRAMBINARYPROC ProgramBinary = nullptr;
+    PFNRGPROGRAMPARAMETERIPROC ProgramParameteri = nullptr;
+
+    // "KHR", "ARB" or nullptr
+    const char* parallelShaderCompile = nullptr;
+    PFNRGMAXSHADERCOMPILERTHREADSPROC MaxShaderCompilerThreads = nullptr;
+
+    bool bufferStorage = false;
+    PFNRGBUFFERSTORAGEPROC BufferStorage = nullptr;
+
+    void load() {
+        if (glfwExtensionSupported("GL_ARB_get_program_binary")) {
+            GetProgramBinary = (PFNRGGETPROGRAMBINARYPROC) glfwGetProcAddress("glGetProgramBinary");
+            ProgramBinary = (PFNRGPROGRAMBINARYPROC) glfwGetProcAddress("glProgramBinary");
+            ProgramParameteri = (PFNRGPROGRAMPARAMETERIPROC) glfwGetProcAddress("glProgramParameteri");
+            GLint formats = 0;
+            glGetIntegerv(GL_NUM_PROGRAM_BINARY_FORMATS, &formats);
+            // some drivers advertise the extension with zero formats, which means no caching
+            programBinary = GetProgramBinary && ProgramBinary && ProgramParameteri && formats > 0;
+        }
+        if (glfwExtensionSupported("GL_KHR_parallel_shader_compile")) {
+            MaxShaderCompilerThreads = (PFNRGMAXSHADERCOMPILERTHREADSPROC) glfwGetProcAddress("glMaxShaderCompilerThreadsKHR");
+            parallelShaderCompile = MaxShaderCompilerThreads ? "KHR" : nullptr;
+        }
+        if (!parallelShaderCompile && glfwExtensionSupported("GL_ARB_parallel_shader_compile")) {
+            MaxShaderCompilerThreads = (PFNRGMAXSHADERCOMPILERTHREADSPROC) glfwGetProcAddress("glMaxShaderCompilerThreadsARB");
+            parallelShaderCompile = MaxShaderCompilerThreads ? "ARB" : nullptr;
+        }
+        if (glfwExtensionSupported("GL_ARB_buffer_storage")) {
+            BufferStorage = (PFNRGBUFFERSTORAGEPROC) glfwGetProcAddress("glBufferStorage");
+            bufferStorage = BufferStorage != nullptr;
+        }
+    }
+};
+
+inline GLExtensions& glExtensions() {
+    static GLExtensions extensions;
+    return extensions;
+}
+
+}
+
+#endif //PROJECT_BASE_GLEXTENSIONS_H
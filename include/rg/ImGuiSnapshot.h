@@ -0,0 +1,52 @@
+//
+// A copy of ImGui's draw data that outlives the next ImGui::NewFrame().
+//
+
+#ifndef PROJECT_BASE_IMGUISNAPSHOT_H
+#define PROJECT_BASE_IMGUISNAPSHOT_H
+
+#include <imgui.h>
+#include <vector>
+
+namespace rg {
+
+// ImGui::GetDrawData() points into the context and is rebuilt by the next frame, the render
+// thread draws one frame later from its own clone of the command lists.
+class ImGuiSnapshot {
+public:
+    ImGuiSnapshot() = default;
+    ImGuiSnapshot(const ImGuiSnapshot&) = delete;
+    ImGuiSnapshot& operator=(const ImGuiSnapshot&) = delete;
+    ~ImGuiSnapshot() { clear(); }
+
+    void capture(const ImDrawData* data) {
+        clear();
+        if (!data || !data->Valid) {
+            return;
+        }
+        for (int i = 0; i < data->CmdListsCount; i++) {
+            m_Lists.push_back(data->CmdLists[i]->CloneOutput());
+        }
+        m_Data = *data;
+        m_Data.CmdLists = m_Lists.data();
+    }
+
+    void clear() {
+        for (ImDrawList* list : m_Lists) {
+            IM_DELETE(list);
+        }
+        m_Lists.clear();
+        m_Data.Clear();
+    }
+
+    // nullptr when nothing was captured; the backend takes a non-const pointer but only reads
+    ImDrawData* drawData() const { return m_Data.Valid ? const_cast<ImDrawData*>(&m_Data) : nullptr; }
+
+private:
+    std::vector<ImDrawList*> m_Lists;
+    ImDrawData m_Data;
+};
+
+}
+
+#endif //PROJECT_BASE_IMGUISNAPSHOT_H
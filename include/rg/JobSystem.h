@@ -0,0 +1,298 @@
+//
+// Work-stealing job system for per-frame CPU work (culling, instance data, animation).
+//
+
+#ifndef PROJECT_BASE_JOBSYSTEM_H
+#define PROJECT_BASE_JOBSYSTEM_H
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <deque>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+#include <rg/Error.h>
+
+namespace rg {
+
+class JobSystem;
+
+// Number of unfinished jobs a caller can wait on. Jobs queued with runAfter() start once the
+// counter they depend on drops to zero, which is how dependencies between jobs are expressed.
+class JobCounter {
+public:
+    // The job that brings the count to zero still holds m_Mutex while it collects the
+    // continuations, the lock here waits for it to let go, so a counter that reads done can be
+    // destroyed right away (they usually live on the waiting thread's stack).
+    bool done() const {
+        if (m_Value.load(std::memory_order_acquire) != 0) {
+            return false;
+        }
+        std::lock_guard<std::mutex> lock(m_Mutex);
+        return m_Value.load(std::memory_order_acquire) == 0;
+    }
+
+private:
+    friend class JobSystem;
+    std::atomic<int> m_Value{0};
+    mutable std::mutex m_Mutex;
+    std::vector<std::function<void()>> m_Continuations;
+};
+
+// one finished job, times in milliseconds since JobSystem::beginFrame()
+struct JobMarker {
+    const char* name;
+    int thread;
+    float start;
+    float end;
+};
+
+// Thread 0 is whoever called init() (the main thread), it runs jobs only while it waits.
+// Every thread owns a deque: it pushes and pops at the back (newest first, warm caches),
+// idle threads steal from the front of the others (oldest first, usually the biggest chunks).
+// Each deque has its own mutex, contention is one owner against the occasional thief.
+// Job names must be string literals, markers keep the pointer.
+class JobSystem {
+public:
+    ~JobSystem() { shutdown(); }
+
+    // threadCount includes the calling thread, 0 picks one per hardware thread
+    void init(int threadCount = 0) {
+        if (threadCount <= 0) {
+            threadCount = std::max(1, (int) std::thread::hardware_concurrency());
+        }
+        m_Queues.clear();
+        for (int i = 0; i < threadCount; i++) {
+            m_Queues.emplace_back(new Queue());
+        }
+        threadIndex() = 0;
+        m_Stop = false;
+        for (int i = 1; i < threadCount; i++) {
+            m_Threads.emplace_back(&JobSystem::workerLoop, this, i);
+        }
+    }
+
+    // finishes everything already queued (and whatever that queues), then joins the workers
+    // in order, no job runs after this returns
+    void shutdown() {
+        if (m_Queues.empty()) {
+            return;
+        }
+        while (m_Unfinished.load(std::memory_order_acquire) > 0) {
+            if (!runOne()) {
+                std::this_thread::yield();
+            }
+        }
+        {
+            std::lock_guard<std::mutex> lock(m_SleepMutex);
+            m_Stop = true;
+        }
+        m_Wake.notify_all();
+        for (std::thread& thread : m_Threads) {
+            thread.join();
+        }
+        m_Threads.clear();
+        m_Queues.clear();
+    }
+
+    int threadCount() const { return (int) m_Queues.size(); }
+
+    void run(const char* name, std::function<void()> job, JobCounter* counter = nullptr) {
+        if (counter) {
+            counter->m_Value.fetch_add(1, std::memory_order_relaxed);
+        }
+        push(Job{ name, std::move(job), counter });
+    }
+
+    // queues job once dependency is done, immediately if it already is
+    void runAfter(JobCounter& dependency, const char* name, std::function<void()> job, JobCounter* counter = nullptr) {
+        if (counter) {
+            counter->m_Value.fetch_add(1, std::memory_order_relaxed);
+        }
+        m_Unfinished.fetch_add(1, std::memory_order_relaxed);
+        Job deferred{ name, std::move(job), counter };
+        // the Job is moved into a shared_ptr so the continuation stays copyable for std::function
+        std::shared_ptr<Job> held = std::make_shared<Job>(std::move(deferred));
+        std::function<void()> start = [this, held]() {
+            m_Unfinished.fetch_sub(1, std::memory_order_relaxed);
+            push(std::move(*held));
+        };
+        {
+            std::lock_guard<std::mutex> lock(dependency.m_Mutex);
+            if (dependency.m_Value.load(std::memory_order_acquire) > 0) {
+                dependency.m_Continuations.push_back(start);
+                return;
+            }
+        }
+        start();
+    }
+
+    // body(begin, end) over [0, count) in chunks of at most grain, all counted on counter
+    void parallelFor(const char* name, int count, int grain, const std::function<void(int, int)>& body, JobCounter& counter) {
+        grain = std::max(1, grain);
+        for (int begin = 0; begin < count; begin += grain) {
+            const int end = std::min(count, begin + grain);
+            run(name, [body, begin, end]() { body(begin, end); }, &counter);
+        }
+    }
+
+    // runs other jobs until counter is done, safe to call from inside a job
+    void wait(JobCounter& counter) {
+        while (!counter.done()) {
+            if (!runOne()) {
+                std::this_thread::yield();
+            }
+        }
+    }
+
+    // markers are collected per frame, from every thread
+    void beginFrame() {
+        for (auto& queue : m_Queues) {
+            std::lock_guard<std::mutex> lock(queue->markerMutex);
+            queue->markers.clear();
+        }
+        m_FrameStart = Clock::now();
+    }
+
+    std::vector<JobMarker> markers() const {
+        std::vector<JobMarker> all;
+        for (auto& queue : m_Queues) {
+            std::lock_guard<std::mutex> lock(queue->markerMutex);
+            all.insert(all.end(), queue->markers.begin(), queue->markers.end());
+        }
+        std::sort(all.begin(), all.end(), [](const JobMarker& a, const JobMarker& b) { return a.start < b.start; });
+        return all;
+    }
+
+private:
+    typedef std::chrono::steady_clock Clock;
+
+    struct Job {
+        const char* name;
+        std::function<void()> function;
+        JobCounter* counter;
+    };
+
+    struct Queue {
+        std::mutex mutex;
+        std::deque<Job> jobs;
+        mutable std::mutex markerMutex;
+        std::vector<JobMarker> markers;
+    };
+
+    std::vector<std::unique_ptr<Queue>> m_Queues;
+    std::vector<std::thread> m_Threads;
+    std::atomic<int> m_Queued{0};
+    std::atomic<int> m_Unfinished{0};   // queued, running or waiting on a dependency
+    std::mutex m_SleepMutex;
+    std::condition_variable m_Wake;
+    bool m_Stop = false;
+    Clock::time_point m_FrameStart;
+
+    static int& threadIndex() {
+        static thread_local int index = 0;
+        return index;
+    }
+
+    void push(Job job) {
+        ASSERT(!m_Queues.empty(), "JobSystem used before init()");
+        Queue& queue = *m_Queues[threadIndex()];
+        m_Unfinished.fetch_add(1, std::memory_order_relaxed);
+        {
+            std::lock_guard<std::mutex> lock(queue.mutex);
+            queue.jobs.push_back(std::move(job));
+        }
+        {
+            // taking the lock orders the increment against a worker checking it before sleeping
+            std::lock_guard<std::mutex> lock(m_SleepMutex);
+            m_Queued.fetch_add(1, std::memory_order_release);
+        }
+        m_Wake.notify_one();
+    }
+
+    bool take(Job& job) {
+        const int self = threadIndex();
+        {
+            Queue& own = *m_Queues[self];
+            std::lock_guard<std::mutex> lock(own.mutex);
+            if (!own.jobs.empty()) {
+                job = std::move(own.jobs.back());
+                own.jobs.pop_back();
+                return true;
+            }
+        }
+        const int count = (int) m_Queues.size();
+        for (int i = 1; i < count; i++) {
+            Queue& victim = *m_Queues[(self + i) % count];
+            std::lock_guard<std::mutex> lock(victim.mutex);
+            if (!victim.jobs.empty()) {
+                job = std::move(victim.jobs.front());
+                victim.jobs.pop_front();
+                return true;
+            }
+        }
+        return false;
+    }
+
+    bool runOne() {
+        Job job;
+        if (!take(job)) {
+            return false;
+        }
+        m_Queued.fetch_sub(1, std::memory_order_relaxed);
+        const float start = elapsedMs();
+        job.function();
+        const float end = elapsedMs();
+        {
+            Queue& own = *m_Queues[threadIndex()];
+            std::lock_guard<std::mutex> lock(own.markerMutex);
+            own.markers.push_back({ job.name, threadIndex(), start, end });
+        }
+        if (job.counter) {
+            finish(*job.counter);
+        }
+        m_Unfinished.fetch_sub(1, std::memory_order_release);
+        return true;
+    }
+
+    // the counter must not be touched once the lock is released, see JobCounter::done()
+    void finish(JobCounter& counter) {
+        std::vector<std::function<void()>> ready;
+        {
+            std::lock_guard<std::mutex> lock(counter.m_Mutex);
+            if (counter.m_Value.fetch_sub(1, std::memory_order_acq_rel) == 1) {
+                ready.swap(counter.m_Continuations);
+            }
+        }
+        for (auto& start : ready) {
+            start();
+        }
+    }
+
+    void workerLoop(int index) {
+        threadIndex() = index;
+        for (;;) {
+            if (runOne()) {
+                continue;
+            }
+            std::unique_lock<std::mutex> lock(m_SleepMutex);
+            m_Wake.wait(lock, [this] { return m_Stop || m_Queued.load(std::memory_order_acquire) > 0; });
+            if (m_Stop) {
+                return;
+            }
+        }
+    }
+
+    float elapsedMs() const {
+        return std::chrono::duration<float, std::milli>(Clock::now() - m_FrameStart).count();
+    }
+};
+
+}
+
+#endif //PROJECT_BASE_JOBSYSTEM_H
@@ -0,0 +1,85 @@
+//
+// Render on demand: fewer frames while nothing changes, none while minimized.
+//
+
+#ifndef PROJECT_BASE_POWERSAVER_H
+#define PROJECT_BASE_POWERSAVER_H
+
+#include <GLFW/glfw3.h>
+
+namespace rg {
+
+enum class Activity {
+    Active,      // full rate
+    Idle,        // nothing changed for a while, a frame every idleInterval
+    Unfocused,   // another window has focus, a frame every unfocusedInterval
+    Minimized    // no frames until the window comes back
+};
+
+// The game loop reports every frame whether anything visible changed (input, simulation,
+// camera, ui), the callbacks report raw input. Before the next frame wait() blocks in
+// glfwWaitEvents* for as long as the activity allows, any event ends the wait at once.
+class PowerSaver {
+public:
+    bool enabled = true;
+    double settleSeconds = 1.0;        // frames keep coming this long after the last change, for exposure and resolution to settle
+    double idleInterval = 0.25;
+    double unfocusedInterval = 0.05;   // still enough frames for the simulation to keep up while something moves
+
+    // from the glfw input callbacks
+    void inputEvent() { m_Input = true; }
+
+    // end of a frame, changed = the frame differed from the one before it
+    void update(double now, bool changed) {
+        if (changed || m_Input) {
+            m_LastChange = now;
+        }
+        m_Input = false;
+    }
+
+    Activity activity(GLFWwindow* window, double now) const {
+        if (glfwGetWindowAttrib(window, GLFW_ICONIFIED)) {
+            return Activity::Minimized;
+        }
+        const bool still = now - m_LastChange > settleSeconds;
+        if (!glfwGetWindowAttrib(window, GLFW_FOCUSED)) {
+            return still ? Activity::Idle : Activity::Unfocused;
+        }
+        return still ? Activity::Idle : Activity::Active;
+    }
+
+    // before a frame, returns what the frame was waited for as
+    Activity wait(GLFWwindow* window) {
+        const Activity activity = enabled ? this->activity(window, glfwGetTime()) : Activity::Active;
+        switch (activity) {
+            case Activity::Active:
+                break;
+            case Activity::Idle:
+                glfwWaitEventsTimeout(idleInterval);
+                break;
+            case Activity::Unfocused:
+                glfwWaitEventsTimeout(unfocusedInterval);
+                break;
+            case Activity::Minimized:
+                while (glfwGetWindowAttrib(window, GLFW_ICONIFIED) && !glfwWindowShouldClose(window)) {
+                    glfwWaitEvents();
+                }
+                // coming back is a change, the first frames after it are drawn at full rate
+                m_LastChange = glfwGetTime();
+                break;
+        }
+        m_Last = activity;
+        return activity;
+    }
+
+    Activity last() const { return m_Last; }
+
+private:
+    double m_LastChange = 0.0;
+    bool m_Input = true;
+    Activity m_Last = Activity::Active;
+};
+
+}
+
+#endif //PROJECT_BASE_POWERSAVER_H
@@ -0,0 +1,174 @@
+//
+// On-disk cache of linked program binaries, skips GLSL compilation on later launches.
+//
+
+#ifndef PROJECT_BASE_PROGRAMBINARYCACHE_H
+#define PROJECT_BASE_PROGRAMBINARYCACHE_H
+
+#include <glad/glad.h>
+#include <atomic>
+#include <cstdint>
+#include <cstdio>
+#include <cstring>
+#include <iostream>
+#include <mutex>
+#include <string>
+#include <vector>
+#include <sys/stat.h>
+#include <rg/GLExtensions.h>
+
+namespace rg {
+
+// Entries are keyed by an FNV-1a hash of the final sources (permutation #defines included)
+// and the driver's vendor/renderer/version strings, so editing a shader or updating the
+// driver simply misses. A binary the driver refuses anyway is deleted and the program is
+// compiled from source, callers never see the difference.
+//
+// load() and store() may run on any thread with a current context (the shader reloader builds
+// on its own), the files are only touched under a lock and the counters are atomic.
+class ProgramBinaryCache {
+public:
+    std::atomic<int> hits{0};
+    std::atomic<int> misses{0};
+    std::atomic<int> rejected{0};
+
+    void init(const std::string& directory) {
+        m_Enabled = glExtensions().programBinary;
+        if (!m_Enabled) {
+            return;
+        }
+        m_Directory = directory;
+        mkdir(m_Directory.c_str(), 0755);
+
+        m_DriverHash = FnvOffset;
+        const GLenum strings[] = { GL_VENDOR, GL_RENDERER, GL_VERSION, GL_SHADING_LANGUAGE_VERSION };
+        for (GLenum name : strings) {
+            const char* value = (const char*) glGetString(name);
+            m_DriverHash = hash(m_DriverHash, value ? value : "");
+        }
+    }
+
+    bool enabled() const { return m_Enabled; }
+
+    uint64_t key(const char* vertex, const char* fragment, const char* geometry) const {
+        uint64_t h = hash(m_DriverHash, vertex);
+        // separators so moving text from one stage to the other changes the key
+        h = hash(h, "\x1f");
+        h = hash(h, fragment);
+        h = hash(h, "\x1f");
+        return hash(h, geometry ? geometry : "");
+    }
+
+    // links program from the cached binary, false if there is none or the driver refused it
+    bool load(uint64_t key, GLuint program) {
+        const std::string file = path(key);
+        Header header;
+        std::vector<char> binary;
+        bool ok;
+        {
+            std::lock_guard<std::mutex> lock(m_FileMutex);
+            FILE* in = fopen(file.c_str(), "rb");
+            if (!in) {
+                misses++;
+                return false;
+            }
+            ok = fread(&header, sizeof(header), 1, in) == 1 && header.magic == Magic && header.key == key
+                 && header.driverHash == m_DriverHash && header.length > 0;
+            if (ok) {
+                binary.resize(header.length);
+                ok = fread(binary.data(), 1, binary.size(), in) == binary.size();
+            }
+            fclose(in);
+        }
+
+        GLint linked = 0;
+        if (ok) {
+            glExtensions().ProgramBinary(program, header.format, binary.data(), (GLsizei) binary.size());
+            glGetProgramiv(program, GL_LINK_STATUS, &linked);
+        }
+        if (!linked) {
+            rejected++;
+            std::lock_guard<std::mutex> lock(m_FileMutex);
+            std::remove(file.c_str());
+            return false;
+        }
+        hits++;
+        return true;
+    }
+
+    // call before glLinkProgram, some drivers only keep the binary around when asked to
+    void prepare(GLuint program) {
+        glExtensions().ProgramParameteri(program, GL_PROGRAM_BINARY_RETRIEVABLE_HINT, GL_TRUE);
+    }
+
+    void store(uint64_t key, GLuint program) {
+        GLint linked = 0, length = 0;
+        glGetProgramiv(program, GL_LINK_STATUS, &linked);
+        glGetProgramiv(program, GL_PROGRAM_BINARY_LENGTH, &length);
+        if (!linked || length <= 0) {
+            return;
+        }
+        std::vector<char> binary(length);
+        Header header;
+        header.key = key;
+        header.driverHash = m_DriverHash;
+        glExtensions().GetProgramBinary(program, length, &length, &header.format, binary.data());
+        header.length = (uint32_t) length;
+
+        // write next to the final name and rename, a crash never leaves half a binary behind
+        const std::string file = path(key);
+        const std::string temporary = file + ".tmp";
+        std::lock_guard<std::mutex> lock(m_FileMutex);
+        FILE* out = fopen(temporary.c_str(), "wb");
+        if (!out) {
+            return;
+        }
+        bool ok = fwrite(&header, sizeof(header), 1, out) == 1 && fwrite(binary.data(), 1, header.length, out) == header.length;
+        ok = fclose(out) == 0 && ok;
+        if (!ok || std::rename(temporary.c_str(), file.c_str()) != 0) {
+            std::remove(temporary.c_str());
+        }
+    }
+
+private:
+    static const uint32_t Magic = 0x42505247; // "GRPB"
+    static const uint64_t FnvOffset = 14695981039346656037ull;
+    static const uint64_t FnvPrime = 1099511628211ull;
+
+    struct Header {
+        uint32_t magic = Magic;
+        GLenum format = 0;
+        uint64_t key = 0;
+        uint64_t driverHash = 0;
+        uint32_t length = 0;
+        uint32_t padding = 0;
+    };
+
+    bool m_Enabled = false;
+    std::string m_Directory;
+    std::mutex m_FileMutex;
+    uint64_t m_DriverHash = 0;
+
+    static uint64_t hash(uint64_t h, const char* text) {
+        for (const unsigned char* c = (const unsigned char*) text; *c; c++) {
+            h ^= *c;
+            h *= FnvPrime;
+        }
+        return h;
+    }
+
+    std::string path(uint64_t key) const {
+        char name[32];
+        snprintf(name, sizeof(name), "%016llx.bin", (unsigned long long) key);
+        return m_Directory + "/" + name;
+    }
+};
+
+inline ProgramBinaryCache& programBinaryCache() {
+    static ProgramBinaryCache cache;
+    return cache;
+}
+
+}
+
+#endif //PROJECT_BASE_PROGRAMBINARYCACHE_H
@@ -0,0 +1,476 @@
+//
+// Small render graph: passes declare what they read and write, the graph orders them,
+// drops the ones nobody needs and lets transient textures share storage.
+//
+
+#ifndef PROJECT_BASE_RENDERGRAPH_H
+#define PROJECT_BASE_RENDERGRAPH_H
+
+#include <glad/glad.h>
+#include <algorithm>
+#include <cstddef>
+#include <functional>
+#include <iostream>
+#include <map>
+#include <string>
+#include <vector>
+#include <rg/Error.h>
+
+namespace rg {
+
+struct TextureDesc {
+    int width = 0;
+    int height = 0;
+    GLenum internalFormat = GL_RGBA16F;
+    GLenum format = GL_RGBA;
+    GLenum type = GL_FLOAT;
+    GLenum filter = GL_LINEAR;
+
+    TextureDesc() = default;
+    TextureDesc(int w, int h, GLenum internal, GLenum fmt, GLenum t, GLenum f = GL_LINEAR)
+        : width(w), height(h), internalFormat(internal), format(fmt), type(t), filter(f) {}
+
+    bool operator==(const TextureDesc& o) const {
+        return width == o.width && height == o.height && internalFormat == o.internalFormat
+               && format == o.format && type == o.type && filter == o.filter;
+    }
+
+    bool isDepth() const {
+        return internalFormat == GL_DEPTH24_STENCIL8 || internalFormat == GL_DEPTH_COMPONENT24
+               || internalFormat == GL_DEPTH_COMPONENT32F;
+    }
+
+    size_t bytes() const {
+        size_t texel = 4;
+        switch (internalFormat) {
+            case GL_R8: texel = 1; break;
+            case GL_R16F: texel = 2; break;
+            case GL_RGBA16F: texel = 8; break;
+            case GL_RGBA32F: texel = 16; break;
+            default: texel = 4; break;
+        }
+        return texel * (size_t) width * (size_t) height;
+    }
+};
+
+class RenderGraph {
+public:
+    typedef int Resource;
+    typedef int Pass;
+
+    struct Report {
+        int passes = 0;
+        int culledPasses = 0;
+        int transientTextures = 0;
+        int physicalTextures = 0;
+        size_t transientBytes = 0;  // every transient texture on its own
+        size_t physicalBytes = 0;   // what the frame actually needed after aliasing
+        size_t peakLiveBytes = 0;   // largest amount alive at once on the pass timeline
+        size_t pooledBytes = 0;     // everything the pool currently holds, incl. other sizes
+
+        bool operator==(const Report& o) const {
+            return passes == o.passes && culledPasses == o.culledPasses && transientTextures == o.transientTextures
+                   && physicalTextures == o.physicalTextures && physicalBytes == o.physicalBytes
+                   && peakLiveBytes == o.peakLiveBytes && pooledBytes == o.pooledBytes;
+        }
+        bool operator!=(const Report& o) const { return !(*this == o); }
+    };
+
+    struct PassInfo {
+        std::string name;
+        bool culled;
+    };
+
+    // print the memory report to stdout whenever it changes
+    bool printReport = true;
+
+    // drops last frame's declarations, pooled textures and framebuffers stay alive
+    void reset() {
+        m_Resources.clear();
+        m_Passes.clear();
+        m_Order.clear();
+        m_Compiled = false;
+        m_Frame++;
+    }
+
+    Resource create(const std::string& name, const TextureDesc& desc) {
+        ResourceNode r;
+        r.name = name;
+        r.desc = desc;
+        m_Resources.push_back(r);
+        return (Resource) m_Resources.size() - 1;
+    }
+
+    // textures owned by someone else (persistent state), the graph never frees them
+    Resource import(const std::string& name, unsigned int texture, const TextureDesc& desc) {
+        Resource r = create(name, desc);
+        m_Resources[r].imported = true;
+        m_Resources[r].texture = texture;
+        return r;
+    }
+
+    // the default framebuffer, always counts as a graph output
+    Resource importBackbuffer(const std::string& name, int width, int height) {
+        Resource r = import(name, 0, TextureDesc(width, height, GL_RGBA8, GL_RGBA, GL_UNSIGNED_BYTE));
+        m_Resources[r].backbuffer = true;
+        m_Resources[r].output = true;
+        return r;
+    }
+
+    void markOutput(Resource r) {
+        m_Resources[r].output = true;
+    }
+
+    Pass addPass(const std::string& name, std::function<void()> execute) {
+        PassNode p;
+        p.name = name;
+        p.execute = execute;
+        m_Passes.push_back(p);
+        return (Pass) m_Passes.size() - 1;
+    }
+
+    void read(Pass pass, Resource r) {
+        m_Passes[pass].reads.push_back(r);
+        m_Resources[r].readers.push_back(pass);
+    }
+
+    // color writes become attachments in declaration order (location 0, 1, ...)
+    void write(Pass pass, Resource r) {
+        m_Passes[pass].writes.push_back(r);
+        m_Resources[r].producers.push_back(pass);
+    }
+
+    // physical texture behind a resource, valid inside pass callbacks
+    unsigned int texture(Resource r) const {
+        return m_Resources[r].texture;
+    }
+
+    void compile() {
+        cull();
+        order();
+        assignPhysical();
+        m_Compiled = true;
+    }
+
+    void execute() {
+        ASSERT(m_Compiled, "RenderGraph::execute called before compile");
+        for (Pass p : m_Order) {
+            PassNode& pass = m_Passes[p];
+            bindTargets(pass);
+            pass.execute();
+        }
+        glBindFramebuffer(GL_FRAMEBUFFER, 0);
+        collectGarbage();
+
+        if (printReport && m_Report != m_PrintedReport) {
+            m_PrintedReport = m_Report;
+            std::cout << "[RenderGraph] passes " << m_Report.passes - m_Report.culledPasses << "/" << m_Report.passes
+                      << ", textures " << m_Report.physicalTextures << " physical for " << m_Report.transientTextures
+                      << " transient, " << m_Report.physicalBytes / 1024 << " KiB used of "
+                      << m_Report.transientBytes / 1024 << " KiB unaliased, peak live "
+                      << m_Report.peakLiveBytes / 1024 << " KiB, pool " << m_Report.pooledBytes / 1024 << " KiB"
+                      << std::endl;
+        }
+    }
+
+    const Report& report() const { return m_Report; }
+
+    std::vector<PassInfo> passes() const {
+        std::vector<PassInfo> result;
+        for (const PassNode& p : m_Passes) {
+            result.push_back({ p.name, p.culled });
+        }
+        return result;
+    }
+
+    void release() {
+        for (auto& fbo : m_Framebuffers) {
+            glDeleteFramebuffers(1, &fbo.second);
+        }
+        m_Framebuffers.clear();
+        for (Physical& p : m_Pool) {
+            glDeleteTextures(1, &p.texture);
+        }
+        m_Pool.clear();
+    }
+
+private:
+    struct ResourceNode {
+        std::string name;
+        TextureDesc desc;
+        bool imported = false;
+        bool backbuffer = false;
+        bool output = false;
+        bool dropped = false;   // color write nobody reads, bound as GL_NONE
+        unsigned int texture = 0;
+        int refCount = 0;
+        int first = -1;
+        int last = -1;
+        std::vector<Pass> producers;
+        std::vector<Pass> readers;
+    };
+
+    struct PassNode {
+        std::string name;
+        std::function<void()> execute;
+        std::vector<Resource> reads;
+        std::vector<Resource> writes;
+        int refCount = 0;
+        bool culled = false;
+    };
+
+    struct Physical {
+        TextureDesc desc;
+        unsigned int texture = 0;
+        int busyUntil = -1;     // position in the pass order after which it's free again
+        long long lastFrame = 0;
+    };
+
+    std::vector<ResourceNode> m_Resources;
+    std::vector<PassNode> m_Passes;
+    std::vector<Pass> m_Order;
+    std::vector<Physical> m_Pool;
+    std::map<std::vector<unsigned int>, unsigned int> m_Framebuffers;
+    Report m_Report;
+    Report m_PrintedReport;
+    long long m_Frame = 0;
+    bool m_Compiled = false;
+
+    // reference counting from the outputs back: a pass survives if something it writes is read
+    void cull() {
+        for (PassNode& p : m_Passes) {
+            p.refCount = (int) p.writes.size();
+            p.culled = false;
+        }
+        std::vector<Resource> unused;
+        for (size_t i = 0; i < m_Resources.size(); i++) {
+            ResourceNode& r = m_Resources[i];
+            r.refCount = (int) r.readers.size() + (r.output ? 1 : 0);
+            if (r.refCount == 0) {
+                unused.push_back((Resource) i);
+            }
+        }
+        while (!unused.empty()) {
+            Resource r = unused.back();
+            unused.pop_back();
+            for (Pass p : m_Resources[r].producers) {
+                PassNode& pass = m_Passes[p];
+                if (pass.culled || --pass.refCount > 0) {
+                    continue;
+                }
+                pass.culled = true;
+                for (Resource in : pass.reads) {
+                    if (--m_Resources[in].refCount == 0) {
+                        unused.push_back(in);
+                    }
+                }
+            }
+        }
+    }
+
+    // topological order over producer -> reader edges, ties broken by declaration order
+    void order() {
+        std::vector<int> incoming(m_Passes.size(), 0);
+        for (size_t p = 0; p < m_Passes.size(); p++) {
+            if (m_Passes[p].culled) {
+                continue;
+            }
+            for (Resource r : m_Passes[p].reads) {
+                for (Pass producer : m_Resources[r].producers) {
+                    if (producer != (Pass) p && !m_Passes[producer].culled) {
+                        incoming[p]++;
+                    }
+                }
+            }
+        }
+        std::vector<bool> done(m_Passes.size(), false);
+        for (;;) {
+            Pass next = -1;
+            for (size_t p = 0; p < m_Passes.size(); p++) {
+                if (!m_Passes[p].culled && !done[p] && incoming[p] == 0) {
+                    next = (Pass) p;
+                    break;
+                }
+            }
+            if (next < 0) {
+                break;
+            }
+            done[next] = true;
+            m_Order.push_back(next);
+            for (Resource r : m_Passes[next].writes) {
+                for (Pass reader : m_Resources[r].readers) {
+                    if (reader != next) {
+                        incoming[reader]--;
+                    }
+                }
+            }
+        }
+        for (size_t p = 0; p < m_Passes.size(); p++) {
+            ASSERT(m_Passes[p].culled || done[p], "RenderGraph has a cycle");
+        }
+    }
+
+    void assignPhysical() {
+        m_Report = Report();
+        m_Report.passes = (int) m_Passes.size();
+        for (const PassNode& p : m_Passes) {
+            m_Report.culledPasses += p.culled ? 1 : 0;
+        }
+
+        // lifetimes on the pass timeline
+        for (int i = 0; i < (int) m_Order.size(); i++) {
+            const PassNode& pass = m_Passes[m_Order[i]];
+            for (Resource r : pass.writes) {
+                touch(m_Resources[r], i);
+            }
+            for (Resource r : pass.reads) {
+                touch(m_Resources[r], i);
+            }
+        }
+        for (Physical& p : m_Pool) {
+            p.busyUntil = -1;
+        }
+
+        std::vector<size_t> usedThisFrame;
+        for (int i = 0; i < (int) m_Order.size(); i++) {
+            size_t live = 0;
+            for (ResourceNode& r : m_Resources) {
+                if (r.imported || r.first < 0) {
+                    continue;
+                }
+                if (r.first == i) {
+                    bool read = std::any_of(r.readers.begin(), r.readers.end(), [this](Pass p) { return !m_Passes[p].culled; });
+                    r.dropped = !read && !r.output && !r.desc.isDepth();
+                    if (!r.dropped) {
+                        size_t p = acquire(r.desc, r.first, r.last);
+                        r.texture = m_Pool[p].texture;
+                        if (std::find(usedThisFrame.begin(), usedThisFrame.end(), p) == usedThisFrame.end()) {
+                            usedThisFrame.push_back(p);
+                        }
+                        m_Report.transientTextures++;
+                        m_Report.transientBytes += r.desc.bytes();
+                    }
+                }
+                if (!r.dropped && r.first <= i && i <= r.last) {
+                    live += r.desc.bytes();
+                }
+            }
+            m_Report.peakLiveBytes = std::max(m_Report.peakLiveBytes, live);
+        }
+        for (size_t p : usedThisFrame) {
+            m_Report.physicalTextures++;
+            m_Report.physicalBytes += m_Pool[p].desc.bytes();
+        }
+    }
+
+    static void touch(ResourceNode& r, int position) {
+        r.first = r.first < 0 ? position : std::min(r.first, position);
+        r.last = std::max(r.last, position);
+    }
+
+    // a pooled texture with the same description that is free at this point of the frame,
+    // or a new one. Storage is shared only between identical descriptions since GL has no
+    // way to alias one allocation under different formats.
+    size_t acquire(const TextureDesc& desc, int first, int last) {
+        for (size_t i = 0; i < m_Pool.size(); i++) {
+            Physical& p = m_Pool[i];
+            if (p.desc == desc && p.busyUntil < first) {
+                p.busyUntil = last;
+                p.lastFrame = m_Frame;
+                return i;
+            }
+        }
+        Physical p;
+        p.desc = desc;
+        p.busyUntil = last;
+        p.lastFrame = m_Frame;
+        glGenTextures(1, &p.texture);
+        glBindTexture(GL_TEXTURE_2D, p.texture);
+        glTexImage2D(GL_TEXTURE_2D, 0, desc.internalFormat, desc.width, desc.height, 0, desc.format, desc.type, NULL);
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, desc.filter);
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, desc.filter);
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
+        glBindTexture(GL_TEXTURE_2D, 0);
+        m_Pool.push_back(p);
+        return m_Pool.size() - 1;
+    }
+
+    void bindTargets(const PassNode& pass) {
+        std::vector<unsigned int> key;
+        std::vector<GLenum> drawBuffers;
+        unsigned int depth = 0;
+        int width = 0, height = 0;
+        bool backbuffer = false;
+        for (Resource r : pass.writes) {
+            const ResourceNode& res = m_Resources[r];
+            if (width == 0) {
+                width = res.desc.width;
+                height = res.desc.height;
+            }
+            if (res.backbuffer) {
+                backbuffer = true;
+            } else if (res.desc.isDepth()) {
+                depth = res.texture;
+            } else {
+                drawBuffers.push_back(res.dropped ? GL_NONE : GL_COLOR_ATTACHMENT0 + (GLenum) key.size());
+                key.push_back(res.dropped ? 0 : res.texture);
+            }
+        }
+        if (backbuffer) {
+            glBindFramebuffer(GL_FRAMEBUFFER, 0);
+            glViewport(0, 0, width, height);
+            return;
+        }
+        key.push_back(depth);
+        auto found = m_Framebuffers.find(key);
+        if (found == m_Framebuffers.end()) {
+            unsigned int fbo;
+            glGenFramebuffers(1, &fbo);
+            glBindFramebuffer(GL_FRAMEBUFFER, fbo);
+            for (size_t i = 0; i + 1 < key.size(); i++) {
+                if (key[i] != 0) {
+                    glFramebufferTexture2D(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0 + (GLenum) i, GL_TEXTURE_2D, key[i], 0);
+                }
+            }
+            if (depth) {
+                glFramebufferTexture2D(GL_FRAMEBUFFER, GL_DEPTH_STENCIL_ATTACHMENT, GL_TEXTURE_2D, depth, 0);
+            }
+            glDrawBuffers((GLsizei) drawBuffers.size(), drawBuffers.data());
+            if (glCheckFramebufferStatus(GL_FRAMEBUFFER) != GL_FRAMEBUFFER_COMPLETE)
+                std::cout << "Framebuffer not complete! (" << pass.name << ")" << std::endl;
+            found = m_Framebuffers.insert(std::make_pair(key, fbo)).first;
+        } else {
+            glBindFramebuffer(GL_FRAMEBUFFER, found->second);
+        }
+        glViewport(0, 0, width, height);
+    }
+
+    // pooled textures not used for a few frames (old window size, bloom switched off...) go away
+    void collectGarbage() {
+        const long long keepFrames = 3;
+        m_Report.pooledBytes = 0;
+        for (size_t i = 0; i < m_Pool.size();) {
+            if (m_Frame - m_Pool[i].lastFrame > keepFrames) {
+                unsigned int texture = m_Pool[i].texture;
+                for (auto it = m_Framebuffers.begin(); it != m_Framebuffers.end();) {
+                    if (std::find(it->first.begin(), it->first.end(), texture) != it->first.end()) {
+                        glDeleteFramebuffers(1, &it->second);
+                        it = m_Framebuffers.erase(it);
+                    } else {
+                        ++it;
+                    }
+                }
+                glDeleteTextures(1, &texture);
+                m_Pool.erase(m_Pool.begin() + i);
+            } else {
+                m_Report.pooledBytes += m_Pool[i].desc.bytes();
+                i++;
+            }
+        }
+    }
+};
+
+}
+
+#endif //PROJECT_BASE_RENDERGRAPH_H
@@ -0,0 +1,173 @@
+//
+// Render targets that follow the window size and a GPU-time driven resolution scale.
+//
+
+#ifndef PROJECT_BASE_RENDERTARGETS_H
+#define PROJECT_BASE_RENDERTARGETS_H
+
+#include <glad/glad.h>
+#include <algorithm>
+#include <cmath>
+#include <rg/RenderGraph.h>
+
+namespace rg {
+
+// Sizes and descriptions of the frame's render targets. The textures themselves are
+// transient render graph resources allocated at the full framebuffer size; the scene
+// is drawn into the bottom-left internalWidth x internalHeight sub-rectangle, so changing
+// the resolution scale never touches GPU memory, only a window resize does.
+class RenderTargets {
+public:
+    int displayWidth = 0;
+    int displayHeight = 0;
+    int internalWidth = 0;
+    int internalHeight = 0;
+    float scale = 1.0f;
+
+    void resize(int width, int height) {
+        if (width <= 0 || height <= 0) {
+            // minimized, keep whatever we had
+            return;
+        }
+        displayWidth = width;
+        displayHeight = height;
+        setScale(scale);
+    }
+
+    void setScale(float s) {
+        scale = s;
+        internalWidth = std::max(1, (int) std::lround(displayWidth * scale));
+        internalHeight = std::max(1, (int) std::lround(displayHeight * scale));
+    }
+
+    // fraction of the targets covered by the scene, passed to shaders sampling them
+    float uvScaleX() const { return displayWidth ? (float) internalWidth / displayWidth : 1.0f; }
+    float uvScaleY() const { return displayHeight ? (float) internalHeight / displayHeight : 1.0f; }
+
+    TextureDesc hdr() const { return TextureDesc(displayWidth, displayHeight, GL_RGBA16F, GL_RGBA, GL_FLOAT); }
+    TextureDesc depth() const {
+        return TextureDesc(displayWidth, displayHeight, GL_DEPTH24_STENCIL8, GL_DEPTH_STENCIL, GL_UNSIGNED_INT_24_8, GL_NEAREST);
+    }
+    TextureDesc ldr() const { return TextureDesc(displayWidth, displayHeight, GL_RGBA8, GL_RGBA, GL_UNSIGNED_BYTE, GL_NEAREST); }
+};
+
+// GL queries kept in a small ring so reading a result never waits on the GPU.
+// The newest available result is usually QueryCount - 1 frames old.
+class GpuQueryRing {
+public:
+    static const int QueryCount = 4;
+
+    explicit GpuQueryRing(GLenum target) : m_Target(target) {}
+
+    void init() {
+        glGenQueries(QueryCount, m_Queries);
+    }
+
+    void begin() {
+        if (m_Pending[m_Current]) {
+            // ring is full, the GPU is more than QueryCount frames behind; skip this frame
+            m_Skipped = true;
+            return;
+        }
+        m_Skipped = false;
+        glBeginQuery(m_Target, m_Queries[m_Current]);
+    }
+
+    void end() {
+        if (m_Skipped) {
+            return;
+        }
+        glEndQuery(m_Target);
+        m_Pending[m_Current] = true;
+        m_Current = (m_Current + 1) % QueryCount;
+    }
+
+    // collects every finished query, returns true if there was at least one
+    bool poll(GLuint64& result) {
+        bool got = false;
+        for (int n = 0; n < QueryCount; n++) {
+            int i = (m_Current + n) % QueryCount;
+            if (!m_Pending[i]) {
+                continue;
+            }
+            GLint available = 0;
+            glGetQueryObjectiv(m_Queries[i], GL_QUERY_RESULT_AVAILABLE, &available);
+            if (!available) {
+                break;
+            }
+            glGetQueryObjectui64v(m_Queries[i], GL_QUERY_RESULT, &result);
+            m_Pending[i] = false;
+            got = true;
+        }
+        return got;
+    }
+
+    void release() {
+        glDeleteQueries(QueryCount, m_Queries);
+    }
+
+private:
+    GLenum m_Target;
+    unsigned int m_Queries[QueryCount] = {};
+    bool m_Pending[QueryCount] = {};
+    int m_Current = 0;
+    bool m_Skipped = false;
+};
+
+class GpuTimer : public GpuQueryRing {
+public:
+    GpuTimer() : GpuQueryRing(GL_TIME_ELAPSED) {}
+
+    bool poll(float& milliseconds) {
+        GLuint64 ns = 0;
+        if (!GpuQueryRing::poll(ns)) {
+            return false;
+        }
+        milliseconds = ns / 1.0e6f;
+        return true;
+    }
+};
+
+// Fragments that passed the depth test between begin() and end(). Around the opaque
+// lighting draws that is the number of times the lighting shader ran, divided by the
+// pixel count it gives the overdraw factor.
+class SampleCounter : public GpuQueryRing {
+public:
+    SampleCounter() : GpuQueryRing(GL_SAMPLES_PASSED) {}
+};
+
+// Picks the resolution scale so that GPU frame time stays under the budget.
+// Pixel cost is roughly proportional to area, so the correction is sqrt(budget / time).
+// The result is quantized and only changed outside a dead band, otherwise it would
+// hunt between neighbouring sizes every frame.
+class DynamicResolution {
+public:
+    bool enabled = true;
+    float targetMs = 1000.0f / 60.0f * 0.9f; // leave some room for the CPU side and swap
+    float minScale = 0.5f;
+    float maxScale = 1.0f;
+    float step = 0.05f;
+    float smoothedMs = 0.0f;
+
+    float update(float gpuMs, float currentScale) {
+        smoothedMs = smoothedMs == 0.0f ? gpuMs : smoothedMs * 0.8f + gpuMs * 0.2f;
+        if (!enabled) {
+            return currentScale;
+        }
+        float ratio = targetMs / std::max(smoothedMs, 0.01f);
+        if (ratio > 0.9f && ratio < 1.15f) {
+            return currentScale;
+        }
+        float wanted = currentScale * std::sqrt(ratio);
+        // grow slowly, shrink fast - a dropped frame is worse than a slightly soft one
+        if (wanted > currentScale) {
+            wanted = std::min(wanted, currentScale + step);
+        }
+        wanted = std::round(wanted / step) * step;
+        return std::min(maxScale, std::max(minScale, wanted));
+    }
+};
+
+}
+
+#endif //PROJECT_BASE_RENDERTARGETS_H
@@ -0,0 +1,190 @@
+//
+// Submits many programs at once and checks on them later, so the driver compiles while we load assets.
+//
+
+#ifndef PROJECT_BASE_SHADERBUILDQUEUE_H
+#define PROJECT_BASE_SHADERBUILDQUEUE_H
+
+#include <glad/glad.h>
+#include <GLFW/glfw3.h>
+#include <algorithm>
+#include <functional>
+#include <iostream>
+#include <string>
+#include <vector>
+#include <common.h>
+#include <learnopengl/shader.h>
+#include <rg/GLExtensions.h>
+#include <rg/ShaderSources.h>
+
+namespace rg {
+
+// The program IDs handed out by submit are valid right away; a compile or link status query is
+// what forces the driver to finish, so those are postponed. With KHR/ARB_parallel_shader_compile
+// poll() asks GL_COMPLETION_STATUS_KHR and finishes whatever is done without ever blocking.
+// Without it the driver may still compile on its own threads (most do, lazily), and finish()
+// is called right before the first frame so that work can overlap with asset loading.
+// Using a program before it was finished is correct but waits for its link, so setup that
+// needs one (sampler units) belongs in onReady.
+class ShaderBuildQueue {
+public:
+    void init() {
+        m_Start = glfwGetTime();
+        GLExtensions& ext = glExtensions();
+        if (ext.parallelShaderCompile) {
+            // let the driver pick the number of threads
+            ext.MaxShaderCompilerThreads(0xFFFFFFFF);
+        }
+    }
+
+    // onReady runs once the program is known to have linked, e.g. to set sampler units,
+    // onFailed if it didn't (the log has been printed by then)
+    Shader submit(const std::string& name, const std::string& vertexCode, const std::string& fragmentCode,
+                  std::function<void(Shader&)> onReady = nullptr, std::function<void(Shader&)> onFailed = nullptr) {
+        const double begin = glfwGetTime();
+        Entry entry;
+        entry.name = name;
+        entry.pending = entry.shader.startBuild(vertexCode.c_str(), fragmentCode.c_str(), nullptr);
+        entry.onReady = onReady;
+        entry.onFailed = onFailed;
+        entry.submitted = begin - m_Start;
+        m_SubmitSeconds += glfwGetTime() - begin;
+        m_Submitted++;
+        m_Cached += entry.pending.cached ? 1 : 0;
+        m_Pending.push_back(entry);
+        return entry.shader;
+    }
+
+    Shader submitFiles(const std::string& vertexPath, const std::string& fragmentPath,
+                       std::function<void(Shader&)> onReady = nullptr) {
+        return submit(vertexPath + " + " + fragmentPath, shaderSources().read(vertexPath), shaderSources().read(fragmentPath), onReady);
+    }
+
+    // finishes every build the driver reports as complete, never blocks
+    void poll() {
+        if (!glExtensions().parallelShaderCompile) {
+            return;
+        }
+        for (size_t i = 0; i < m_Pending.size();) {
+            GLint done = GL_TRUE;
+            if (!m_Pending[i].pending.cached) {
+                glGetProgramiv(m_Pending[i].shader.ID, GL_COMPLETION_STATUS_KHR, &done);
+            }
+            if (done) {
+                complete(m_Pending[i]);
+                m_Pending.erase(m_Pending.begin() + i);
+            } else {
+                m_StillRunning++;
+                i++;
+            }
+        }
+    }
+
+    // Without the extension there is no asking whether a build is done. This finishes what was
+    // submitted at least seconds ago and leaves the rest pending. Drivers that compile on their
+    // own threads are done with it by then, the others block no longer than finish() would.
+    void finishOlderThan(double seconds) {
+        const double now = glfwGetTime() - m_Start;
+        const double begin = glfwGetTime();
+        for (size_t i = 0; i < m_Pending.size();) {
+            if (now - m_Pending[i].submitted >= seconds) {
+                complete(m_Pending[i]);
+                m_Pending.erase(m_Pending.begin() + i);
+            } else {
+                i++;
+            }
+        }
+        m_BlockedSeconds += glfwGetTime() - begin;
+    }
+
+    // finishes everything that is left, waiting on the driver where it has to
+    void finish() {
+        poll();
+        const double begin = glfwGetTime();
+        for (Entry& entry : m_Pending) {
+            complete(entry);
+        }
+        m_Pending.clear();
+        m_BlockedSeconds += glfwGetTime() - begin;
+    }
+
+    bool idle() const { return m_Pending.empty(); }
+
+    // named point on the startup timeline for the report, e.g. "models loaded"
+    void mark(const std::string& what) {
+        m_Marks.push_back(std::make_pair(what, glfwGetTime() - m_Start));
+    }
+
+    void report() const {
+        const char* parallel = glExtensions().parallelShaderCompile;
+        std::cout << "[Shaders] " << m_Submitted << " programs (" << m_Cached << " from binary cache), "
+                  << (parallel ? std::string(parallel) + "_parallel_shader_compile" : std::string("no parallel compile extension"))
+                  << "\n  " << ms(m_SubmitSeconds) << " ms in submit, " << ms(m_BlockedSeconds)
+                  << " ms blocked finishing builds, last one ready at " << ms(m_LastReady) << " ms";
+        for (const auto& mark : m_Marks) {
+            std::cout << "\n  " << mark.first << " at " << ms(mark.second) << " ms";
+        }
+        // Only a completion status query can tell that the driver was still compiling while we did
+        // something else. Without one, a driver that compiles inside glLinkProgram shows up as
+        // submit time, one that defers to the first status query as blocked time.
+        if (!parallel) {
+            std::cout << "\n  background compilation not observable without the extension" << std::endl;
+        } else if (m_StillRunning > 0) {
+            std::cout << "\n  builds reported still running " << m_StillRunning << " times, the driver compiled in the background" << std::endl;
+        } else {
+            std::cout << "\n  no build was ever reported still running, nothing shows the driver compiled in the background" << std::endl;
+        }
+        for (const Result& result : m_Results) {
+            std::cout << "  " << (result.ok ? "" : "FAILED ") << result.name << ": ready after "
+                      << ms(result.ready - result.submitted) << " ms" << (result.cached ? " (cached)" : "") << std::endl;
+        }
+    }
+
+private:
+    struct Entry {
+        std::string name;
+        Shader shader;
+        Shader::PendingBuild pending;
+        std::function<void(Shader&)> onReady;
+        std::function<void(Shader&)> onFailed;
+        double submitted = 0.0;
+    };
+
+    struct Result {
+        std::string name;
+        double submitted;
+        double ready;
+        bool cached;
+        bool ok;
+    };
+
+    double m_Start = 0.0;
+    double m_SubmitSeconds = 0.0;
+    double m_BlockedSeconds = 0.0;
+    double m_LastReady = 0.0;
+    int m_Submitted = 0;
+    int m_Cached = 0;
+    int m_StillRunning = 0;   // completion status queries that answered GL_FALSE
+    std::vector<Entry> m_Pending;
+    std::vector<Result> m_Results;
+    std::vector<std::pair<std::string, double>> m_Marks;
+
+    static int ms(double seconds) { return (int) (seconds * 1000.0 + 0.5); }
+
+    void complete(Entry& entry) {
+        const bool ok = entry.shader.finishBuild(entry.pending);
+        if (ok && entry.onReady) {
+            entry.shader.use();
+            entry.onReady(entry.shader);
+        } else if (!ok && entry.onFailed) {
+            entry.onFailed(entry.shader);
+        }
+        const double ready = glfwGetTime() - m_Start;
+        m_LastReady = std::max(m_LastReady, ready);
+        m_Results.push_back({ entry.name, entry.submitted, ready, entry.pending.cached, ok });
+    }
+};
+
+}
+
+#endif //PROJECT_BASE_SHADERBUILDQUEUE_H
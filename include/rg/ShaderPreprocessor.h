@@ -0,0 +1,198 @@
+//
+// GLSL #include handling and compile-time permutations of a shader.
+//
+
+#ifndef PROJECT_BASE_SHADERPREPROCESSOR_H
+#define PROJECT_BASE_SHADERPREPROCESSOR_H
+
+#include <glad/glad.h>
+#include <algorithm>
+#include <functional>
+#include <iostream>
+#include <map>
+#include <sstream>
+#include <string>
+#include <vector>
+#include <common.h>
+#include <learnopengl/shader.h>
+#include <rg/ShaderBuildQueue.h>
+#include <rg/ShaderSources.h>
+
+namespace rg {
+
+// Feature bits of a permutation key, every set bit becomes a #define right after #version.
+// Branches on them are resolved by the GLSL compiler instead of per fragment.
+const unsigned int FeatureMoonlight = 1u << 0;
+const unsigned int FeatureNormalMap = 1u << 1;
+const unsigned int FeatureInstanced = 1u << 2;
+const unsigned int FeatureSkinned = 1u << 3;   // reserved, nothing in the scene is skinned yet
+const unsigned int FeatureCompactInstance = 1u << 4;   // with FeatureInstanced: rg::CompactInstance instead of a mat4
+
+inline std::string shaderFeatureDefines(unsigned int features) {
+    static const char* names[] = { "MOONLIGHT", "NORMAL_MAP", "INSTANCED", "SKINNED", "COMPACT_INSTANCE" };
+    std::string defines;
+    for (unsigned int i = 0; i < sizeof(names) / sizeof(names[0]); i++) {
+        if (features & (1u << i)) {
+            defines += std::string("#define ") + names[i] + "\n";
+        }
+    }
+    return defines;
+}
+
+struct PreprocessedShader {
+    std::string source;
+    // every file that went into the source, index = GLSL source string number in #line
+    std::vector<std::string> files;
+};
+
+// #include "path" is resolved relative to the including file and pasted in place, each file
+// at most once per shader. #line directives keep compiler messages pointing at the right
+// file and line: "0(12)" is line 12 of files[0].
+class ShaderPreprocessor {
+public:
+    static PreprocessedShader process(const std::string& path, unsigned int features) {
+        PreprocessedShader result;
+        std::ostringstream out;
+        expand(path, features, result.files, out);
+        result.source = out.str();
+        return result;
+    }
+
+private:
+    static void expand(const std::string& path, unsigned int features, std::vector<std::string>& files, std::ostringstream& out) {
+        const int fileIndex = (int) files.size();
+        files.push_back(path);
+        std::string source = shaderSources().read(path);
+        if (source.empty()) {
+            std::cout << "ERROR::SHADER::FILE_NOT_SUCCESFULLY_READ " << path << std::endl;
+        }
+        const std::string directory = path.substr(0, path.find_last_of('/') + 1);
+
+        std::istringstream in(source);
+        std::string line;
+        int lineNumber = 0;
+        while (std::getline(in, line)) {
+            lineNumber++;
+            const size_t start = line.find_first_not_of(" \t");
+            if (start != std::string::npos && line.compare(start, 8, "#version") == 0) {
+                out << line << '\n' << shaderFeatureDefines(features) << "#line " << lineNumber + 1 << ' ' << fileIndex << '\n';
+                continue;
+            }
+            if (start == std::string::npos || line.compare(start, 8, "#include") != 0) {
+                out << line << '\n';
+                continue;
+            }
+            const size_t open = line.find('"', start);
+            const size_t close = open == std::string::npos ? open : line.find('"', open + 1);
+            if (close == std::string::npos) {
+                std::cout << "ERROR::SHADER::BAD_INCLUDE " << path << ":" << lineNumber << std::endl;
+                out << '\n';
+                continue;
+            }
+            const std::string included = directory + line.substr(open + 1, close - open - 1);
+            if (std::find(files.begin(), files.end(), included) == files.end()) {
+                out << "#line 1 " << files.size() << '\n';
+                expand(included, 0, files, out);
+            }
+            out << "#line " << lineNumber + 1 << ' ' << fileIndex << '\n';
+        }
+    }
+};
+
+// Specialized programs of one vertex/fragment pair, compiled on first use of a permutation
+// key and cached. setup runs once on every new program (while it is in use) for state that
+// never changes, like sampler units.
+class ShaderPermutations {
+public:
+    ShaderPermutations(const std::string& vertexPath, const std::string& fragmentPath,
+                       std::function<void(Shader&)> setup = nullptr)
+        : m_VertexPath(vertexPath), m_FragmentPath(fragmentPath), m_Setup(setup) {}
+
+    Shader& get(unsigned int features) {
+        auto found = m_Programs.find(features);
+        if (found != m_Programs.end()) {
+            return found->second;
+        }
+        PreprocessedShader vertex, fragment;
+        preprocess(features, vertex, fragment);
+        Shader shader = Shader::fromSource(vertex.source, fragment.source);
+
+        GLint linked = 0;
+        glGetProgramiv(shader.ID, GL_LINK_STATUS, &linked);
+        if (!linked) {
+            std::cout << "ERROR::SHADER::PERMUTATION " << name(features) << "\n  vertex sources:";
+            for (size_t i = 0; i < vertex.files.size(); i++) {
+                std::cout << " " << i << "=" << vertex.files[i];
+            }
+            std::cout << "\n  fragment sources:";
+            for (size_t i = 0; i < fragment.files.size(); i++) {
+                std::cout << " " << i << "=" << fragment.files[i];
+            }
+            std::cout << std::endl;
+        }
+        if (m_Setup) {
+            shader.use();
+            m_Setup(shader);
+        }
+        return m_Programs.insert(std::make_pair(features, shader)).first->second;
+    }
+
+    // builds a key through the queue ahead of its first get(), which then never compiles
+    void prewarm(ShaderBuildQueue& queue, unsigned int features) {
+        if (m_Programs.count(features)) {
+            return;
+        }
+        PreprocessedShader vertex, fragment;
+        preprocess(features, vertex, fragment);
+        m_Programs.insert(std::make_pair(features, queue.submit(name(features), vertex.source, fragment.source, m_Setup)));
+    }
+
+    // fresh sources of an existing key, for rebuilding it after a file changed
+    void sources(unsigned int features, std::string& vertexCode, std::string& fragmentCode) {
+        PreprocessedShader vertex, fragment;
+        preprocess(features, vertex, fragment);
+        vertexCode = vertex.source;
+        fragmentCode = fragment.source;
+    }
+
+    // every program built so far with the files it was preprocessed from
+    void forEach(const std::function<void(unsigned int, Shader&, const std::vector<std::string>&)>& visit) {
+        for (auto& program : m_Programs) {
+            visit(program.first, program.second, m_Dependencies[program.first]);
+        }
+    }
+
+    std::string name(unsigned int features) const {
+        std::ostringstream out;
+        out << m_VertexPath << " + " << m_FragmentPath << " [0x" << std::hex << features << "]";
+        return out.str();
+    }
+
+    size_t size() const { return m_Programs.size(); }
+
+    void release() {
+        for (auto& program : m_Programs) {
+            glDeleteProgram(program.second.ID);
+        }
+        m_Programs.clear();
+    }
+
+private:
+    std::string m_VertexPath;
+    std::string m_FragmentPath;
+    std::function<void(Shader&)> m_Setup;
+    std::map<unsigned int, Shader> m_Programs;
+    std::map<unsigned int, std::vector<std::string>> m_Dependencies;
+
+    void preprocess(unsigned int features, PreprocessedShader& vertex, PreprocessedShader& fragment) {
+        vertex = ShaderPreprocessor::process(m_VertexPath, features);
+        fragment = ShaderPreprocessor::process(m_FragmentPath, features);
+        std::vector<std::string>& files = m_Dependencies[features];
+        files = vertex.files;
+        files.insert(files.end(), fragment.files.begin(), fragment.files.end());
+    }
+};
+
+}
+
+#endif //PROJECT_BASE_SHADERPREPROCESSOR_H
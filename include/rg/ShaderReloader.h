@@ -0,0 +1,342 @@
+//
+// Rebuilds programs in the background when their source files change and swaps them in once they link.
+//
+
+#ifndef PROJECT_BASE_SHADERRELOADER_H
+#define PROJECT_BASE_SHADERRELOADER_H
+
+#include <glad/glad.h>
+#include <GLFW/glfw3.h>
+#include <algorithm>
+#include <condition_variable>
+#include <deque>
+#include <functional>
+#include <iostream>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+#include <common.h>
+#include <learnopengl/shader.h>
+#include <rg/GLExtensions.h>
+#include <rg/ShaderBuildQueue.h>
+#include <rg/ShaderPreprocessor.h>
+#include <rg/ShaderSources.h>
+#ifdef __linux__
+#include <sys/inotify.h>
+#include <unistd.h>
+#endif
+
+namespace rg {
+
+// inotify on the shader directories, polled once per frame without blocking. A changed file
+// rebuilds every program that was made from it:
+//  - with KHR/ARB_parallel_shader_compile through a ShaderBuildQueue, polled every frame,
+//  - otherwise on a worker thread with its own hidden context sharing objects with ours,
+//  - without a shared context through the queue as well, finished settleSeconds later so the
+//    frame that submits never waits for the compile.
+// The program in use is only replaced once the new one has linked, its uniforms are copied
+// over so one-time setup (sampler units) survives. A broken edit keeps the old program.
+// Outside Linux the reloader does nothing.
+class ShaderReloader {
+public:
+    bool enabled = true;
+    double settleSeconds = 0.25;   // queued builds without the extension, see ShaderBuildQueue::finishOlderThan
+
+    // directories are shader source names (see rg::ShaderSources), watched under its override directory
+    void init(GLFWwindow* window, const std::vector<std::string>& directories) {
+#ifdef __linux__
+        const std::string& root = shaderSources().overrideDirectory();
+        if (root.empty() && ShaderSources::embeddedCount() > 0) {
+            std::cout << "[ShaderReload] shaders are embedded and there is no override directory, hot reload off" << std::endl;
+            return;
+        }
+        m_Inotify = inotify_init1(IN_NONBLOCK | IN_CLOEXEC);
+        if (m_Inotify < 0) {
+            std::cout << "[ShaderReload] inotify unavailable, hot reload off" << std::endl;
+            return;
+        }
+        for (const std::string& directory : directories) {
+            // editors often save by writing a temporary file and renaming it over the original
+            const std::string watched = root.empty() ? directory : root + "/" + directory;
+            int wd = inotify_add_watch(m_Inotify, watched.c_str(), IN_CLOSE_WRITE | IN_MOVED_TO);
+            if (wd >= 0) {
+                m_Watches.push_back(std::make_pair(wd, directory));
+            }
+        }
+        if (glExtensions().parallelShaderCompile) {
+            return;
+        }
+        // the hidden window only exists for its context, created with the same hints as the main one
+        glfwWindowHint(GLFW_VISIBLE, GLFW_FALSE);
+        m_WorkerContext = glfwCreateWindow(1, 1, "shader reload", NULL, window);
+        glfwWindowHint(GLFW_VISIBLE, GLFW_TRUE);
+        if (m_WorkerContext) {
+            m_Worker = std::thread(&ShaderReloader::workerLoop, this);
+        } else {
+            std::cout << "[ShaderReload] no shared context, changed shaders will build on the render thread" << std::endl;
+        }
+#endif
+    }
+
+    // plain vertex + fragment pair, shader is swapped in place
+    void watchFiles(Shader& shader, const std::string& vertexPath, const std::string& fragmentPath) {
+        m_Files.push_back({ &shader, vertexPath, fragmentPath });
+    }
+
+    void watchPermutations(ShaderPermutations& permutations) {
+        m_Permutations.push_back(&permutations);
+    }
+
+    // call once per frame on the thread that owns the GL context
+    void poll() {
+#ifdef __linux__
+        if (m_Inotify < 0) {
+            return;
+        }
+        std::vector<std::string> changed = readEvents();
+        if (enabled && !changed.empty()) {
+            schedule(changed);
+        }
+        m_Queue.poll();
+        if (!glExtensions().parallelShaderCompile) {
+            m_Queue.finishOlderThan(settleSeconds);
+        }
+        std::vector<Job> done;
+        {
+            std::lock_guard<std::mutex> lock(m_Mutex);
+            done.swap(m_Done);
+        }
+        for (Job& job : done) {
+            finish(job);
+        }
+#endif
+    }
+
+    // programs swapped in so far; a swapped out ID is deleted and may be handed out again,
+    // so anything cached per program ID is stale once this changes
+    int swaps() const { return m_Swaps; }
+
+    // stops the worker and waits for it, nothing is swapped after this
+    void release() {
+#ifdef __linux__
+        if (m_Worker.joinable()) {
+            {
+                std::lock_guard<std::mutex> lock(m_Mutex);
+                m_Stop = true;
+            }
+            m_Wake.notify_one();
+            m_Worker.join();
+        }
+        for (Job& job : m_Done) {
+            glDeleteProgram(job.program);
+        }
+        m_Done.clear();
+        if (m_WorkerContext) {
+            glfwDestroyWindow(m_WorkerContext);
+            m_WorkerContext = nullptr;
+        }
+        if (m_Inotify >= 0) {
+            close(m_Inotify);
+            m_Inotify = -1;
+        }
+#endif
+    }
+
+private:
+    struct WatchedFiles {
+        Shader* shader;
+        std::string vertexPath;
+        std::string fragmentPath;
+    };
+
+    struct Job {
+        Shader* target = nullptr;
+        std::string name;
+        std::string vertexCode;
+        std::string fragmentCode;
+        unsigned int program = 0;
+        bool ok = false;
+        double submitted = 0.0;
+    };
+
+    std::vector<WatchedFiles> m_Files;
+    std::vector<ShaderPermutations*> m_Permutations;
+    std::vector<std::pair<int, std::string>> m_Watches;
+    int m_Inotify = -1;
+    ShaderBuildQueue m_Queue;
+
+    GLFWwindow* m_WorkerContext = nullptr;
+    std::thread m_Worker;
+    std::mutex m_Mutex;
+    std::condition_variable m_Wake;
+    std::deque<Job> m_Jobs;
+    std::vector<Job> m_Done;
+    bool m_Stop = false;
+    int m_Swaps = 0;
+
+#ifdef __linux__
+    std::vector<std::string> readEvents() {
+        std::vector<std::string> changed;
+        alignas(inotify_event) char buffer[4096];
+        for (;;) {
+            ssize_t length = read(m_Inotify, buffer, sizeof(buffer));
+            if (length <= 0) {
+                break;
+            }
+            for (char* p = buffer; p < buffer + length;) {
+                inotify_event* event = (inotify_event*) p;
+                p += sizeof(inotify_event) + event->len;
+                if (event->len == 0) {
+                    continue;
+                }
+                for (const auto& watch : m_Watches) {
+                    if (watch.first == event->wd) {
+                        std::string path = watch.second + "/" + event->name;
+                        if (std::find(changed.begin(), changed.end(), path) == changed.end()) {
+                            changed.push_back(path);
+                        }
+                    }
+                }
+            }
+        }
+        return changed;
+    }
+#endif
+
+    static bool dependsOn(const std::vector<std::string>& files, const std::vector<std::string>& changed) {
+        return std::any_of(files.begin(), files.end(), [&changed](const std::string& file) {
+            return std::find(changed.begin(), changed.end(), file) != changed.end();
+        });
+    }
+
+    void schedule(const std::vector<std::string>& changed) {
+        std::vector<Job> jobs;
+        for (WatchedFiles& files : m_Files) {
+            if (dependsOn({ files.vertexPath, files.fragmentPath }, changed)) {
+                Job job;
+                job.target = files.shader;
+                job.name = files.vertexPath + " + " + files.fragmentPath;
+                job.vertexCode = shaderSources().read(files.vertexPath);
+                job.fragmentCode = shaderSources().read(files.fragmentPath);
+                jobs.push_back(job);
+            }
+        }
+        for (ShaderPermutations* permutations : m_Permutations) {
+            permutations->forEach([&](unsigned int features, Shader& shader, const std::vector<std::string>& files) {
+                if (dependsOn(files, changed)) {
+                    Job job;
+                    job.target = &shader;
+                    job.name = permutations->name(features);
+                    permutations->sources(features, job.vertexCode, job.fragmentCode);
+                    jobs.push_back(job);
+                }
+            });
+        }
+        for (Job& job : jobs) {
+            job.submitted = glfwGetTime();
+            if (glExtensions().parallelShaderCompile || !m_Worker.joinable()) {
+                // job is copied into the callbacks, the queue outlives this call
+                m_Queue.submit(job.name, job.vertexCode, job.fragmentCode,
+                               [this, job](Shader& built) mutable { job.program = built.ID; job.ok = true; finish(job); },
+                               [this, job](Shader& built) mutable { job.program = built.ID; job.ok = false; finish(job); });
+            } else {
+                {
+                    std::lock_guard<std::mutex> lock(m_Mutex);
+                    m_Jobs.push_back(job);
+                }
+                m_Wake.notify_one();
+            }
+        }
+    }
+
+    // on the render thread: swap the new program in, or throw it away if it didn't link
+    void finish(Job& job) {
+        const int ms = (int) ((glfwGetTime() - job.submitted) * 1000.0 + 0.5);
+        if (!job.ok) {
+            glDeleteProgram(job.program);
+            std::cout << "[ShaderReload] " << job.name << " failed, keeping the old program" << std::endl;
+            return;
+        }
+        copyUniforms(job.target->ID, job.program);
+        glDeleteProgram(job.target->ID);
+        job.target->ID = job.program;
+        m_Swaps++;
+        std::cout << "[ShaderReload] " << job.name << " swapped in after " << ms << " ms" << std::endl;
+    }
+
+    void workerLoop() {
+        glfwMakeContextCurrent(m_WorkerContext);
+        for (;;) {
+            Job job;
+            {
+                std::unique_lock<std::mutex> lock(m_Mutex);
+                m_Wake.wait(lock, [this] { return m_Stop || !m_Jobs.empty(); });
+                if (m_Stop) {
+                    break;
+                }
+                job = m_Jobs.front();
+                m_Jobs.pop_front();
+            }
+            Shader built;
+            job.ok = built.finishBuild(built.startBuild(job.vertexCode.c_str(), job.fragmentCode.c_str(), nullptr));
+            job.program = built.ID;
+            // the program must be complete before the other context may use it
+            glFinish();
+            std::lock_guard<std::mutex> lock(m_Mutex);
+            m_Done.push_back(job);
+        }
+        glfwMakeContextCurrent(NULL);
+    }
+
+    // carries uniform values (mostly sampler units set once at startup) over to the new program
+    static void copyUniforms(unsigned int from, unsigned int to) {
+        GLint count = 0;
+        glGetProgramiv(from, GL_ACTIVE_UNIFORMS, &count);
+        GLint previous = 0;
+        glGetIntegerv(GL_CURRENT_PROGRAM, &previous);
+        glUseProgram(to);
+        for (GLint i = 0; i < count; i++) {
+            char name[256];
+            GLint size = 0;
+            GLenum type = 0;
+            glGetActiveUniform(from, (GLuint) i, sizeof(name), NULL, &size, &type, name);
+            std::string base(name);
+            if (base.size() > 3 && base.compare(base.size() - 3, 3, "[0]") == 0) {
+                base.resize(base.size() - 3);
+            }
+            for (GLint element = 0; element < size; element++) {
+                const std::string elementName = size > 1 ? base + "[" + std::to_string(element) + "]" : base;
+                GLint source = glGetUniformLocation(from, elementName.c_str());
+                GLint target = glGetUniformLocation(to, elementName.c_str());
+                if (source < 0 || target < 0) {
+                    continue;
+                }
+                GLfloat f[16];
+                GLint n[4];
+                switch (type) {
+                    case GL_FLOAT: glGetUniformfv(from, source, f); glUniform1fv(target, 1, f); break;
+                    case GL_FLOAT_VEC2: glGetUniformfv(from, source, f); glUniform2fv(target, 1, f); break;
+                    case GL_FLOAT_VEC3: glGetUniformfv(from, source, f); glUniform3fv(target, 1, f); break;
+                    case GL_FLOAT_VEC4: glGetUniformfv(from, source, f); glUniform4fv(target, 1, f); break;
+                    case GL_FLOAT_MAT3: glGetUniformfv(from, source, f); glUniformMatrix3fv(target, 1, GL_FALSE, f); break;
+                    case GL_FLOAT_MAT4: glGetUniformfv(from, source, f); glUniformMatrix4fv(target, 1, GL_FALSE, f); break;
+                    case GL_INT:
+                    case GL_BOOL:
+                    case GL_SAMPLER_2D:
+                    case GL_SAMPLER_CUBE:
+                        glGetUniformiv(from, source, n);
+                        glUniform1i(target, n[0]);
+                        break;
+                    case GL_INT_VEC2: glGetUniformiv(from, source, n); glUniform2iv(target, 1, n); break;
+                    default: break;
+                }
+            }
+        }
+        glUseProgram((GLuint) previous);
+    }
+};
+
+}
+
+#endif //PROJECT_BASE_SHADERRELOADER_H
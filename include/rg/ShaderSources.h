@@ -0,0 +1,86 @@
+//
+// Shader sources by name: compiled into the executable, or read from disk during development.
+//
+
+#ifndef PROJECT_BASE_SHADERSOURCES_H
+#define PROJECT_BASE_SHADERSOURCES_H
+
+#include <cstddef>
+#include <fstream>
+#include <sstream>
+#include <string>
+#include <common.h>
+
+namespace rg {
+
+struct EmbeddedFile {
+    const char* name;
+    const char* data;
+    size_t size;
+};
+
+}
+
+// generated from resources/shaders by cmake/EmbedShaders.cmake
+#ifdef RG_EMBEDDED_SHADERS
+#include <embedded_shaders.h>
+#endif
+
+namespace rg {
+
+// Names are the paths relative to the project root, e.g. "resources/shaders/hdrShader.vs".
+// Lookup order: the override directory if one is set and has the file, then the embedded
+// table, then the name as a path relative to the working directory (builds without the
+// embed step). Only the override and fallback touch the filesystem.
+class ShaderSources {
+public:
+    // usually the source tree, so edits (and rg::ShaderReloader) work on an embedded build
+    void setOverrideDirectory(const std::string& directory) { m_Override = directory; }
+    const std::string& overrideDirectory() const { return m_Override; }
+
+    std::string read(const std::string& name) const {
+        if (!m_Override.empty()) {
+            std::ifstream in(m_Override + "/" + name);
+            if (in) {
+                std::stringstream buffer;
+                buffer << in.rdbuf();
+                return buffer.str();
+            }
+        }
+        if (const EmbeddedFile* file = find(name)) {
+            return std::string(file->data, file->size);
+        }
+        return readFileContents(name);
+    }
+
+    static const EmbeddedFile* find(const std::string& name) {
+#ifdef RG_EMBEDDED_SHADERS
+        for (const EmbeddedFile& file : embeddedShaderFiles) {
+            if (name == file.name) {
+                return &file;
+            }
+        }
+#endif
+        return nullptr;
+    }
+
+    static size_t embeddedCount() {
+#ifdef RG_EMBEDDED_SHADERS
+        return sizeof(embeddedShaderFiles) / sizeof(embeddedShaderFiles[0]);
+#else
+        return 0;
+#endif
+    }
+
+private:
+    std::string m_Override;
+};
+
+inline ShaderSources& shaderSources() {
+    static ShaderSources sources;
+    return sources;
+}
+
+}
+
+#endif //PROJECT_BASE_SHADERSOURCES_H
@@ -0,0 +1,262 @@
+//
+// Uniform grid over the ground plane for spatial queries on many small objects.
+//
+
+#ifndef PROJECT_BASE_SPATIALGRID_H
+#define PROJECT_BASE_SPATIALGRID_H
+
+#include <glm/glm.hpp>
+#include <rg/Frustum.h>
+#include <algorithm>
+#include <cmath>
+#include <cstdint>
+#include <limits>
+#include <utility>
+#include <vector>
+
+namespace rg {
+
+// Bounding spheres bucketed by the XZ cell their center is in, the scene is flat so height
+// only goes into each cell's bounds. Every cell keeps its items packed in one array and
+// tracks the box around their spheres, queries reject whole cells with a single box test and
+// only walk the items of cells that survive. Positions outside the grid's area are clamped
+// into the border cells, they are still found, just less efficiently.
+//
+// Ids are whatever the caller indexes with (e.g. transform rows), dense and small, every id
+// is in the grid at most once. Moving within a cell only rewrites the item, crossing into
+// another cell is a swap-remove and an append. Cell bounds only ever grow.
+class SpatialGrid {
+public:
+    struct Item {
+        glm::vec3 center;
+        float radius;
+        uint32_t id;
+    };
+
+    // area [min, max] on XZ split into square cells of cellSize
+    void init(const glm::vec2& min, const glm::vec2& max, float cellSize) {
+        m_Min = min;
+        m_CellSize = cellSize;
+        m_CellsX = std::max(1, (int) std::ceil((max.x - min.x) / cellSize));
+        m_CellsZ = std::max(1, (int) std::ceil((max.y - min.y) / cellSize));
+        m_Cells.assign((size_t) m_CellsX * m_CellsZ, Cell());
+        m_Locations.clear();
+        m_MaxRadius = 0.0f;
+        m_Size = 0;
+    }
+
+    void insert(uint32_t id, const glm::vec3& center, float radius) {
+        if (id >= m_Locations.size()) {
+            m_Locations.resize(id + 1, Location());
+        }
+        const uint32_t cell = cellOf(center);
+        Cell& c = m_Cells[cell];
+        m_Locations[id] = { cell, (uint32_t) c.items.size() };
+        c.items.push_back({ center, radius, id });
+        c.grow(center, radius);
+        m_MaxRadius = std::max(m_MaxRadius, radius);
+        m_Size++;
+    }
+
+    void move(uint32_t id, const glm::vec3& center) {
+        const Location location = m_Locations[id];
+        const uint32_t cell = cellOf(center);
+        if (cell == location.cell) {
+            Cell& c = m_Cells[cell];
+            c.items[location.slot].center = center;
+            c.grow(center, c.items[location.slot].radius);
+            return;
+        }
+        const float radius = m_Cells[location.cell].items[location.slot].radius;
+        remove(id);
+        insert(id, center, radius);
+    }
+
+    void remove(uint32_t id) {
+        const Location location = m_Locations[id];
+        std::vector<Item>& items = m_Cells[location.cell].items;
+        items[location.slot] = items.back();
+        m_Locations[items[location.slot].id].slot = location.slot;
+        items.pop_back();
+        m_Locations[id] = Location();
+        m_Size--;
+    }
+
+    bool contains(uint32_t id) const { return id < m_Locations.size() && m_Locations[id].cell != NoCell; }
+    size_t size() const { return m_Size; }
+    size_t cellCount() const { return m_Cells.size(); }
+    float cellSize() const { return m_CellSize; }
+
+    // items whose sphere touches the frustum, cells [firstCell, lastCell) only, so jobs can
+    // split the grid between them. Cells entirely inside skip the per item test.
+    template<typename F>
+    void queryFrustum(const Frustum& frustum, size_t firstCell, size_t lastCell, F&& f) const {
+        for (size_t i = firstCell; i < lastCell; i++) {
+            const Cell& cell = m_Cells[i];
+            if (cell.items.empty()) {
+                continue;
+            }
+            const Frustum::Containment containment = frustum.classifyBox(cell.min, cell.max);
+            if (containment == Frustum::Outside) {
+                continue;
+            }
+            for (const Item& item : cell.items) {
+                if (containment == Frustum::Inside || frustum.intersectsSphere(item.center, item.radius)) {
+                    f(item);
+                }
+            }
+        }
+    }
+
+    template<typename F>
+    void queryFrustum(const Frustum& frustum, F&& f) const {
+        queryFrustum(frustum, 0, m_Cells.size(), f);
+    }
+
+    // items whose sphere touches the sphere
+    template<typename F>
+    void querySphere(const glm::vec3& center, float radius, F&& f) const {
+        const glm::vec3 extent(radius);
+        forCells(center - extent, center + extent, [&](const Cell& cell) {
+            const glm::vec3 closest = glm::clamp(center, cell.min, cell.max);
+            if (glm::dot(closest - center, closest - center) > radius * radius) {
+                return;
+            }
+            for (const Item& item : cell.items) {
+                const float reach = radius + item.radius;
+                const glm::vec3 d = item.center - center;
+                if (glm::dot(d, d) <= reach * reach) {
+                    f(item);
+                }
+            }
+        });
+    }
+
+    // items whose sphere touches the box
+    template<typename F>
+    void queryBox(const glm::vec3& min, const glm::vec3& max, F&& f) const {
+        forCells(min, max, [&](const Cell& cell) {
+            if (glm::any(glm::lessThan(cell.max, min)) || glm::any(glm::greaterThan(cell.min, max))) {
+                return;
+            }
+            for (const Item& item : cell.items) {
+                const glm::vec3 closest = glm::clamp(item.center, min, max);
+                const glm::vec3 d = closest - item.center;
+                if (glm::dot(d, d) <= item.radius * item.radius) {
+                    f(item);
+                }
+            }
+        });
+    }
+
+    // items of every cell that may hold spheres touching [min, max], unfiltered, for callers
+    // that run their own batched test over them: f(const Item* items, size_t count)
+    template<typename F>
+    void queryCells(const glm::vec3& min, const glm::vec3& max, F&& f) const {
+        forCells(min, max, [&](const Cell& cell) {
+            f(cell.items.data(), cell.items.size());
+        });
+    }
+
+    // up to k items with the closest centers, nearest first. Searches rings of cells around
+    // the point until nothing outside the rings so far can be closer than the k-th best.
+    std::vector<Item> nearest(const glm::vec3& point, size_t k) const {
+        std::vector<std::pair<float, Item>> best;   // max-heap on distance
+        auto closer = [](const std::pair<float, Item>& a, const std::pair<float, Item>& b) { return a.first < b.first; };
+        if (k == 0 || m_Size == 0) {
+            return {};
+        }
+        const int cx = cellX(point.x), cz = cellZ(point.z);
+        for (int r = 0;; r++) {
+            for (int z = cz - r; z <= cz + r; z++) {
+                for (int x = cx - r; x <= cx + r; x++) {
+                    // the ring only, the inside was searched before
+                    if (x < 0 || z < 0 || x >= m_CellsX || z >= m_CellsZ || (std::abs(x - cx) != r && std::abs(z - cz) != r)) {
+                        continue;
+                    }
+                    for (const Item& item : m_Cells[(size_t) z * m_CellsX + x].items) {
+                        const glm::vec3 d = item.center - point;
+                        const float distance = glm::dot(d, d);
+                        if (best.size() < k) {
+                            best.push_back({ distance, item });
+                            std::push_heap(best.begin(), best.end(), closer);
+                        } else if (distance < best.front().first) {
+                            std::pop_heap(best.begin(), best.end(), closer);
+                            best.back() = { distance, item };
+                            std::push_heap(best.begin(), best.end(), closer);
+                        }
+                    }
+                }
+            }
+            // how far the point is from anything beyond these rings, border cells reach to infinity
+            float bound = std::numeric_limits<float>::max();
+            if (cx - r > 0) bound = std::min(bound, point.x - (m_Min.x + (cx - r) * m_CellSize));
+            if (cx + r < m_CellsX - 1) bound = std::min(bound, m_Min.x + (cx + r + 1) * m_CellSize - point.x);
+            if (cz - r > 0) bound = std::min(bound, point.z - (m_Min.y + (cz - r) * m_CellSize));
+            if (cz + r < m_CellsZ - 1) bound = std::min(bound, m_Min.y + (cz + r + 1) * m_CellSize - point.z);
+            const bool everything = bound == std::numeric_limits<float>::max();
+            if (everything || (best.size() == k && best.front().first <= bound * bound)) {
+                break;
+            }
+        }
+        std::sort_heap(best.begin(), best.end(), closer);
+        std::vector<Item> items;
+        items.reserve(best.size());
+        for (const auto& entry : best) {
+            items.push_back(entry.second);
+        }
+        return items;
+    }
+
+private:
+    static const uint32_t NoCell = 0xFFFFFFFFu;
+
+    struct Cell {
+        std::vector<Item> items;
+        glm::vec3 min = glm::vec3(std::numeric_limits<float>::max());
+        glm::vec3 max = glm::vec3(-std::numeric_limits<float>::max());
+
+        void grow(const glm::vec3& center, float radius) {
+            min = glm::min(min, center - glm::vec3(radius));
+            max = glm::max(max, center + glm::vec3(radius));
+        }
+    };
+
+    struct Location {
+        uint32_t cell = NoCell;
+        uint32_t slot = 0;
+    };
+
+    int cellX(float x) const { return std::min(m_CellsX - 1, std::max(0, (int) std::floor((x - m_Min.x) / m_CellSize))); }
+    int cellZ(float z) const { return std::min(m_CellsZ - 1, std::max(0, (int) std::floor((z - m_Min.y) / m_CellSize))); }
+    uint32_t cellOf(const glm::vec3& p) const { return (uint32_t) (cellZ(p.z) * m_CellsX + cellX(p.x)); }
+
+    // non-empty cells that may hold spheres touching [min, max], widened by the largest radius
+    // since a sphere can stick out of the cell its center is in
+    template<typename F>
+    void forCells(const glm::vec3& min, const glm::vec3& max, F&& f) const {
+        const int x0 = cellX(min.x - m_MaxRadius), x1 = cellX(max.x + m_MaxRadius);
+        const int z0 = cellZ(min.z - m_MaxRadius), z1 = cellZ(max.z + m_MaxRadius);
+        for (int z = z0; z <= z1; z++) {
+            for (int x = x0; x <= x1; x++) {
+                const Cell& cell = m_Cells[(size_t) z * m_CellsX + x];
+                if (!cell.items.empty()) {
+                    f(cell);
+                }
+            }
+        }
+    }
+
+    glm::vec2 m_Min = glm::vec2(0.0f);
+    float m_CellSize = 1.0f;
+    int m_CellsX = 1;
+    int m_CellsZ = 1;
+    std::vector<Cell> m_Cells;
+    std::vector<Location> m_Locations;   // by id
+    float m_MaxRadius = 0.0f;
+    size_t m_Size = 0;
+};
+
+}
+
+#endif //PROJECT_BASE_SPATIALGRID_H
@@ -0,0 +1,122 @@
+//
+// Per-frame vertex data streamed through a ring of fenced buffer regions.
+//
+
+#ifndef PROJECT_BASE_STREAMBUFFER_H
+#define PROJECT_BASE_STREAMBUFFER_H
+
+#include <glad/glad.h>
+#include <GLFW/glfw3.h>
+#include <rg/GLExtensions.h>
+
+namespace rg {
+
+// One buffer split into RegionCount regions, frame N writes region N % RegionCount while the
+// GPU may still be reading the two before it. Each region is fenced after the draws that read
+// it, the fence is only waited for when the ring comes back around, normally long signalled.
+//
+// With ARB_buffer_storage the buffer is mapped once, persistent and coherent, and writing a
+// frame is a plain memcpy. Without it (GL 3.3) the region is mapped every frame with
+// MAP_UNSYNCHRONIZED_BIT, the fences guarantee the GPU is done with it, so the driver neither
+// stalls nor orphans the storage.
+class StreamBuffer {
+public:
+    static const int RegionCount = 3;
+
+    void init(GLsizeiptr regionBytes) {
+        m_RegionBytes = regionBytes;
+        glGenBuffers(1, &m_Buffer);
+        glBindBuffer(GL_ARRAY_BUFFER, m_Buffer);
+        const GLsizeiptr bytes = regionBytes * RegionCount;
+        GLExtensions& extensions = glExtensions();
+        if (extensions.bufferStorage && bytes > 0) {
+            const GLbitfield flags = GL_MAP_WRITE_BIT | GL_MAP_PERSISTENT_BIT | GL_MAP_COHERENT_BIT;
+            extensions.BufferStorage(GL_ARRAY_BUFFER, bytes, nullptr, flags);
+            m_Persistent = (char*) glMapBufferRange(GL_ARRAY_BUFFER, 0, bytes, flags);
+        }
+        if (!m_Persistent) {
+            glBufferData(GL_ARRAY_BUFFER, bytes, nullptr, GL_STREAM_DRAW);
+        }
+        glBindBuffer(GL_ARRAY_BUFFER, 0);
+    }
+
+    // this frame's region, nullptr if the map failed. Leaves the buffer bound to GL_ARRAY_BUFFER
+    // until unmap().
+    char* map() {
+        const double begin = glfwGetTime();
+        if (m_Fences[m_Region]) {
+            // flush on the first try, the fence may never have reached the GPU otherwise
+            GLbitfield flags = GL_SYNC_FLUSH_COMMANDS_BIT;
+            while (glClientWaitSync(m_Fences[m_Region], flags, 1000000) == GL_TIMEOUT_EXPIRED) {
+                flags = 0;
+            }
+            glDeleteSync(m_Fences[m_Region]);
+            m_Fences[m_Region] = 0;
+        }
+        m_WaitMs = (float) ((glfwGetTime() - begin) * 1000.0);
+
+        glBindBuffer(GL_ARRAY_BUFFER, m_Buffer);
+        if (m_Persistent) {
+            return m_Persistent + offset();
+        }
+        if (m_RegionBytes == 0) {
+            return nullptr;
+        }
+        char* mapped = (char*) glMapBufferRange(GL_ARRAY_BUFFER, offset(), m_RegionBytes,
+                                                GL_MAP_WRITE_BIT | GL_MAP_UNSYNCHRONIZED_BIT | GL_MAP_INVALIDATE_RANGE_BIT);
+        m_Mapped = mapped != nullptr;
+        return mapped;
+    }
+
+    void unmap() {
+        if (m_Mapped) {
+            glUnmapBuffer(GL_ARRAY_BUFFER);
+            m_Mapped = false;
+        }
+        glBindBuffer(GL_ARRAY_BUFFER, 0);
+    }
+
+    // after the last draw that reads this frame's region
+    void endFrame() {
+        m_Fences[m_Region] = glFenceSync(GL_SYNC_GPU_COMMANDS_COMPLETE, 0);
+        m_Region = (m_Region + 1) % RegionCount;
+    }
+
+    void release() {
+        for (GLsync& fence : m_Fences) {
+            if (fence) {
+                glDeleteSync(fence);
+                fence = 0;
+            }
+        }
+        if (m_Persistent) {
+            glBindBuffer(GL_ARRAY_BUFFER, m_Buffer);
+            glUnmapBuffer(GL_ARRAY_BUFFER);
+            glBindBuffer(GL_ARRAY_BUFFER, 0);
+            m_Persistent = nullptr;
+        }
+        glDeleteBuffers(1, &m_Buffer);
+        m_Buffer = 0;
+    }
+
+    unsigned int buffer() const { return m_Buffer; }
+    // start of this frame's region in the buffer
+    GLintptr offset() const { return m_Region * m_RegionBytes; }
+    GLsizeiptr regionBytes() const { return m_RegionBytes; }
+    bool persistent() const { return m_Persistent != nullptr; }
+    // how long the last map() waited for the GPU, anything above zero means the ring is too short
+    float waitMs() const { return m_WaitMs; }
+
+private:
+    unsigned int m_Buffer = 0;
+    GLsizeiptr m_RegionBytes = 0;
+    char* m_Persistent = nullptr;
+    bool m_Mapped = false;
+    GLsync m_Fences[RegionCount] = {};
+    int m_Region = 0;
+    float m_WaitMs = 0.0f;
+};
+
+}
+
+#endif //PROJECT_BASE_STREAMBUFFER_H
@@ -0,0 +1,90 @@
+//
+// Parent/child transforms in one flat array, world matrices recomputed only under changed nodes.
+//
+
+#ifndef PROJECT_BASE_TRANSFORMHIERARCHY_H
+#define PROJECT_BASE_TRANSFORMHIERARCHY_H
+
+#include <glm/glm.hpp>
+#include <glm/gtc/type_ptr.hpp>
+#include <algorithm>
+#include <cstdint>
+#include <cstring>
+#include <vector>
+#include <rg/Error.h>
+
+namespace rg {
+
+// Nodes are stored so that a parent always comes before its children (add() only accepts
+// an existing parent), so one forward pass sees every parent's world matrix before it is
+// needed. Dirty flags spread down the same pass: a node is recomputed when its own local
+// transform changed or its parent was recomputed. update() starts at the first dirty node
+// and returns immediately when nothing changed, a parked vehicle costs nothing.
+class TransformHierarchy {
+public:
+    typedef int Node;
+    static const Node None = -1;
+
+    Node add(Node parent, const glm::mat4& local = glm::mat4(1.0f)) {
+        ASSERT(parent < (Node) m_Parent.size(), "TransformHierarchy: parent has to be added first");
+        const Node node = (Node) m_Parent.size();
+        m_Parent.push_back(parent);
+        m_Local.push_back(local);
+        m_World.push_back(local);
+        m_Dirty.push_back(1);
+        m_FirstDirty = std::min(m_FirstDirty, node);
+        return node;
+    }
+
+    // marks the subtree dirty only if the transform actually changed
+    void setLocal(Node node, const glm::mat4& local) {
+        if (std::memcmp(glm::value_ptr(m_Local[node]), glm::value_ptr(local), sizeof(glm::mat4)) == 0) {
+            return;
+        }
+        m_Local[node] = local;
+        m_Dirty[node] = 1;
+        m_FirstDirty = std::min(m_FirstDirty, node);
+    }
+
+    const glm::mat4& local(Node node) const { return m_Local[node]; }
+    const glm::mat4& world(Node node) const { return m_World[node]; }
+    glm::vec3 worldPosition(Node node) const { return glm::vec3(m_World[node][3]); }
+
+    size_t size() const { return m_Parent.size(); }
+
+    // world matrices recomputed by the last update(), for the performance window
+    int lastUpdated() const { return m_LastUpdated; }
+
+    void update() {
+        m_LastUpdated = 0;
+        const Node count = (Node) m_Parent.size();
+        if (m_FirstDirty >= count) {
+            return;
+        }
+        for (Node i = m_FirstDirty; i < count; i++) {
+            const Node parent = m_Parent[i];
+            if (parent != None && m_Dirty[parent]) {
+                m_Dirty[i] = 1;
+            }
+            if (!m_Dirty[i]) {
+                continue;
+            }
+            m_World[i] = parent == None ? m_Local[i] : m_World[parent] * m_Local[i];
+            m_LastUpdated++;
+        }
+        std::fill(m_Dirty.begin() + m_FirstDirty, m_Dirty.end(), 0);
+        m_FirstDirty = count;
+    }
+
+private:
+    std::vector<Node> m_Parent;
+    std::vector<glm::mat4> m_Local;
+    std::vector<glm::mat4> m_World;
+    std::vector<uint8_t> m_Dirty;
+    Node m_FirstDirty = 0;
+    int m_LastUpdated = 0;
+};
+
+}
+
+#endif //PROJECT_BASE_TRANSFORMHIERARCHY_H
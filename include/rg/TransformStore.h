@@ -0,0 +1,240 @@
+//
+// Structure-of-arrays transforms with a batched SSE/AVX world matrix kernel.
+//
+
+#ifndef PROJECT_BASE_TRANSFORMSTORE_H
+#define PROJECT_BASE_TRANSFORMSTORE_H
+
+#include <glm/glm.hpp>
+#include <glm/gtc/quaternion.hpp>
+#include <rg/CompactInstance.h>
+#include <cmath>
+#include <cstddef>
+#include <cstdint>
+#include <initializer_list>
+#include <vector>
+#if defined(__x86_64__) || defined(__i386__)
+#include <immintrin.h>
+#define RG_TRANSFORM_SIMD 1
+#endif
+
+namespace rg {
+
+// Position, rotation (unit quaternion) and per-axis scale, each component in its own array,
+// so the kernel loads 4 or 8 entries per instruction. Output is one column-major mat4
+// (16 floats, the layout glm and instance attributes 5-8 use) per entry,
+// written straight to wherever the caller points, usually a mapped instance buffer.
+// World = translate * rotate * scale, the same as mat4_cast(rotation) with scaled columns.
+class TransformStore {
+public:
+    typedef uint32_t Handle;
+
+    Handle add(const glm::vec3& position, const glm::quat& rotation = glm::quat(1.0f, 0.0f, 0.0f, 0.0f),
+               const glm::vec3& scale = glm::vec3(1.0f)) {
+        m_PX.push_back(position.x); m_PY.push_back(position.y); m_PZ.push_back(position.z);
+        m_QX.push_back(rotation.x); m_QY.push_back(rotation.y); m_QZ.push_back(rotation.z); m_QW.push_back(rotation.w);
+        m_SX.push_back(scale.x); m_SY.push_back(scale.y); m_SZ.push_back(scale.z);
+        return (Handle) (m_PX.size() - 1);
+    }
+
+    size_t size() const { return m_PX.size(); }
+
+    glm::vec3 position(Handle h) const { return glm::vec3(m_PX[h], m_PY[h], m_PZ[h]); }
+    void setPosition(Handle h, const glm::vec3& p) { m_PX[h] = p.x; m_PY[h] = p.y; m_PZ[h] = p.z; }
+    void setRotation(Handle h, const glm::quat& q) { m_QX[h] = q.x; m_QY[h] = q.y; m_QZ[h] = q.z; m_QW[h] = q.w; }
+    void setScale(Handle h, const glm::vec3& s) { m_SX[h] = s.x; m_SY[h] = s.y; m_SZ[h] = s.z; }
+    glm::quat rotation(Handle h) const { return glm::quat(m_QW[h], m_QX[h], m_QY[h], m_QZ[h]); }
+    glm::vec3 scale(Handle h) const { return glm::vec3(m_SX[h], m_SY[h], m_SZ[h]); }
+
+    // moves the last entry into h, handles stay dense; returns the handle that moved (or h)
+    Handle removeSwap(Handle h) {
+        const Handle last = (Handle) (m_PX.size() - 1);
+        for (std::vector<float>* a : { &m_PX, &m_PY, &m_PZ, &m_QX, &m_QY, &m_QZ, &m_QW, &m_SX, &m_SY, &m_SZ }) {
+            (*a)[h] = (*a)[last];
+            a->pop_back();
+        }
+        return last;
+    }
+
+    // raw arrays for batch queries that only need positions (culling)
+    const float* positionsX() const { return m_PX.data(); }
+    const float* positionsY() const { return m_PY.data(); }
+    const float* positionsZ() const { return m_PZ.data(); }
+
+    // entries [first, first + count) into out[0 .. 16 * count)
+    void computeMatrices(size_t first, size_t count, float* out) const {
+        compute(Range{ (uint32_t) first }, count, out);
+    }
+
+    // entries indices[0 .. count) into out[0 .. 16 * count), e.g. whatever survived culling
+    void gatherMatrices(const uint32_t* indices, size_t count, float* out) const {
+        compute(Gather{ indices }, count, out);
+    }
+
+    // rotated around +Y only and scaled the same on every axis, i.e. fits a CompactInstance
+    bool compactable(Handle h) const {
+        const float epsilon = 1e-4f;
+        return std::abs(m_QX[h]) < epsilon && std::abs(m_QZ[h]) < epsilon
+               && std::abs(m_SX[h] - m_SY[h]) < epsilon && std::abs(m_SX[h] - m_SZ[h]) < epsilon;
+    }
+
+    CompactInstance compactInstance(Handle h, uint16_t variation) const {
+        const float yaw = 2.0f * std::atan2(m_QY[h], m_QW[h]);
+        return packCompactInstance(position(h), yaw, m_SX[h], variation);
+    }
+
+    glm::mat4 matrix(Handle h) const {
+        glm::mat4 m;
+        scalar(h, &m[0][0]);
+        return m;
+    }
+
+private:
+    std::vector<float> m_PX, m_PY, m_PZ;
+    std::vector<float> m_QX, m_QY, m_QZ, m_QW;
+    std::vector<float> m_SX, m_SY, m_SZ;
+
+    struct Range {
+        uint32_t first;
+        uint32_t operator()(size_t i) const { return first + (uint32_t) i; }
+    };
+    struct Gather {
+        const uint32_t* indices;
+        uint32_t operator()(size_t i) const { return indices[i]; }
+    };
+
+    void scalar(uint32_t e, float* m) const {
+        const float x = m_QX[e], y = m_QY[e], z = m_QZ[e], w = m_QW[e];
+        const float xx = x * x, yy = y * y, zz = z * z;
+        const float xy = x * y, xz = x * z, yz = y * z;
+        const float wx = w * x, wy = w * y, wz = w * z;
+        m[0] = (1.0f - 2.0f * (yy + zz)) * m_SX[e]; m[1] = 2.0f * (xy + wz) * m_SX[e]; m[2] = 2.0f * (xz - wy) * m_SX[e]; m[3] = 0.0f;
+        m[4] = 2.0f * (xy - wz) * m_SY[e]; m[5] = (1.0f - 2.0f * (xx + zz)) * m_SY[e]; m[6] = 2.0f * (yz + wx) * m_SY[e]; m[7] = 0.0f;
+        m[8] = 2.0f * (xz + wy) * m_SZ[e]; m[9] = 2.0f * (yz - wx) * m_SZ[e]; m[10] = (1.0f - 2.0f * (xx + yy)) * m_SZ[e]; m[11] = 0.0f;
+        m[12] = m_PX[e]; m[13] = m_PY[e]; m[14] = m_PZ[e]; m[15] = 1.0f;
+    }
+
+#ifdef RG_TRANSFORM_SIMD
+    template<typename Index>
+    static __m128 load4(const std::vector<float>& a, const Index& index, size_t i) {
+        return _mm_setr_ps(a[index(i)], a[index(i + 1)], a[index(i + 2)], a[index(i + 3)]);
+    }
+
+    static __m128 load4(const std::vector<float>& a, const Range& range, size_t i) {
+        return _mm_loadu_ps(&a[range(i)]);
+    }
+
+    // 16 registers hold one matrix element each for 4 entries, transpose them into 4 matrices
+    static void store4(const __m128 (&e)[16], float* out) {
+        for (int column = 0; column < 4; column++) {
+            __m128 r0 = e[column * 4], r1 = e[column * 4 + 1], r2 = e[column * 4 + 2], r3 = e[column * 4 + 3];
+            _MM_TRANSPOSE4_PS(r0, r1, r2, r3);
+            _mm_storeu_ps(out + column * 4, r0);
+            _mm_storeu_ps(out + 16 + column * 4, r1);
+            _mm_storeu_ps(out + 32 + column * 4, r2);
+            _mm_storeu_ps(out + 48 + column * 4, r3);
+        }
+    }
+
+    template<typename Index>
+    void sse(const Index& index, size_t i, float* out) const {
+        const __m128 x = load4(m_QX, index, i), y = load4(m_QY, index, i), z = load4(m_QZ, index, i), w = load4(m_QW, index, i);
+        const __m128 sx = load4(m_SX, index, i), sy = load4(m_SY, index, i), sz = load4(m_SZ, index, i);
+        const __m128 one = _mm_set1_ps(1.0f), two = _mm_set1_ps(2.0f), zero = _mm_setzero_ps();
+        const __m128 xx = _mm_mul_ps(x, x), yy = _mm_mul_ps(y, y), zz = _mm_mul_ps(z, z);
+        const __m128 xy = _mm_mul_ps(x, y), xz = _mm_mul_ps(x, z), yz = _mm_mul_ps(y, z);
+        const __m128 wx = _mm_mul_ps(w, x), wy = _mm_mul_ps(w, y), wz = _mm_mul_ps(w, z);
+        __m128 e[16];
+        e[0] = _mm_mul_ps(_mm_sub_ps(one, _mm_mul_ps(two, _mm_add_ps(yy, zz))), sx);
+        e[1] = _mm_mul_ps(_mm_mul_ps(two, _mm_add_ps(xy, wz)), sx);
+        e[2] = _mm_mul_ps(_mm_mul_ps(two, _mm_sub_ps(xz, wy)), sx);
+        e[3] = zero;
+        e[4] = _mm_mul_ps(_mm_mul_ps(two, _mm_sub_ps(xy, wz)), sy);
+        e[5] = _mm_mul_ps(_mm_sub_ps(one, _mm_mul_ps(two, _mm_add_ps(xx, zz))), sy);
+        e[6] = _mm_mul_ps(_mm_mul_ps(two, _mm_add_ps(yz, wx)), sy);
+        e[7] = zero;
+        e[8] = _mm_mul_ps(_mm_mul_ps(two, _mm_add_ps(xz, wy)), sz);
+        e[9] = _mm_mul_ps(_mm_mul_ps(two, _mm_sub_ps(yz, wx)), sz);
+        e[10] = _mm_mul_ps(_mm_sub_ps(one, _mm_mul_ps(two, _mm_add_ps(xx, yy))), sz);
+        e[11] = zero;
+        e[12] = load4(m_PX, index, i);
+        e[13] = load4(m_PY, index, i);
+        e[14] = load4(m_PZ, index, i);
+        e[15] = one;
+        store4(e, out);
+    }
+
+    // same math 8 wide, compiled for AVX regardless of the build flags and only called when
+    // the CPU has it; the transpose reuses the SSE path on both halves
+    template<typename Index>
+    __attribute__((target("avx"))) static __m256 load8(const std::vector<float>& a, const Index& index, size_t i) {
+        return _mm256_setr_ps(a[index(i)], a[index(i + 1)], a[index(i + 2)], a[index(i + 3)],
+                              a[index(i + 4)], a[index(i + 5)], a[index(i + 6)], a[index(i + 7)]);
+    }
+
+    __attribute__((target("avx"))) static __m256 load8(const std::vector<float>& a, const Range& range, size_t i) {
+        return _mm256_loadu_ps(&a[range(i)]);
+    }
+
+    template<typename Index>
+    __attribute__((target("avx"))) void avx(const Index& index, size_t i, float* out) const {
+        const __m256 x = load8(m_QX, index, i), y = load8(m_QY, index, i), z = load8(m_QZ, index, i), w = load8(m_QW, index, i);
+        const __m256 sx = load8(m_SX, index, i), sy = load8(m_SY, index, i), sz = load8(m_SZ, index, i);
+        const __m256 one = _mm256_set1_ps(1.0f), two = _mm256_set1_ps(2.0f), zero = _mm256_setzero_ps();
+        const __m256 xx = _mm256_mul_ps(x, x), yy = _mm256_mul_ps(y, y), zz = _mm256_mul_ps(z, z);
+        const __m256 xy = _mm256_mul_ps(x, y), xz = _mm256_mul_ps(x, z), yz = _mm256_mul_ps(y, z);
+        const __m256 wx = _mm256_mul_ps(w, x), wy = _mm256_mul_ps(w, y), wz = _mm256_mul_ps(w, z);
+        __m256 e[16];
+        e[0] = _mm256_mul_ps(_mm256_sub_ps(one, _mm256_mul_ps(two, _mm256_add_ps(yy, zz))), sx);
+        e[1] = _mm256_mul_ps(_mm256_mul_ps(two, _mm256_add_ps(xy, wz)), sx);
+        e[2] = _mm256_mul_ps(_mm256_mul_ps(two, _mm256_sub_ps(xz, wy)), sx);
+        e[3] = zero;
+        e[4] = _mm256_mul_ps(_mm256_mul_ps(two, _mm256_sub_ps(xy, wz)), sy);
+        e[5] = _mm256_mul_ps(_mm256_sub_ps(one, _mm256_mul_ps(two, _mm256_add_ps(xx, zz))), sy);
+        e[6] = _mm256_mul_ps(_mm256_mul_ps(two, _mm256_add_ps(yz, wx)), sy);
+        e[7] = zero;
+        e[8] = _mm256_mul_ps(_mm256_mul_ps(two, _mm256_add_ps(xz, wy)), sz);
+        e[9] = _mm256_mul_ps(_mm256_mul_ps(two, _mm256_sub_ps(yz, wx)), sz);
+        e[10] = _mm256_mul_ps(_mm256_sub_ps(one, _mm256_mul_ps(two, _mm256_add_ps(xx, yy))), sz);
+        e[11] = zero;
+        e[12] = load8(m_PX, index, i);
+        e[13] = load8(m_PY, index, i);
+        e[14] = load8(m_PZ, index, i);
+        e[15] = one;
+        __m128 low[16], high[16];
+        for (int k = 0; k < 16; k++) {
+            low[k] = _mm256_castps256_ps128(e[k]);
+            high[k] = _mm256_extractf128_ps(e[k], 1);
+        }
+        store4(low, out);
+        store4(high, out + 64);
+    }
+
+    static bool hasAvx() {
+        static const bool supported = __builtin_cpu_supports("avx");
+        return supported;
+    }
+#endif
+
+    template<typename Index>
+    void compute(const Index& index, size_t count, float* out) const {
+        size_t i = 0;
+#ifdef RG_TRANSFORM_SIMD
+        if (hasAvx()) {
+            for (; i + 8 <= count; i += 8) {
+                avx(index, i, out + 16 * i);
+            }
+        }
+        for (; i + 4 <= count; i += 4) {
+            sse(index, i, out + 16 * i);
+        }
+#endif
+        for (; i < count; i++) {
+            scalar(index(i), out + 16 * i);
+        }
+    }
+};
+
+}
+
+#endif //PROJECT_BASE_TRANSFORMSTORE_H
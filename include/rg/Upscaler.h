@@ -0,0 +1,45 @@
+//
+// Spatial upscaler: edge-adaptive Lanczos upsample followed by contrast-adaptive sharpening.
+//
+
+#ifndef PROJECT_BASE_UPSCALER_H
+#define PROJECT_BASE_UPSCALER_H
+
+namespace rg {
+
+enum class UpscalePreset {
+    Off,         // bilinear straight from the hdr target, as before
+    Quality,
+    Balanced,
+    Performance
+};
+
+struct UpscaleSettings {
+    const char* name;
+    float scale;      // internal resolution relative to the window
+    float sharpness;  // 0 = gentle, 1 = maximum CAS
+};
+
+inline UpscaleSettings upscaleSettings(UpscalePreset preset) {
+    switch (preset) {
+        case UpscalePreset::Off: return { "Off", 1.0f, 0.0f };
+        case UpscalePreset::Quality: return { "Quality", 0.77f, 0.3f };
+        case UpscalePreset::Balanced: return { "Balanced", 0.67f, 0.5f };
+        case UpscalePreset::Performance: return { "Performance", 0.5f, 0.7f };
+    }
+    return { "Off", 1.0f, 0.0f };
+}
+
+// The tone mapped scene (only the internal sub-rectangle is used) and the upscaled image
+// are transient LDR render graph textures, see RenderTargets::ldr.
+class Upscaler {
+public:
+    UpscalePreset preset = UpscalePreset::Off;
+
+    bool enabled() const { return preset != UpscalePreset::Off; }
+    UpscaleSettings settings() const { return upscaleSettings(preset); }
+};
+
+}
+
+#endif //PROJECT_BASE_UPSCALER_H
@@ -2,107 +2,39 @@
 out vec4 FragColor;
 layout (location = 1) out vec4 BrightColor;
 
-struct Spotlight {
-    vec3 position;
-    vec3 direction;
-
-    vec3 specular;
-    vec3 diffuse;
-    vec3 ambient;
-
-    float constant;
-    float linear;
-    float quadratic;
-
-    float cutOff;
-    float outerCutOff;
-};
-
-struct PointLight {
-    vec3 position;
-
-    vec3 specular;
-    vec3 diffuse;
-    vec3 ambient;
-
-    float constant;
-    float linear;
-    float quadratic;
-};
-
-struct Material {
-    sampler2D texture_diffuse1;
-    sampler2D texture_specular1;
-
-    float shininess;
-};
 in vec2 TexCoords;
 in vec3 Normal;
 in vec3 FragPos;
+#ifdef NORMAL_MAP
+in mat3 TBN;
+#endif
+
+#include "include/lighting.glsl"
 
 uniform Spotlight leftHeadlight;
 uniform Spotlight rightHeadlight;
+#ifdef MOONLIGHT
 uniform PointLight tempSvetlo;
+#endif
 uniform Material material;
 uniform vec3 viewPosition;
-uniform bool moonlight;
-
-vec3 CalcSpotlight(Spotlight light, vec3 normal, vec3 fragPos, vec3 viewDir)
-{
-    vec3 lightDir = normalize(light.position - fragPos);
-
-    float theta = dot(lightDir, normalize(-light.direction));
-    float epsilon = light.cutOff - light.outerCutOff;
-    float intensity = clamp((theta - light.outerCutOff) / epsilon, 0.0f, 1.0f);
-
-    vec3 ambient = light.ambient * vec3(texture(material.texture_diffuse1, TexCoords));
-
-    float diff = max(dot(normal, lightDir), 0.0);
-    vec3 diffuse = light.diffuse * diff * vec3(texture(material.texture_diffuse1, TexCoords)) * intensity;
-
-    vec3 reflectDir = reflect(-lightDir, normal);
-    float spec = pow(max(dot(viewDir, reflectDir), 0.0), material.shininess);
-    vec3 specular = light.specular * spec * vec3(texture(material.texture_specular1, TexCoords).xxx) * intensity;
-
-    float distance = length(light.position - fragPos);
-    float attenuation = 1.0 / (light.constant + light.linear * distance + light.quadratic * distance * distance);
-    ambient *= attenuation;
-    diffuse *= attenuation;
-    specular *= attenuation;
-    return (ambient + diffuse + specular);
-}
-
-vec3 CalcPointLight(PointLight light, vec3 normal, vec3 fragPos, vec3 viewDir)
-{
-    vec3 lightDir = normalize(light.position - fragPos);
-
-    vec3 ambient = light.ambient * vec3(texture(material.texture_diffuse1, TexCoords));
-
-    float diff = max(dot(normal, lightDir), 0.0);
-    vec3 diffuse = light.diffuse * diff * vec3(texture(material.texture_diffuse1, TexCoords));
-
-    vec3 reflectDir = reflect(-lightDir, normal);
-    vec3 halfwayDir = normalize(lightDir + viewDir);
-    float spec = pow(max(dot(normal, halfwayDir), 0.0), material.shininess);
-    vec3 specular = light.specular * spec * vec3(texture(material.texture_specular1, TexCoords).xxx);
-
-    float distance = length(light.position - fragPos);
-    float attenuation = 1.0 / (light.constant + light.linear * distance + light.quadratic * distance * distance);
-    ambient *= attenuation;
-    diffuse *= attenuation;
-    specular *= attenuation;
-    return (ambient + diffuse + specular);
-}
 
 void main()
 {
+#ifdef NORMAL_MAP
+    vec3 normal = normalize(TBN * (texture(material.texture_normal1, TexCoords).rgb * 2.0 - 1.0));
+#else
     vec3 normal = normalize(Normal);
+#endif
     vec3 viewDir = normalize(viewPosition - FragPos);
-    vec3 result = CalcSpotlight(leftHeadlight, normal, FragPos, viewDir) + CalcSpotlight(rightHeadlight, normal, FragPos, viewDir);
-    if (moonlight)
-    {
-        result += CalcPointLight(tempSvetlo, normal, FragPos, viewDir);
-    }
+    vec3 albedo = texture(material.texture_diffuse1, TexCoords).rgb;
+    vec3 specularMask = texture(material.texture_specular1, TexCoords).xxx;
+
+    vec3 result = CalcSpotlight(leftHeadlight, normal, FragPos, viewDir, albedo, specularMask, material.shininess)
+                + CalcSpotlight(rightHeadlight, normal, FragPos, viewDir, albedo, specularMask, material.shininess);
+#ifdef MOONLIGHT
+    result += CalcPointLight(tempSvetlo, normal, FragPos, viewDir, albedo, specularMask, material.shininess);
+#endif
     FragColor = vec4(result, 1.0);
 
     float brightness = dot(result, vec3(0.2126, 0.7152, 0.0722));
@@ -110,4 +42,4 @@ void main()
         BrightColor = vec4(result, 1.0);
     else
         BrightColor = vec4(0.0, 0.0, 0.0, 1.0);
-}
\ No newline at end of file
+}
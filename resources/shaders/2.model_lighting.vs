@@ -2,19 +2,28 @@
 layout (location = 0) in vec3 aPos;
 layout (location = 1) in vec3 aNormal;
 layout (location = 2) in vec2 aTexCoords;
+#ifdef NORMAL_MAP
+layout (location = 3) in vec3 aTangent;
+layout (location = 4) in vec3 aBitangent;
+#endif
 
 out vec2 TexCoords;
 out vec3 Normal;
 out vec3 FragPos;
+#ifdef NORMAL_MAP
+out mat3 TBN;
+#endif
 
-uniform mat4 model;
-uniform mat4 view;
-uniform mat4 projection;
+#include "include/transform.glsl"
 
 void main()
 {
-    FragPos = vec3(model * vec4(aPos, 1.0));
+    FragPos = worldPosition(aPos);
     Normal = aNormal;
-    TexCoords = aTexCoords;    
-    gl_Position = projection * view * vec4(FragPos, 1.0);
-}
\ No newline at end of file
+    TexCoords = aTexCoords;
+#ifdef NORMAL_MAP
+    // same space as Normal above
+    TBN = mat3(normalize(aTangent), normalize(aBitangent), normalize(aNormal));
+#endif
+    gl_Position = clipPosition(FragPos);
+}
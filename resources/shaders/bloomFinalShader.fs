@@ -7,6 +7,8 @@ uniform sampler2D scene;
 uniform sampler2D bloomBlur;
 uniform bool bloom;
 uniform float exposure;
+uniform bool autoExposure;
+uniform sampler2D exposureTexture; // 1x1, written by exposureShader
 
 void main()
 {
@@ -16,7 +18,8 @@ void main()
     if(bloom)
         hdrColor += bloomColor; // additive blending
     // tone mapping
-    vec3 result = vec3(1.0) - exp(-hdrColor * exposure);
+    float e = autoExposure ? texelFetch(exposureTexture, ivec2(0, 0), 0).r : exposure;
+    vec3 result = vec3(1.0) - exp(-hdrColor * e);
     // also gamma correct while we're at it
     result = pow(result, vec3(1.0 / gamma));
     FragColor = vec4(result, 1.0);
@@ -6,6 +6,8 @@ in vec2 TexCoords;
 uniform sampler2D image;
 
 uniform bool horizontal;
+// last valid texel center, anything past it is left over from a larger resolution
+uniform vec2 uvMax = vec2(1.0);
 uniform float weight[5] = float[] (0.2270270270, 0.1945945946, 0.1216216216, 0.0540540541, 0.0162162162);
 
 void main()
@@ -16,7 +18,7 @@ void main()
      {
          for(int i = 1; i < 5; ++i)
          {
-            result += texture(image, TexCoords + vec2(tex_offset.x * i, 0.0)).rgb * weight[i];
+            result += texture(image, min(TexCoords + vec2(tex_offset.x * i, 0.0), uvMax)).rgb * weight[i];
             result += texture(image, TexCoords - vec2(tex_offset.x * i, 0.0)).rgb * weight[i];
          }
      }
@@ -24,7 +26,7 @@ void main()
      {
          for(int i = 1; i < 5; ++i)
          {
-             result += texture(image, TexCoords + vec2(0.0, tex_offset.y * i)).rgb * weight[i];
+             result += texture(image, min(TexCoords + vec2(0.0, tex_offset.y * i), uvMax)).rgb * weight[i];
              result += texture(image, TexCoords - vec2(0.0, tex_offset.y * i)).rgb * weight[i];
          }
      }
@@ -0,0 +1,10 @@
+#version 330 core
+layout (location = 0) in vec3 aPos;
+
+// same transform as 2.model_lighting.vs, the main pass tests against this depth with GL_EQUAL
+#include "include/transform.glsl"
+
+void main()
+{
+    gl_Position = clipPosition(worldPosition(aPos));
+}
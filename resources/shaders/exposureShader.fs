@@ -0,0 +1,44 @@
+#version 330 core
+out vec4 FragColor;
+
+uniform sampler2D histogram;
+uniform sampler2D previousExposure;
+uniform int binCount;
+uniform float minLogLuminance;
+uniform float logLuminanceRange;
+uniform float lowPercent;
+uniform float highPercent;
+uniform float compensation;
+uniform float adaptationSpeed;
+uniform float deltaTime;
+
+void main()
+{
+    float total = 0.0;
+    for (int i = 0; i < binCount; ++i)
+        total += texelFetch(histogram, ivec2(i, 0), 0).r;
+
+    // average log luminance of the samples between the low and high percentiles
+    float low = total * lowPercent;
+    float high = total * highPercent;
+    float accumulated = 0.0;
+    float weighted = 0.0;
+    float count = 0.0;
+    for (int i = 0; i < binCount; ++i)
+    {
+        float samples = texelFetch(histogram, ivec2(i, 0), 0).r;
+        float inside = max(0.0, min(accumulated + samples, high) - max(accumulated, low));
+        accumulated += samples;
+        float logLuminance = minLogLuminance + (float(i) + 0.5) / float(binCount) * logLuminanceRange;
+        weighted += inside * logLuminance;
+        count += inside;
+    }
+    float averageLuminance = exp2(count > 0.0 ? weighted / count : minLogLuminance);
+
+    // 1 - exp(-L * exposure) puts the average at middle grey (0.18) when L * exposure = 0.2
+    float target = clamp(0.2 / averageLuminance * exp2(compensation), 0.001, 100.0);
+    float previous = max(texelFetch(previousExposure, ivec2(0, 0), 0).r, 0.001);
+    // adapt in log space so getting brighter and darker take the same time
+    float adapted = exp2(mix(log2(previous), log2(target), 1.0 - exp(-deltaTime * adaptationSpeed)));
+    FragColor = vec4(adapted, 0.0, 0.0, 1.0);
+}
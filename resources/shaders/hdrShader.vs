@@ -4,8 +4,11 @@ layout (location = 1) in vec2 aTexCoords;
 
 out vec2 TexCoords;
 
+// part of the source texture covered by the scene when rendering at reduced resolution
+uniform vec2 uvScale = vec2(1.0);
+
 void main()
 {
-    TexCoords = aTexCoords;
+    TexCoords = aTexCoords * uvScale;
     gl_Position = vec4(aPos, 1.0);
 }
\ No newline at end of file
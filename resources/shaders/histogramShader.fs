@@ -0,0 +1,8 @@
+#version 330 core
+out vec4 FragColor;
+
+void main()
+{
+    // additive blending turns this into a count
+    FragColor = vec4(1.0);
+}
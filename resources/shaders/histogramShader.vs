@@ -0,0 +1,21 @@
+#version 330 core
+// one point per luminance sample, positioned over the histogram bin it falls into
+
+uniform sampler2D scene;
+uniform vec2 uvScale;
+uniform int samplesX;
+uniform int samplesY;
+uniform int binCount;
+uniform float minLogLuminance;
+uniform float logLuminanceRange;
+
+void main()
+{
+    ivec2 cell = ivec2(gl_VertexID % samplesX, gl_VertexID / samplesX);
+    vec2 uv = (vec2(cell) + 0.5) / vec2(samplesX, samplesY) * uvScale;
+    vec3 color = textureLod(scene, uv, 0.0).rgb;
+    float luminance = dot(color, vec3(0.2126, 0.7152, 0.0722));
+    float t = luminance < 1e-5 ? 0.0 : clamp((log2(luminance) - minLogLuminance) / logLuminanceRange, 0.0, 1.0);
+    float bin = min(floor(t * float(binCount)), float(binCount - 1));
+    gl_Position = vec4((bin + 0.5) / float(binCount) * 2.0 - 1.0, 0.0, 0.0, 1.0);
+}
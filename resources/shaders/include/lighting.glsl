@@ -0,0 +1,82 @@
+// Light and material structs plus the shading functions of the lit scene.
+// The material textures are sampled once by the caller and passed in, not once per light.
+
+struct Spotlight {
+    vec3 position;
+    vec3 direction;
+
+    vec3 specular;
+    vec3 diffuse;
+    vec3 ambient;
+
+    float constant;
+    float linear;
+    float quadratic;
+
+    float cutOff;
+    float outerCutOff;
+};
+
+struct PointLight {
+    vec3 position;
+
+    vec3 specular;
+    vec3 diffuse;
+    vec3 ambient;
+
+    float constant;
+    float linear;
+    float quadratic;
+};
+
+struct Material {
+    sampler2D texture_diffuse1;
+    sampler2D texture_specular1;
+#ifdef NORMAL_MAP
+    sampler2D texture_normal1;
+#endif
+
+    float shininess;
+};
+
+float attenuation(float constant, float linear, float quadratic, vec3 lightPos, vec3 fragPos)
+{
+    float distance = length(lightPos - fragPos);
+    return 1.0 / (constant + linear * distance + quadratic * distance * distance);
+}
+
+vec3 CalcSpotlight(Spotlight light, vec3 normal, vec3 fragPos, vec3 viewDir, vec3 albedo, vec3 specularMask, float shininess)
+{
+    vec3 lightDir = normalize(light.position - fragPos);
+
+    float theta = dot(lightDir, normalize(-light.direction));
+    float epsilon = light.cutOff - light.outerCutOff;
+    float intensity = clamp((theta - light.outerCutOff) / epsilon, 0.0f, 1.0f);
+
+    vec3 ambient = light.ambient * albedo;
+
+    float diff = max(dot(normal, lightDir), 0.0);
+    vec3 diffuse = light.diffuse * diff * albedo * intensity;
+
+    vec3 reflectDir = reflect(-lightDir, normal);
+    float spec = pow(max(dot(viewDir, reflectDir), 0.0), shininess);
+    vec3 specular = light.specular * spec * specularMask * intensity;
+
+    return (ambient + diffuse + specular) * attenuation(light.constant, light.linear, light.quadratic, light.position, fragPos);
+}
+
+vec3 CalcPointLight(PointLight light, vec3 normal, vec3 fragPos, vec3 viewDir, vec3 albedo, vec3 specularMask, float shininess)
+{
+    vec3 lightDir = normalize(light.position - fragPos);
+
+    vec3 ambient = light.ambient * albedo;
+
+    float diff = max(dot(normal, lightDir), 0.0);
+    vec3 diffuse = light.diffuse * diff * albedo;
+
+    vec3 halfwayDir = normalize(lightDir + viewDir);
+    float spec = pow(max(dot(normal, halfwayDir), 0.0), shininess);
+    vec3 specular = light.specular * spec * specularMask;
+
+    return (ambient + diffuse + specular) * attenuation(light.constant, light.linear, light.quadratic, light.position, fragPos);
+}
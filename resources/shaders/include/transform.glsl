@@ -0,0 +1,42 @@
+// Model matrix source and clip-space transform shared by every pass that draws scene geometry.
+// Depth pre-pass and shading pass must produce bit-identical depth for GL_EQUAL, so both
+// include this file instead of writing the expression out themselves.
+
+#if defined(INSTANCED) && defined(COMPACT_INSTANCE)
+// rg::CompactInstance, half floats widened by the vertex fetch
+layout (location = 5) in vec4 aInstancePositionYaw;
+layout (location = 6) in float aInstanceScale;
+layout (location = 7) in uint aInstanceVariation;
+
+mat4 compactInstanceModel()
+{
+    float s = sin(aInstancePositionYaw.w) * aInstanceScale;
+    float c = cos(aInstancePositionYaw.w) * aInstanceScale;
+    return mat4(vec4(c, 0.0, -s, 0.0),
+                vec4(0.0, aInstanceScale, 0.0, 0.0),
+                vec4(s, 0.0, c, 0.0),
+                vec4(aInstancePositionYaw.xyz, 1.0));
+}
+#define MODEL_MATRIX compactInstanceModel()
+#elif defined(INSTANCED)
+layout (location = 5) in mat4 aInstanceModel;   // takes locations 5-8
+#define MODEL_MATRIX aInstanceModel
+#else
+uniform mat4 model;
+#define MODEL_MATRIX model
+#endif
+
+uniform mat4 view;
+uniform mat4 projection;
+
+invariant gl_Position;
+
+vec3 worldPosition(vec3 position)
+{
+    return vec3(MODEL_MATRIX * vec4(position, 1.0));
+}
+
+vec4 clipPosition(vec3 worldPos)
+{
+    return projection * view * vec4(worldPos, 1.0);
+}
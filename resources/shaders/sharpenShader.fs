@@ -0,0 +1,41 @@
+#version 330 core
+out vec4 FragColor;
+
+in vec2 TexCoords;
+
+uniform sampler2D image;
+uniform float sharpness;
+
+vec3 fetch(ivec2 p)
+{
+    return texelFetch(image, clamp(p, ivec2(0), textureSize(image, 0) - 1), 0).rgb;
+}
+
+// contrast adaptive sharpening: the sharpening weight shrinks where the local
+// neighbourhood already has a lot of contrast, so edges don't get halos
+void main()
+{
+    ivec2 p = ivec2(gl_FragCoord.xy);
+    // a b c
+    // d e f
+    // g h i
+    vec3 a = fetch(p + ivec2(-1, 1));
+    vec3 b = fetch(p + ivec2( 0, 1));
+    vec3 c = fetch(p + ivec2( 1, 1));
+    vec3 d = fetch(p + ivec2(-1, 0));
+    vec3 e = fetch(p);
+    vec3 f = fetch(p + ivec2( 1, 0));
+    vec3 g = fetch(p + ivec2(-1,-1));
+    vec3 h = fetch(p + ivec2( 0,-1));
+    vec3 i = fetch(p + ivec2( 1,-1));
+
+    vec3 mn = min(min(min(d, e), min(f, b)), h);
+    vec3 mx = max(max(max(d, e), max(f, b)), h);
+    mn += min(mn, min(min(a, c), min(g, i)));
+    mx += max(mx, max(max(a, c), max(g, i)));
+
+    vec3 amp = sqrt(clamp(min(mn, 2.0 - mx) / max(mx, vec3(1e-5)), 0.0, 1.0));
+    vec3 w = amp * (-1.0 / mix(8.0, 5.0, sharpness));
+    vec3 result = ((b + d + f + h) * w + e) / (1.0 + 4.0 * w);
+    FragColor = vec4(clamp(result, 0.0, 1.0), 1.0);
+}
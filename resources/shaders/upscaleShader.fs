@@ -0,0 +1,68 @@
+#version 330 core
+out vec4 FragColor;
+
+in vec2 TexCoords;
+
+uniform sampler2D image;
+uniform vec2 inputSize;   // internal resolution, only this corner of image is valid
+uniform vec2 outputSize;
+
+float luma(vec3 c)
+{
+    return dot(c, vec3(0.299, 0.587, 0.114));
+}
+
+vec3 fetch(ivec2 p)
+{
+    return texelFetch(image, clamp(p, ivec2(0), ivec2(inputSize) - 1), 0).rgb;
+}
+
+// lanczos2 approximated with a polynomial (no sin/cos), takes squared distance
+float lanczos2(float x2)
+{
+    x2 = min(x2, 4.0);
+    float a = 2.0 / 5.0 * x2 - 1.0;
+    float b = 1.0 / 4.0 * x2 - 1.0;
+    return (25.0 / 16.0 * a * a - (25.0 / 16.0 - 1.0)) * (b * b);
+}
+
+void main()
+{
+    vec2 srcPos = gl_FragCoord.xy * (inputSize / outputSize) - 0.5;
+    ivec2 base = ivec2(floor(srcPos));
+    vec2 f = srcPos - vec2(base);
+
+    // edge direction from the luma gradient of the 2x2 footprint
+    vec3 c00 = fetch(base);
+    vec3 c10 = fetch(base + ivec2(1, 0));
+    vec3 c01 = fetch(base + ivec2(0, 1));
+    vec3 c11 = fetch(base + ivec2(1, 1));
+    float l00 = luma(c00), l10 = luma(c10), l01 = luma(c01), l11 = luma(c11);
+    vec2 grad = vec2((l10 - l00) + (l11 - l01), (l01 - l00) + (l11 - l10));
+    float gradLen = length(grad);
+    vec2 dir = gradLen > 1e-4 ? grad / gradLen : vec2(1.0, 0.0);
+    // on strong edges the kernel gets narrower across the edge and wider along it,
+    // which keeps the edge crisp and smooths the stair steps
+    float edge = clamp(gradLen * 4.0, 0.0, 1.0);
+    vec2 axisScale = vec2(1.0 + 0.5 * edge, 1.0 - 0.5 * edge);
+
+    vec3 sum = vec3(0.0);
+    float weightSum = 0.0;
+    for (int j = -1; j <= 2; ++j)
+    {
+        for (int i = -1; i <= 2; ++i)
+        {
+            vec2 offset = vec2(i, j) - f;
+            vec2 rotated = vec2(dot(offset, dir), dot(offset, vec2(-dir.y, dir.x))) * axisScale;
+            float w = lanczos2(dot(rotated, rotated));
+            sum += fetch(base + ivec2(i, j)) * w;
+            weightSum += w;
+        }
+    }
+    vec3 result = sum / weightSum;
+
+    // negative lobes ring, keep the result inside the range of the nearest texels
+    vec3 lo = min(min(c00, c10), min(c01, c11));
+    vec3 hi = max(max(c00, c10), max(c01, c11));
+    FragColor = vec4(clamp(result, lo, hi), 1.0);
+}
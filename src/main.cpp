@@ -14,12 +14,53 @@
 #include <learnopengl/camera.h>
 #include <learnopengl/model.h>
 
+#include <rg/RenderGraph.h>
+#include <rg/RenderTargets.h>
+#include <rg/Upscaler.h>
+#include <rg/AutoExposure.h>
+#include <rg/ShaderPreprocessor.h>
+#include <rg/GLExtensions.h>
+#include <rg/ProgramBinaryCache.h>
+#include <rg/ShaderBuildQueue.h>
+#include <rg/ShaderReloader.h>
+#include <rg/ShaderSources.h>
+#include <rg/JobSystem.h>
+#include <rg/Frustum.h>
+#include <rg/TransformStore.h>
+#include <rg/TransformHierarchy.h>
+#include <rg/EntityWorld.h>
+#include <rg/Components.h>
+#include <rg/FramePipeline.h>
+#include <rg/ImGuiSnapshot.h>
+#include <rg/FixedTimestep.h>
+#include <rg/FramePacing.h>
+#include <rg/PowerSaver.h>
+#include <rg/StreamBuffer.h>
+#include <rg/SpatialGrid.h>
+#include <rg/Collision.h>
+#include <rg/Bvh.h>
+
+#include <cstdlib>
 #include <iostream>
+#include <limits>
+#include <mutex>
+#include <random>
+#include <thread>
+#include <unordered_map>
 
 void framebuffer_size_callback(GLFWwindow *window, int width, int height);
 void mouse_callback(GLFWwindow *window, double xpos, double ypos);
 void scroll_callback(GLFWwindow *window, double xoffset, double yoffset);
+void mouse_button_callback(GLFWwindow *window, int button, int action, int mods);
 void processInput(GLFWwindow *window);
+struct DriveInput;
+struct CrowdCollisions;
+struct TruckContacts;
+DriveInput readDriveInput(GLFWwindow *window);
+glm::vec3 simulateTruck(rg::EntityWorld& scene, rg::Entity truck, const DriveInput& input, const glm::vec3& bodyForward, float dt);
+TruckContacts collideTruck(rg::EntityWorld& scene, rg::Entity truck, std::vector<CrowdCollisions>& crowds);
+glm::mat4 truckBodyTransform();
+int runHeadless(int argc, char **argv);
 void key_callback(GLFWwindow *window, int key, int scancode, int action, int mods);
 void renderQuad();
 unsigned int loadCubemap(vector<std::string> faces);
@@ -43,32 +84,138 @@ bool firstMouse = true;
 float deltaTime = 0.0f;
 float lastFrame = 0.0f;
 
-struct Spotlight {
-    glm::vec3 position;
-    glm::vec3 direction;
+// the crowd: how many, the square [-zone, zone] they spawn in on XZ and the cells of the grid
+// that indexes them; headless runs build the same world from these
+const int pokemonCount = 1000;
+const float pokemonSpawnZone = 50.0f;
+const float instanceCellSize = 8.0f;
+
+// what the driver does during one simulation step
+struct DriveInput {
+    bool accelerate;
+    bool brake;
+    bool left;
+    bool right;
+};
 
-    glm::vec3 ambient;
-    glm::vec3 diffuse;
-    glm::vec3 specular;
+// a crowd grid and the members of it that touched the truck the step before
+struct CrowdCollisions {
+    const rg::SpatialGrid* grid;
+    rg::ContactSet contacts;
+    std::vector<uint32_t> hits;   // scratch
+};
 
-    float cutOff;
-    float outerCutOff;
+// what one step of truck collisions did
+struct TruckContacts {
+    int crowdStarted = 0;    // crowd members the truck started touching
+    int crowdTouching = 0;
+    bool solid = false;      // overlapped a solid collider and was pushed out
+    glm::vec3 pushed = glm::vec3(0.0f);
+};
 
-    float constant;
-    float linear;
-    float quadratic;
+// one frame as the game thread hands it to the render thread, see rg::FramePipeline
+struct DrawItem {
+    uint32_t model;
+    uint32_t features;
+    uint32_t flags;
+    glm::mat4 world;
+    bool vehicle;   // hangs off the truck, moved along with it by late latching
 };
 
-struct PointLight {
+struct LightItem {
+    rg::Light light;
     glm::vec3 position;
+    bool vehicle;
+};
+
+// where one light's struct sits in a lit program
+struct LightUniforms {
+    GLint position, direction, cutOff, outerCutOff;
+    GLint ambient, diffuse, specular;
+    GLint constant, linear, quadratic;
+};
+
+// looked up the first time a program gets the lights, instead of building every name each frame
+struct LitUniforms {
+    GLint viewPosition;
+    GLint shininess;
+    std::unordered_map<const char*, LightUniforms> lights;   // by rg::Light::uniform
+};
 
-    glm::vec3 ambient;
-    glm::vec3 diffuse;
-    glm::vec3 specular;
+// what the render thread swaps in right before it submits, newer than the packet it draws
+struct LatchedView {
+    glm::mat4 view;
+    glm::vec3 cameraPosition;
+    glm::mat4 vehicle;   // the truck frame the view goes with
+    double inputTime;
+};
+
+// visible instances of one model
+struct InstanceBatch {
+    uint32_t model = 0;
+    uint32_t features = 0;   // with rg::FeatureCompactInstance the instances are in compact, otherwise in matrices
+    std::vector<glm::mat4> matrices;
+    std::vector<rg::CompactInstance> compact;
+
+    bool isCompact() const { return (features & rg::FeatureCompactInstance) != 0; }
+    size_t count() const { return isCompact() ? compact.size() : matrices.size(); }
+    size_t bytes() const { return isCompact() ? compact.size() * sizeof(rg::CompactInstance) : matrices.size() * sizeof(glm::mat4); }
+    const void* data() const { return isCompact() ? (const void*) compact.data() : (const void*) matrices.data(); }
+};
+
+struct FramePacket {
+    float deltaTime = 0.0f;
+    int displayWidth = 0;
+    int displayHeight = 0;
+    glm::mat4 view;
+    glm::mat4 projection;
+    glm::vec3 cameraPosition;
+    glm::mat4 vehicle;
+    double inputTime = 0.0;   // when the input this frame was built from was sampled
+    uint64_t latchSequence = 0;   // the LatchedView published along with this packet
+    std::vector<DrawItem> drawItems;
+    std::vector<InstanceBatch> instances;
+    std::vector<LightItem> lights;
+    glm::mat4 headlightBoxes;
+    glm::mat4 windshield;
+
+    glm::vec3 clearColor;
+    bool depthPrepass = true;
+    bool bloom = true;
+    bool moonlight = true;
+    float exposure = 0.0f;
+    rg::DynamicResolution dynamicResolution;   // settings, the smoothing state stays on the render thread
+    rg::UpscalePreset upscalePreset = rg::UpscalePreset::Off;
+    float requestedScale = 0.0f;
+    bool autoExposure = true;
+    float exposureCompensation = 0.0f;
+    float adaptationSpeed = 0.0f;
+    rg::PacingMode pacing = rg::PacingMode::VSync;
+    bool lateLatch = true;
+
+    rg::ImGuiSnapshot imgui;
+};
 
-    float constant;
-    float linear;
-    float quadratic;
+// what the render thread measured, shown by the ui a frame later
+struct RenderStats {
+    float gpuFrameMs = 0.0f;
+    float smoothedMs = 0.0f;
+    float overdraw = 0.0f;   // shaded fragments of the opaque pass per internal pixel
+    float exposure = 0.0f;
+    int internalWidth = 0;
+    int internalHeight = 0;
+    int displayWidth = 0;
+    int displayHeight = 0;
+    float scale = 1.0f;
+    bool tearControl = false;
+    bool persistentStream = false;
+    float streamWaitMs = 0.0f;   // waited for the GPU to free an instance stream region
+    float latencyMs = 0.0f;   // input sampled to swap returned
+    float latencyAverageMs = 0.0f;
+    float latencyMaxMs = 0.0f;
+    bool lateLatched = false;   // the last frame was drawn with a newer view than its packet
+    rg::RenderGraph::Report report;
+    std::vector<rg::RenderGraph::PassInfo> passes;
 };
 
 struct ProgramState {
@@ -78,12 +225,49 @@ struct ProgramState {
     Camera drivingCamera;
     bool CameraMouseMovementUpdateEnabled = true;
     bool isDrivingMode = true;
-    glm::vec3 truckPosition = glm::vec3(0.0f);
-    glm::vec3 truckForward = glm::vec3(0.0f, 0.0f, -1.0f);
-    float currentTruckSpeed = 0.0f;
-    float currentTruckSteer = 0.0f;
-    Spotlight leftHeadlight;
-    Spotlight rightHeadlight;
+    // everything in the scene, the truck is the entity with the rg::Vehicle component
+    rg::EntityWorld scene;
+    rg::Entity truck;
+    rg::Entity leftHeadlight;
+
+    // framebuffer size as last reported by glfw, render targets follow it at the start of a frame
+    int framebufferWidth = SCR_WIDTH;
+    int framebufferHeight = SCR_HEIGHT;
+    // render settings, the render thread picks them up from the next frame packet
+    rg::DynamicResolution dynamicResolution;
+    rg::Upscaler upscaler;
+    float requestedScale = 0.0f;   // set by the ui, 0 = leave the scale to dynamic resolution
+    bool depthPrepass = true;
+    rg::FramePacer pacer;   // the simulation runs at its own rate whatever the pacing
+    bool lateLatch = true;
+    rg::PowerSaver powerSaver;
+    bool autoExposure = true;
+    float exposureCompensation = 0.0f;
+    float adaptationSpeed = 0.0f;
+    RenderStats renderStats;
+    float gameWaitMs = 0.0f;
+    float renderWaitMs = 0.0f;
+    int instancesVisible = 0;
+    float nearestInstance = -1.0f;   // distance from the truck, -1 = none
+    int crowdHits = 0;        // crowd members the truck ran into since the start
+    int crowdTouching = 0;    // touching it after the last step
+    bool wallContact = false; // pushed out of a solid in the last step
+    float collisionMs = 0.0f; // last step
+    // ray queries, see the game loop
+    bool pickRequested = false;
+    glm::vec2 pickPoint = glm::vec2(0.5f);   // in the window, 0..1 from the top left
+    const char* picked = nullptr;            // what the last pick hit, nullptr = nothing
+    float pickedDistance = 0.0f;
+    float wheelGround[4] = {};               // height of whatever is under each wheel
+    float headlightReach[2] = {};            // how far each headlight sees
+    int raysTraced = 0;
+    float rayMs = 0.0f;
+    glm::vec3 drivingCameraPrevious = glm::vec3(0.0f);   // at the start of the last simulation step
+    int simulationHz = 0;
+    int simulationSteps = 0;   // this frame
+    int transformsUpdated = 0;
+    int jobThreads = 0;
+    std::vector<rg::JobMarker> jobMarkers;   // last frame's jobs
     ProgramState()
             : worldCamera(glm::vec3(4.0f, 4.0f, 2.0f), glm::vec3(0.0f, 1.0f, 0.0f), -135.0f, -35.0f),
               drivingCamera(glm::vec3(0.0f, 1.1f, -0.8f), glm::vec3(0.0f, 1.0f, 0.0f), 0.0f, 0.0f) {}
@@ -93,7 +277,14 @@ ProgramState *programState;
 
 void DrawImGui(ProgramState *programState);
 
-int main() {
+int main(int argc, char **argv) {
+    // simulation only, no window and no GL
+    for (int i = 1; i < argc; i++) {
+        if (std::string(argv[i]) == "--headless") {
+            return runHeadless(argc, argv);
+        }
+    }
+
     // glfw: initialize and configure
     // ------------------------------
     glfwInit();
@@ -117,6 +308,7 @@ int main() {
     glfwSetFramebufferSizeCallback(window, framebuffer_size_callback);
     glfwSetCursorPosCallback(window, mouse_callback);
     glfwSetScrollCallback(window, scroll_callback);
+    glfwSetMouseButtonCallback(window, mouse_button_callback);
     glfwSetKeyCallback(window, key_callback);
     glfwSetInputMode(window, GLFW_CURSOR, GLFW_CURSOR_DISABLED);
     glfwSwapInterval(1);
@@ -127,11 +319,21 @@ int main() {
         std::cout << "Failed to initialize GLAD" << std::endl;
         return -1;
     }
+    rg::glExtensions().load();
+    rg::programBinaryCache().init(".shadercache");
+    // shaders are compiled into the executable, RG_SHADER_DIR points at a tree to edit them live
+    if (const char* shaderDirectory = std::getenv("RG_SHADER_DIR")) {
+        rg::shaderSources().setOverrideDirectory(shaderDirectory);
+    }
+    std::cout << "[Shaders] " << rg::ShaderSources::embeddedCount() << " sources embedded"
+              << (rg::shaderSources().overrideDirectory().empty() ? "" : ", overridden from " + rg::shaderSources().overrideDirectory())
+              << std::endl;
 
     // tell stb_image.h to flip loaded texture's on the y-axis (before loading model).
     stbi_set_flip_vertically_on_load(false);
 
     programState = new ProgramState;
+    glfwGetFramebufferSize(window, &programState->framebufferWidth, &programState->framebufferHeight);
     if (programState->ImGuiEnabled) {
         glfwSetInputMode(window, GLFW_CURSOR, GLFW_CURSOR_NORMAL);
     }
@@ -153,116 +355,122 @@ int main() {
 
     // build and compile shaders
     // -------------------------
-    Shader ourShader("resources/shaders/2.model_lighting.vs", "resources/shaders/2.model_lighting.fs");
-    Shader windshieldShader("resources/shaders/2.model_lighting.vs", "resources/shaders/windshieldShader.fs");
-    Shader hdrShader("resources/shaders/hdrShader.vs", "resources/shaders/hdrShader.fs");
-    Shader blurShader("resources/shaders/hdrShader.vs", "resources/shaders/blurShader.fs");
-    Shader bloomFinalShader("resources/shaders/hdrShader.vs", "resources/shaders/bloomFinalShader.fs");
-    Shader skyboxShader("resources/shaders/skyboxShader.vs", "resources/shaders/skyboxShader.fs");
+    // scene shaders go through the preprocessor, one program per permutation key (rg::Feature* bits)
+    rg::ShaderPermutations litPrograms("resources/shaders/2.model_lighting.vs", "resources/shaders/2.model_lighting.fs");
+    rg::ShaderPermutations depthPrograms("resources/shaders/depthShader.vs", "resources/shaders/depthShader.fs");
+    rg::ShaderPermutations windshieldPrograms("resources/shaders/2.model_lighting.vs", "resources/shaders/windshieldShader.fs");
+    // everything is submitted up front and compiles while the models and textures below load,
+    // statuses are only checked before the first frame (or as they finish, with parallel compile).
+    // Sampler units are set in onReady, touching a program earlier would wait for its link
+    rg::ShaderBuildQueue shaderQueue;
+    shaderQueue.init();
+    for (unsigned int features : { 0u, rg::FeatureMoonlight }) {
+        litPrograms.prewarm(shaderQueue, features);
+        litPrograms.prewarm(shaderQueue, features | rg::FeatureInstanced);
+    }
+    depthPrograms.prewarm(shaderQueue, 0);
+    depthPrograms.prewarm(shaderQueue, rg::FeatureInstanced);
+    windshieldPrograms.prewarm(shaderQueue, 0);
+    Shader& windshieldShader = windshieldPrograms.get(0);
+    Shader hdrShader = shaderQueue.submitFiles("resources/shaders/hdrShader.vs", "resources/shaders/hdrShader.fs", [](Shader& shader) {
+        shader.setInt("hdrBuffer", 0);
+    });
+    Shader blurShader = shaderQueue.submitFiles("resources/shaders/hdrShader.vs", "resources/shaders/blurShader.fs", [](Shader& shader) {
+        shader.setInt("image", 0);
+    });
+    Shader bloomFinalShader = shaderQueue.submitFiles("resources/shaders/hdrShader.vs", "resources/shaders/bloomFinalShader.fs", [](Shader& shader) {
+        shader.setInt("scene", 0);
+        shader.setInt("bloomBlur", 1);
+        shader.setInt("exposureTexture", 2);
+    });
+    Shader skyboxShader = shaderQueue.submitFiles("resources/shaders/skyboxShader.vs", "resources/shaders/skyboxShader.fs", [](Shader& shader) {
+        shader.setInt("skybox", 0);
+    });
+    Shader upscaleShader = shaderQueue.submitFiles("resources/shaders/hdrShader.vs", "resources/shaders/upscaleShader.fs", [](Shader& shader) {
+        shader.setInt("image", 0);
+    });
+    Shader sharpenShader = shaderQueue.submitFiles("resources/shaders/hdrShader.vs", "resources/shaders/sharpenShader.fs", [](Shader& shader) {
+        shader.setInt("image", 0);
+    });
+    Shader histogramShader = shaderQueue.submitFiles("resources/shaders/histogramShader.vs", "resources/shaders/histogramShader.fs", [](Shader& shader) {
+        shader.setInt("scene", 0);
+        shader.setInt("samplesX", rg::AutoExposure::SamplesX);
+        shader.setInt("samplesY", rg::AutoExposure::SamplesY);
+        shader.setInt("binCount", rg::AutoExposure::HistogramBins);
+    });
+    Shader exposureShader = shaderQueue.submitFiles("resources/shaders/hdrShader.vs", "resources/shaders/exposureShader.fs", [](Shader& shader) {
+        shader.setInt("histogram", 0);
+        shader.setInt("previousExposure", 1);
+        shader.setInt("binCount", rg::AutoExposure::HistogramBins);
+    });
+    shaderQueue.mark("all programs submitted");
+    // saving a shader rebuilds whatever uses it in the background, see rg::ShaderReloader
+    rg::ShaderReloader shaderReloader;
+    shaderReloader.init(window, { "resources/shaders", "resources/shaders/include" });
+    shaderReloader.watchPermutations(litPrograms);
+    shaderReloader.watchPermutations(depthPrograms);
+    shaderReloader.watchPermutations(windshieldPrograms);
+    shaderReloader.watchFiles(hdrShader, "resources/shaders/hdrShader.vs", "resources/shaders/hdrShader.fs");
+    shaderReloader.watchFiles(blurShader, "resources/shaders/hdrShader.vs", "resources/shaders/blurShader.fs");
+    shaderReloader.watchFiles(bloomFinalShader, "resources/shaders/hdrShader.vs", "resources/shaders/bloomFinalShader.fs");
+    shaderReloader.watchFiles(skyboxShader, "resources/shaders/skyboxShader.vs", "resources/shaders/skyboxShader.fs");
+    shaderReloader.watchFiles(upscaleShader, "resources/shaders/hdrShader.vs", "resources/shaders/upscaleShader.fs");
+    shaderReloader.watchFiles(sharpenShader, "resources/shaders/hdrShader.vs", "resources/shaders/sharpenShader.fs");
+    shaderReloader.watchFiles(histogramShader, "resources/shaders/histogramShader.vs", "resources/shaders/histogramShader.fs");
+    shaderReloader.watchFiles(exposureShader, "resources/shaders/hdrShader.vs", "resources/shaders/exposureShader.fs");
 
     // load models
     // ---------
-    Model truck("resources/objects/truck/truck.obj");
+    // everything here goes through the depth pre-pass, so each mesh also gets a position-only stream
+    Model truck("resources/objects/truck/truck.obj", false, true);
     truck.SetShaderTextureNamePrefix("material.");
-    Model wall("resources/objects/wall/10061_Wall_SG_V2_Iterations-2.obj");
+    Model wall("resources/objects/wall/10061_Wall_SG_V2_Iterations-2.obj", false, true);
     wall.SetShaderTextureNamePrefix("material.");
-    Model oshawott("resources/objects/oshawott/model.obj");
+    Model oshawott("resources/objects/oshawott/model.obj", false, true);
     oshawott.SetShaderTextureNamePrefix("material.");
-    Model minion("resources/objects/Baby Minion/mc_baby.obj");
+    Model minion("resources/objects/Baby Minion/mc_baby.obj", false, true);
     minion.SetShaderTextureNamePrefix("material.");
-
-    // hdr stuff?
-    // -----------
-    unsigned int hdrFBO;
-    glGenFramebuffers(1, &hdrFBO);
-    glBindFramebuffer(GL_FRAMEBUFFER, hdrFBO);
-
-    unsigned int colorBuffers[2];
-    glGenTextures(2, colorBuffers);
-    for (unsigned int i = 0; i < 2; i++) {
-        glBindTexture(GL_TEXTURE_2D, colorBuffers[i]);
-        glTexImage2D(GL_TEXTURE_2D, 0, GL_RGBA16F, SCR_WIDTH, SCR_HEIGHT, 0, GL_RGBA, GL_FLOAT, NULL);
-        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
-        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
-        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
-        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
-        glFramebufferTexture2D(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0 + i, GL_TEXTURE_2D, colorBuffers[i], 0);
+    // renderables refer to models by their index in this table
+    std::vector<Model*> models = { &truck, &wall, &oshawott, &minion };
+    const uint32_t truckAsset = 0, wallAsset = 1, oshawottAsset = 2, minionAsset = 3;
+    const char* modelNames[] = { "truck", "wall", "oshawott", "minion" };
+    // permutation bits that follow from the asset itself
+    const unsigned int truckFeatures = truck.HasTextures("texture_normal") ? rg::FeatureNormalMap : 0;
+    const unsigned int wallFeatures = wall.HasTextures("texture_normal") ? rg::FeatureNormalMap : 0;
+    const unsigned int oshawottFeatures = oshawott.HasTextures("texture_normal") ? rg::FeatureNormalMap : 0;
+    const unsigned int minionFeatures = minion.HasTextures("texture_normal") ? rg::FeatureNormalMap : 0;
+    shaderQueue.mark("models loaded");
+    for (unsigned int features : { truckFeatures, wallFeatures, oshawottFeatures, minionFeatures }) {
+        litPrograms.prewarm(shaderQueue, features);
+        litPrograms.prewarm(shaderQueue, features | rg::FeatureMoonlight);
     }
-
-    unsigned int rboDepth;
-    glGenRenderbuffers(1, &rboDepth);
-    glBindRenderbuffer(GL_RENDERBUFFER, rboDepth);
-    glRenderbufferStorage(GL_RENDERBUFFER, GL_DEPTH24_STENCIL8, SCR_WIDTH, SCR_HEIGHT);
-    glFramebufferRenderbuffer(GL_FRAMEBUFFER, GL_DEPTH_STENCIL_ATTACHMENT, GL_RENDERBUFFER, rboDepth);
-
-    unsigned int attachments[2] = { GL_COLOR_ATTACHMENT0, GL_COLOR_ATTACHMENT1 };
-    glDrawBuffers(2, attachments);
-    if (glCheckFramebufferStatus(GL_FRAMEBUFFER) != GL_FRAMEBUFFER_COMPLETE)
-        std::cout << "Framebuffer not complete!" << std::endl;
-    glBindFramebuffer(GL_FRAMEBUFFER, 0);
-
-    // ping-pong-framebuffer for blurring
-    unsigned int pingpongFBO[2];
-    unsigned int pingpongColorbuffers[2];
-    glGenFramebuffers(2, pingpongFBO);
-    glGenTextures(2, pingpongColorbuffers);
-    for (unsigned int i = 0; i < 2; i++)
     {
-        glBindFramebuffer(GL_FRAMEBUFFER, pingpongFBO[i]);
-        glBindTexture(GL_TEXTURE_2D, pingpongColorbuffers[i]);
-        glTexImage2D(GL_TEXTURE_2D, 0, GL_RGBA16F, SCR_WIDTH, SCR_HEIGHT, 0, GL_RGBA, GL_FLOAT, NULL);
-        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
-        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
-        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE); // we clamp to the edge as the blur filter would otherwise sample repeated texture values!
-        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
-        glFramebufferTexture2D(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, GL_TEXTURE_2D, pingpongColorbuffers[i], 0);
-        // also check if framebuffers are complete (no need for depth buffer)
-        if (glCheckFramebufferStatus(GL_FRAMEBUFFER) != GL_FRAMEBUFFER_COMPLETE)
-            std::cout << "Framebuffer not complete!" << std::endl;
+        size_t interleavedBytes = 0, positionBytes = 0;
+        for (Model* model : models) {
+            for (const Mesh& mesh : model->meshes) {
+                interleavedBytes += mesh.vertices.size() * sizeof(Vertex);
+                positionBytes += mesh.positionStreamBytes;
+            }
+        }
+        std::cout << "[Mesh] depth passes fetch " << positionBytes / 1024 << " KiB of positions instead of "
+                  << interleavedBytes / 1024 << " KiB of interleaved vertices" << std::endl;
     }
 
+    // hdr stuff?
+    // -----------
+    // the hdr scene target and bloom buffers are transient render graph textures, see the render loop
+    rg::RenderTargets renderTargets;
+    renderTargets.resize(programState->framebufferWidth, programState->framebufferHeight);
+    rg::RenderGraph graph;
 
-    // lighting info
-    // -------------
-    Spotlight leftHeadlight, rightHeadlight;
-    leftHeadlight.position = glm::vec3(0);
-    leftHeadlight.direction = glm::vec3(0.0f, 0.0f, -1.0f);
-
-    leftHeadlight.ambient = glm::vec3(0.0f);
-    leftHeadlight.diffuse = glm::vec3(1.0f);
-    leftHeadlight.specular = glm::vec3(2.0f);
-
-    leftHeadlight.constant = 1.0f;
-    leftHeadlight.linear = 0.09f;
-    leftHeadlight.quadratic = 0.032f;
-
-    leftHeadlight.cutOff = glm::cos(glm::radians(25.0f));
-    leftHeadlight.outerCutOff = glm::cos(glm::radians(40.0f));
-
-    rightHeadlight.position = glm::vec3(0);
-    rightHeadlight.direction = glm::vec3(0.0f, 0.0f, -1.0f);
-
-    rightHeadlight.ambient = glm::vec3(0.0f);
-    rightHeadlight.diffuse = glm::vec3(1.0f);
-    rightHeadlight.specular = glm::vec3(2.0f);
-
-    rightHeadlight.constant = 1.00f;
-    rightHeadlight.linear = 0.09f;
-    rightHeadlight.quadratic = 0.032f;
+    rg::GpuTimer gpuTimer;
+    gpuTimer.init();
+    rg::SampleCounter overdrawCounter;
+    overdrawCounter.init();
 
-    rightHeadlight.cutOff = glm::cos(glm::radians(25.0f));
-    rightHeadlight.outerCutOff = glm::cos(glm::radians(40.0f));
+    rg::AutoExposure autoExposure;
+    autoExposure.init();
 
-    PointLight tempSvetlo;
-    // poludecu od ovih svetala i sve cu ih promeniti cim skejl daunujem modele
-    tempSvetlo.position = glm::vec3(0.0f, 10.0f, 0.0f);
-    tempSvetlo.ambient = glm::vec3(0.01f);
-    tempSvetlo.diffuse = glm::vec3(0.05f);
-    tempSvetlo.specular = glm::vec3(0.1f);
-
-    tempSvetlo.constant = 0.1f;
-    tempSvetlo.linear = 0.0045f;
-    tempSvetlo.quadratic = 0.00032f;
 
     // load skybox and stuff
     float skyboxVertices[] = {
@@ -361,439 +569,1229 @@ int main() {
 
     // shader configuration
     // --------------------
-    hdrShader.use();
-    hdrShader.setInt("hdrBuffer", 0);
-    blurShader.use();
-    blurShader.setInt("image", 0);
-    bloomFinalShader.use();
-    bloomFinalShader.setInt("scene", 0);
-    bloomFinalShader.setInt("bloomBlur", 1);
-    skyboxShader.use();
-    skyboxShader.setInt("skybox", 0);
+    shaderQueue.mark("textures loaded");
+
+    // vehicle attachments, local to the vehicle frame
+    rg::TransformHierarchy attachments;
+    const rg::TransformHierarchy::Node truckFrame = attachments.add(rg::TransformHierarchy::None);
+    const glm::mat4 truckBodyLocal = truckBodyTransform();
+    const rg::TransformHierarchy::Node truckBody = attachments.add(truckFrame, truckBodyLocal);
+    // kamionov forward vector je 1 0 0 iz nekog razloga nemam pojma mnogo su haoticne rotacije i ne sredjuje mi se to
+    const glm::vec3 truckBodyForward = glm::normalize(glm::vec3(truckBodyLocal * glm::vec4(1.0f, 0.0f, 0.0f, 0.0f)));
+    // farovi, spotlight origins are given in the truck model's units, tilted down towards the road
+    const rg::TransformHierarchy::Node headlightLights = attachments.add(truckFrame,
+            glm::rotate(glm::scale(glm::mat4(1.0f), glm::vec3(0.1f)), -0.5f, glm::vec3(1, 0, 0)));
+    // the headlight boxes and the windshield are modelled in vehicle frame units
+    const rg::TransformHierarchy::Node headlightBoxes = attachments.add(truckFrame);
+    const rg::TransformHierarchy::Node windshieldMount = attachments.add(truckFrame);
+    const rg::TransformHierarchy::Node cameraMount = attachments.add(truckFrame, glm::translate(glm::mat4(1.0f), glm::vec3(0.0f, 1.1f, -0.8f)));
+
+    // scene entities
+    // --------------
+    rg::EntityWorld& scene = programState->scene;
+    const glm::quat noRotation(1.0f, 0.0f, 0.0f, 0.0f);
+    auto modelRadius = [](const Model& model) {
+        float radius = 0.0f;
+        for (const Mesh& mesh : model.meshes) {
+            for (const Vertex& vertex : mesh.vertices) {
+                radius = std::max(radius, glm::length(vertex.Position));
+            }
+        }
+        return radius;
+    };
+    const float oshawottRadius = modelRadius(oshawott);
+    // box around the model's vertices, as seen through local (the model's placement in the entity)
+    auto modelBox = [](const Model& model, const glm::mat4& local) {
+        glm::vec3 min(std::numeric_limits<float>::max()), max(-std::numeric_limits<float>::max());
+        for (const Mesh& mesh : model.meshes) {
+            for (const Vertex& vertex : mesh.vertices) {
+                const glm::vec3 p = glm::vec3(local * glm::vec4(vertex.Position, 1.0f));
+                min = glm::min(min, p);
+                max = glm::max(max, p);
+            }
+        }
+        return rg::Collider{ (min + max) * 0.5f, (max - min) * 0.5f };
+    };
+
+    // wott
+    scene.create(glm::vec3(0.0f), noRotation, glm::vec3(1.0f),
+                 rg::Renderable{ oshawottAsset, oshawottFeatures, 0 }, rg::Bounds{ oshawottRadius });
 
     // pokemoni
     // --------
-    int pokemonCount = 1000;
-    std::vector<glm::mat4> pokemoni;
     srand(static_cast<unsigned>(time(0)));
-    float pokemonSpawnZone = 50.0f;
 
     for (int i = 0; i < pokemonCount; i++) {
         float x = -pokemonSpawnZone + static_cast<float>(rand()) / (static_cast<float>(RAND_MAX / (2 * pokemonSpawnZone)));
         float z = -pokemonSpawnZone + static_cast<float>(rand()) / (static_cast<float>(RAND_MAX / (2 * pokemonSpawnZone)));
-        glm::mat4 pokemon = glm::translate(glm::mat4(1.0f), glm::vec3(x, 0.0f, z));
-        pokemoni.push_back(pokemon);
+        scene.create(glm::vec3(x, 0.0f, z), noRotation, glm::vec3(1.0f),
+                     rg::Renderable{ oshawottAsset, oshawottFeatures, 0 }, rg::Bounds{ oshawottRadius }, rg::Instanced{ (uint16_t) (i % 4) });
     }
 
     // rare baby minion encounter
     float minion_x = -pokemonSpawnZone + static_cast<float>(rand()) / (static_cast<float>(RAND_MAX / (2 * pokemonSpawnZone)));
     float minion_z = -pokemonSpawnZone + static_cast<float>(rand()) / (static_cast<float>(RAND_MAX / (2 * pokemonSpawnZone)));
+    scene.create(glm::vec3(minion_x, 0.0f, minion_z), noRotation, glm::vec3(1.0f),
+                 rg::Renderable{ minionAsset, minionFeatures, 0 }, rg::Bounds{ modelRadius(minion) });
+
+    // wall
+    scene.create(glm::vec3(0.0f, 0.0f, -2.5f), glm::angleAxis(-3.14f * 0.5f, glm::vec3(1, 0, 0)), glm::vec3(0.01f),
+                 rg::Renderable{ wallAsset, wallFeatures, rg::RenderCullFace }, rg::Bounds{ modelRadius(wall) * 0.01f },
+                 modelBox(wall, glm::mat4(1.0f)));
+
+    // truck: the vehicle frame (position and steering), its body and lights hang below it in attachments
+    programState->truck = scene.create(glm::vec3(0.0f), noRotation, glm::vec3(1.0f),
+                                       rg::Vehicle{ 0.0f, 0.0f, truckBodyForward }, rg::Motion{ glm::vec3(0.0f), noRotation },
+                                       modelBox(truck, truckBodyLocal));
+    scene.create(glm::vec3(0.0f), noRotation, glm::vec3(1.0f),
+                 rg::Renderable{ truckAsset, truckFeatures, 0 }, rg::Bounds{ modelRadius(truck) * 0.1f },
+                 rg::Attachment{ truckBody, glm::vec3(0.0f) });
 
-    // render loop
-    // -----------
-    while (!glfwWindowShouldClose(window)) {
-        // per-frame time logic
-        // --------------------
-        float currentFrame = glfwGetTime();
-        deltaTime = currentFrame - lastFrame;
-        lastFrame = currentFrame;
-
-        // input
-        // -----
-        processInput(window);
-
-        // render
-        // ------
-        glClearColor(programState->clearColor.r, programState->clearColor.g, programState->clearColor.b, 1.0f);
-        glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
-
-        // novo
-        glBindFramebuffer(GL_FRAMEBUFFER, hdrFBO);
-        glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
-        Camera& activeCamera = programState->isDrivingMode ? programState->drivingCamera : programState->worldCamera;
-
-        // view/projection transformations
-        glm::mat4 projection = glm::perspective(glm::radians(activeCamera.Zoom), (float) SCR_WIDTH / (float) SCR_HEIGHT, 0.2f, 100.0f);
-        glm::mat4 view = activeCamera.GetViewMatrix();
-
-        // draw skybox
-        glDepthFunc(GL_LEQUAL);  // change depth function so depth test passes when values are equal to depth buffer's content
-        skyboxShader.use();
-        view = glm::mat4(glm::mat3(activeCamera.GetViewMatrix())); // remove translation from the view matrix
-        skyboxShader.setMat4("view", view);
-        skyboxShader.setMat4("projection", projection);
-        // skybox cube
-        glBindVertexArray(skyboxVAO);
-        glActiveTexture(GL_TEXTURE0);
-        glBindTexture(GL_TEXTURE_CUBE_MAP, cubemapTexture);
-        glDrawArrays(GL_TRIANGLES, 0, 36);
-        glBindVertexArray(0);
-        glDepthFunc(GL_LESS); // set depth function back to default
-
-        // now normal shader time
-        // view/projection transformations
-        projection = glm::perspective(glm::radians(activeCamera.Zoom), (float) SCR_WIDTH / (float) SCR_HEIGHT, 0.2f, 100.0f);
-        view = activeCamera.GetViewMatrix();
-        ourShader.use();
-        ourShader.setMat4("projection", projection);
-        ourShader.setMat4("view", view);
-        ourShader.setBool("moonlight", moonlight);
-
-        // loading models
-        // --------------
-        // wott
-        glm::mat4 oshawottModel = glm::mat4(1.0f);
-        ourShader.setMat4("model", oshawottModel);
-        //oshawott.Draw(ourShader);
-        oshawott.Draw(ourShader);
-
-        // wottotachi
-        for (glm::mat4& pokemon : pokemoni) {
-            ourShader.setMat4("model", pokemon);
-            oshawott.Draw(ourShader);
+    // lighting info
+    // -------------
+    rg::Light headlight;
+    headlight.type = rg::LightSpot;
+    headlight.direction = glm::vec3(0.0f, 0.0f, -1.0f);
+    headlight.ambient = glm::vec3(0.0f);
+    headlight.diffuse = glm::vec3(1.0f);
+    headlight.specular = glm::vec3(2.0f);
+    headlight.constant = 1.0f;
+    headlight.linear = 0.09f;
+    headlight.quadratic = 0.032f;
+    headlight.cutOff = glm::cos(glm::radians(25.0f));
+    headlight.outerCutOff = glm::cos(glm::radians(40.0f));
+    headlight.uniform = "leftHeadlight";
+    programState->leftHeadlight = scene.create(glm::vec3(0.0f), noRotation, glm::vec3(1.0f), headlight, rg::Attachment{ headlightLights, glm::vec3(-5.0f, 7.0f, -15.0f) });
+    headlight.uniform = "rightHeadlight";
+    scene.create(glm::vec3(0.0f), noRotation, glm::vec3(1.0f), headlight, rg::Attachment{ headlightLights, glm::vec3(5.0f, 7.0f, -15.0f) });
+
+    rg::Light tempSvetlo;
+    // poludecu od ovih svetala i sve cu ih promeniti cim skejl daunujem modele
+    tempSvetlo.type = rg::LightPoint;
+    tempSvetlo.uniform = "tempSvetlo";
+    tempSvetlo.direction = glm::vec3(0.0f, -1.0f, 0.0f);
+    tempSvetlo.ambient = glm::vec3(0.01f);
+    tempSvetlo.diffuse = glm::vec3(0.05f);
+    tempSvetlo.specular = glm::vec3(0.1f);
+    tempSvetlo.constant = 0.1f;
+    tempSvetlo.linear = 0.0045f;
+    tempSvetlo.quadratic = 0.00032f;
+    tempSvetlo.cutOff = tempSvetlo.outerCutOff = 0.0f;
+    scene.create(glm::vec3(0.0f, 10.0f, 0.0f), noRotation, glm::vec3(1.0f), tempSvetlo);
+
+    // instanced renderables: culled against the view every frame on the job system, the visible
+    // part of every model goes into one stream, a region of it per frame in flight. A model
+    // whose instances are all yaw + uniform scale is streamed as 16 byte rg::CompactInstance,
+    // decided here once, anything else keeps full matrices.
+    rg::StreamBuffer instanceStream;
+    std::vector<uint32_t> instancedModels, instancedFeatures;
+    {
+        std::map<uint32_t, size_t> instanceCounts;
+        std::map<uint32_t, uint32_t> features;
+        scene.each<rg::Renderable, rg::Instanced>([&](rg::TransformStore& transforms, const rg::Entity*, size_t count, rg::Renderable* renderables, rg::Instanced*) {
+            for (size_t i = 0; i < count; i++) {
+                const uint32_t model = renderables[i].model;
+                if (!instanceCounts[model]++) {
+                    features[model] = renderables[i].features | rg::FeatureCompactInstance;
+                }
+                if (!transforms.compactable((uint32_t) i)) {
+                    features[model] &= ~rg::FeatureCompactInstance;
+                }
+            }
+        });
+        size_t streamBytes = 0, matrixBytes = 0;
+        for (const auto& instances : instanceCounts) {
+            const uint32_t modelFeatures = features[instances.first];
+            const bool compact = (modelFeatures & rg::FeatureCompactInstance) != 0;
+            streamBytes += instances.second * (compact ? sizeof(rg::CompactInstance) : sizeof(glm::mat4));
+            matrixBytes += instances.second * sizeof(glm::mat4);
+            instancedModels.push_back(instances.first);
+            instancedFeatures.push_back(modelFeatures);
+            litPrograms.prewarm(shaderQueue, modelFeatures | rg::FeatureInstanced);
+            litPrograms.prewarm(shaderQueue, modelFeatures | rg::FeatureInstanced | rg::FeatureMoonlight);
+            depthPrograms.prewarm(shaderQueue, (modelFeatures & rg::FeatureCompactInstance) | rg::FeatureInstanced);
         }
+        instanceStream.init(streamBytes);
+        std::cout << "[Instances] " << (instanceStream.persistent() ? "persistent" : "mapped") << " stream, "
+                  << rg::StreamBuffer::RegionCount << " x " << instanceStream.regionBytes() / 1024 << " KiB ("
+                  << matrixBytes / 1024 << " KiB as matrices)" << std::endl;
+    }
+    // spatial index of every instanced archetype by transform row, built here for the collisions
+    // of the first step and again whenever the archetype changes size; the crowd stands still,
+    // anything that moves goes through grid.move()
+    std::map<const rg::TransformStore*, rg::SpatialGrid> instanceGrids;
+    auto instanceGrid = [&](const rg::TransformStore& transforms, const rg::Bounds* bounds, size_t count) -> rg::SpatialGrid& {
+        rg::SpatialGrid& grid = instanceGrids[&transforms];
+        if (grid.size() != count) {
+            grid.init(glm::vec2(-pokemonSpawnZone), glm::vec2(pokemonSpawnZone), instanceCellSize);
+            for (uint32_t i = 0; i < count; i++) {
+                grid.insert(i, transforms.position(i), bounds[i].radius);
+            }
+        }
+        return grid;
+    };
+    // the grids double as the collision broadphase for the truck, map nodes do not move
+    std::vector<CrowdCollisions> crowdCollisions;
+    scene.each<rg::Bounds, rg::Instanced>([&](rg::TransformStore& transforms, const rg::Entity*, size_t count, rg::Bounds* bounds, rg::Instanced*) {
+        crowdCollisions.emplace_back();
+        crowdCollisions.back().grid = &instanceGrid(transforms, bounds, count);
+    });
+    // a range of grid cells of one instanced archetype and what survived culling in it
+    struct CullBatch {
+        rg::TransformStore* transforms;
+        const rg::Renderable* renderables;
+        const rg::Instanced* instanced;
+        const rg::SpatialGrid* grid;
+        size_t begin, end;
+        std::vector<uint32_t> visible;   // rows, grouped by model
+    };
+    const size_t cullCells = 16;
+    std::vector<CullBatch> cullBatches;
+    // visible rows of one batch that go to the same instance batch, written by one job
+    struct InstanceRun {
+        const CullBatch* batch;
+        uint32_t first, count;
+        InstanceBatch* out;
+        int offset;
+    };
+    std::vector<InstanceRun> instanceRuns;
+    std::vector<glm::mat4> matrixScratch;
+
+    // farovi i sofersajbna, static geometry in vehicle frame units
+    float leftHeadlightVertices[] = {
+        // Front face (two triangles)
+        -0.45f, 0.6f,  -1.5f,  // Bottom left
+        -0.25f, 0.6f,  -1.5f,  // Bottom right
+        -0.45f,  0.8f,  -1.45f,  // Top left
+        -0.25f,  0.8f,  -1.45f,  // Top right
+
+        // Back face (two triangles)
+        -0.45f, 0.6f,  -1.4f,  // Bottom left
+        -0.25f, 0.6f,  -1.4f,  // Bottom right
+        -0.45f,  0.8f,  -1.35f,  // Top left
+        -0.25f,  0.8f,  -1.35f,  // Top right
+
+        // Left side face (two triangles)
+        -0.45f, 0.6f,  -1.5f,  // Front bottom left
+        -0.45f, 0.8f,  -1.45f,  // Front top left
+        -0.45f, 0.6f,  -1.4f,  // Back bottom left
+        -0.45f, 0.8f,  -1.35f,  // Back top left
+
+        // Right side face (two triangles)
+        -0.25f, 0.6f,  -1.45f,  // Front bottom right
+        -0.25f, 0.8f,  -1.4f,  // Front top right
+        -0.25f, 0.6f,  -1.35f,  // Back bottom right
+        -0.25f, 0.8f,  -1.3f,  // Back top right
+
+        // Top face (two triangles)
+        -0.45f,  0.8f,  -1.4f,  // Front left
+        -0.25f,  0.8f,  -1.4f,  // Front right
+        -0.45f,  0.8f,  -1.3f,  // Back left
+        -0.25f,  0.8f,  -1.3f,  // Back right
+
+        // Bottom face (two triangles)
+        -0.45f, 0.6f,  -1.5f,  // Front left
+        -0.25f, 0.6f,  -1.5f,  // Front right
+        -0.45f, 0.6f,  -1.4f,  // Back left
+        -0.25f, 0.6f,  -1.4f   // Back right
+    };
 
-        // minion
-        glm::mat4 binion = glm::translate(glm::mat4(1.0f), glm::vec3(minion_x, 0.0f, minion_z));
-        ourShader.setMat4("model", binion);
-        minion.Draw(ourShader);
-
-        // truck
-        glm::mat4 truckModel = glm::mat4(1.0f);
-
-        // model je blesav pa ga rotiramo da bude lepo orijentisan
-        const float truckRotOffsetX = -M_PI * 0.5f;
-        const float truckRotOffsetZ = M_PI * 0.5f;
-
-        truckModel = glm::translate(truckModel, programState -> truckPosition);
-        truckModel = glm::scale(truckModel, glm::vec3(0.1f));
-
-        truckModel = glm::rotate(truckModel, programState -> currentTruckSteer, glm::vec3(0, 1, 0));
-        truckModel = glm::rotate(truckModel, truckRotOffsetX, glm::vec3(1, 0, 0));
-        truckModel = glm::rotate(truckModel, truckRotOffsetZ, glm::vec3(0, 0, 1));
-
-        // kamionov forward vector je 1 0 0 iz nekog razloga nemam pojma mnogo su haoticne rotacije i ne sredjuje mi se to
-        programState -> truckForward = glm::normalize(glm::vec3(truckModel * glm::vec4(1.0f, 0.0f, 0.0f, 0.0f)));
-
-        ourShader.setMat4("model", truckModel);
-        truck.Draw(ourShader);
-
-        // farovi
-        glm::mat4 headlightModel = glm::mat4(1.0f);
-
-        // ubijemo originalne kamionove rotacije koje cemo ispod primeniti na svetla
-        headlightModel = glm::rotate(headlightModel, -truckRotOffsetZ, glm::vec3(0, 0, 1));
-        headlightModel = glm::rotate(headlightModel, -truckRotOffsetX, glm::vec3(1, 0, 0));
-
-        // al takodje rotiramo malo dole jer su ovo farovi pa kao gledaju u put
-        headlightModel = glm::rotate(headlightModel, -0.5f, glm::vec3(1, 0, 0));
-
-        // ovo je kao radilo
-        leftHeadlight.position = glm::vec3(truckModel * headlightModel * glm::vec4(-5.0f, 7.0f, -15.0f, 1.0f));
-        rightHeadlight.position = glm::vec3(truckModel * headlightModel * glm::vec4(5.0f, 7.0f, -15.0f, 1.0f));
-
-       // leftHeadlight.direction = programState -> truckForward;
-       // rightHeadlight.direction = programState -> truckForward;
+    float rightHeadlightVertices[] = {
+        // Front face (two triangles)
+        0.45f, 0.6f,  -1.5f,  // Bottom left
+        0.25f, 0.6f,  -1.5f,  // Bottom right
+        0.45f,  0.8f,  -1.45f,  // Top left
+        0.25f,  0.8f,  -1.45f,  // Top right
+
+        // Back face (two triangles)
+        0.45f, 0.6f,  -1.4f,  // Bottom left
+        0.25f, 0.6f,  -1.4f,  // Bottom right
+        0.45f,  0.8f,  -1.35f,  // Top left
+        0.25f,  0.8f,  -1.35f,  // Top right
+
+        // Left side face (two triangles)
+        0.45f, 0.6f,  -1.5f,  // Front bottom left
+        0.45f, 0.8f,  -1.45f,  // Front top left
+        0.45f, 0.6f,  -1.4f,  // Back bottom left
+        0.45f, 0.8f,  -1.35f,  // Back top left
+
+        // Right side face (two triangles)
+        0.25f, 0.6f,  -1.45f,  // Front bottom right
+        0.25f, 0.8f,  -1.4f,  // Front top right
+        0.25f, 0.6f,  -1.35f,  // Back bottom right
+        0.25f, 0.8f,  -1.3f,  // Back top right
+
+        // Top face (two triangles)
+        0.45f,  0.8f,  -1.4f,  // Front left
+        0.25f,  0.8f,  -1.4f,  // Front right
+        0.45f,  0.8f,  -1.3f,  // Back left
+        0.25f,  0.8f,  -1.3f,  // Back right
+
+        // Bottom face (two triangles)
+        0.45f, 0.6f,  -1.5f,  // Front left
+        0.25f, 0.6f,  -1.5f,  // Front right
+        0.45f, 0.6f,  -1.4f,  // Back left
+        0.25f, 0.6f,  -1.4f   // Back right
+    };
 
-        glm::mat4 rotationMatrix = glm::rotate(glm::mat4(1.0f), -0.3f, glm::vec3(1.0f, 0.0f, 0.0f));
+    unsigned int headlightVAOs[2], headlightVBOs[2];
+    glGenVertexArrays(2, headlightVAOs);
+    glGenBuffers(2, headlightVBOs);
+    for (int i = 0; i < 2; i++) {
+        glBindVertexArray(headlightVAOs[i]);
+        glBindBuffer(GL_ARRAY_BUFFER, headlightVBOs[i]);
+        glBufferData(GL_ARRAY_BUFFER, sizeof(leftHeadlightVertices), i == 0 ? leftHeadlightVertices : rightHeadlightVertices, GL_STATIC_DRAW);
+        glVertexAttribPointer(0, 3, GL_FLOAT, GL_FALSE, 3 * sizeof(float), (void*)0);
+        glEnableVertexAttribArray(0);
+    }
 
-        leftHeadlight.direction = glm::normalize(glm::vec3(rotationMatrix * glm::vec4(programState->truckForward, 0.0f)));
-        rightHeadlight.direction = glm::normalize(glm::vec3(rotationMatrix * glm::vec4(programState->truckForward, 0.0f)));
+    std::vector<glm::vec3> windshieldVertices = {
+            glm::vec3(-0.35f, 0.9f, -1.35f),  // dole levo
+            glm::vec3(0.3f, 0.9f, -1.35f),   // dole desno
+            glm::vec3(0.3f, 1.35f, -1.2f),  // gore desno
+            glm::vec3(-0.35f, 1.35f, -1.2f)  // gore levo
+    };
+    unsigned int windshieldVAO, windshieldVBO;
+    glGenVertexArrays(1, &windshieldVAO);
+    glGenBuffers(1, &windshieldVBO);
+    glBindVertexArray(windshieldVAO);
+    glBindBuffer(GL_ARRAY_BUFFER, windshieldVBO);
+    glBufferData(GL_ARRAY_BUFFER, windshieldVertices.size() * sizeof(glm::vec3), &windshieldVertices[0], GL_STATIC_DRAW);
+    glVertexAttribPointer(0, 3, GL_FLOAT, GL_FALSE, sizeof(glm::vec3), (void*)0);
+    glEnableVertexAttribArray(0);
+    glBindBuffer(GL_ARRAY_BUFFER, 0);
+    glBindVertexArray(0);
 
+    // per-frame CPU work fans out over every core, the main thread helps while it waits
+    rg::JobSystem jobs;
+    jobs.init();
 
-        // sad ih i renderujemo
-        float leftHeadlightVertices[] = {
-            // Front face (two triangles)
-            -0.45f, 0.6f,  -1.5f,  // Bottom left
-            -0.25f, 0.6f,  -1.5f,  // Bottom right
-            -0.45f,  0.8f,  -1.45f,  // Top left
-            -0.25f,  0.8f,  -1.45f,  // Top right
+    // ray queries
+    // -----------
+    // one triangle tree per model and one for the ground, placed once per entity that is not
+    // attached to the truck; the truck's own probes start inside it. Nothing placed here moves,
+    // anything that does would need rayScene.setWorld() and build() again.
+    std::vector<rg::TriangleBvh> modelBvhs(models.size());
+    auto buildModelBvh = [](const Model& model, rg::TriangleBvh& bvh) {
+        std::vector<glm::vec3> positions;
+        std::vector<uint32_t> indices;
+        for (const Mesh& mesh : model.meshes) {
+            const uint32_t base = (uint32_t) positions.size();
+            for (const Vertex& vertex : mesh.vertices) {
+                positions.push_back(vertex.Position);
+            }
+            for (unsigned int index : mesh.indices) {
+                indices.push_back(base + index);
+            }
+        }
+        bvh.build(positions, indices);
+    };
+    rg::TriangleBvh groundBvh;
+    {
+        std::vector<glm::vec3> positions;
+        std::vector<uint32_t> indices;
+        for (size_t i = 0; i < sizeof(groundVertices) / sizeof(float); i += 8) {
+            indices.push_back((uint32_t) positions.size());
+            positions.push_back(glm::vec3(groundVertices[i], groundVertices[i + 1], groundVertices[i + 2]));
+        }
+        groundBvh.build(positions, indices);
+    }
+    rg::SceneBvh rayScene;
+    std::vector<rg::Entity> rayEntities;   // by instance, the ground is the invalid entity
+    scene.each<rg::Renderable>([&](rg::TransformStore& transforms, const rg::Entity* entities, size_t count, rg::Renderable* renderables) {
+        for (uint32_t i = 0; i < count; i++) {
+            rg::TriangleBvh& bvh = modelBvhs[renderables[i].model];
+            if (bvh.empty()) {
+                buildModelBvh(*models[renderables[i].model], bvh);
+            }
+            rayScene.add(bvh, transforms.matrix(i));
+            rayEntities.push_back(entities[i]);
+        }
+    }, rg::EntityWorld::maskOf<rg::Attachment>());
+    rayScene.add(groundBvh, glm::mat4(1.0f));
+    rayEntities.push_back(rg::Entity());
+    rayScene.build();
+    // rays go out in packets of four, a batch bigger than rayGrain is split over the workers
+    const int rayGrain = 256;
+    auto traceRays = [&](const std::vector<rg::Ray>& rays, std::vector<rg::RayHit>& hits) {
+        hits.resize(rays.size());
+        if (rays.size() <= (size_t) rayGrain) {
+            rayScene.intersect(rays.data(), hits.data(), rays.size());
+            return;
+        }
+        rg::JobCounter traced;
+        jobs.parallelFor("trace rays", (int) rays.size(), rayGrain, [&](int begin, int end) {
+            rayScene.intersect(rays.data() + begin, hits.data() + begin, (size_t) (end - begin));
+        }, traced);
+        jobs.wait(traced);
+    };
+    std::vector<rg::Ray> rays;
+    std::vector<rg::RayHit> rayHits;
 
-            // Back face (two triangles)
-            -0.45f, 0.6f,  -1.4f,  // Bottom left
-            -0.25f, 0.6f,  -1.4f,  // Bottom right
-            -0.45f,  0.8f,  -1.35f,  // Top left
-            -0.25f,  0.8f,  -1.35f,  // Top right
+    // render thread
+    // -------------
+    // owns the GL context from here on and draws the packets the loop below fills, one frame
+    // behind it. Everything it touches besides the packet was set up above and is left alone
+    // by the main thread until it is joined.
+    rg::FramePipeline<FramePacket> pipeline;
+    rg::LateLatch<LatchedView> viewLatch;
+    std::mutex renderStatsMutex;
+    RenderStats renderStats;
+    rg::DynamicResolution dynamicResolution;
+    rg::Upscaler upscaler;
+    programState->autoExposure = autoExposure.enabled;
+    programState->exposureCompensation = autoExposure.compensation;
+    programState->adaptationSpeed = autoExposure.adaptationSpeed;
+    // the opengl backend creates its objects on the first new frame, with the context still here
+    ImGui_ImplOpenGL3_NewFrame();
 
-            // Left side face (two triangles)
-            -0.45f, 0.6f,  -1.5f,  // Front bottom left
-            -0.45f, 0.8f,  -1.45f,  // Front top left
-            -0.45f, 0.6f,  -1.4f,  // Back bottom left
-            -0.45f, 0.8f,  -1.35f,  // Back top left
+    auto renderLoop = [&]() {
+        glfwMakeContextCurrent(window);
+        bool firstFrame = true;
+        bool shaderReportPrinted = false;
+        std::unordered_map<GLuint, LitUniforms> litUniforms;   // by program ID, see setLights
+        int shaderSwaps = 0;
+        int swapInterval = 1;
+        const bool tearControl = rg::FramePacer::tearControlSupported();
+        rg::LatencyMeter latency;
+        while (const FramePacket* frame = pipeline.acquire()) {
+            if (firstFrame) {
+                // the first frame draws with every program, whatever is still building is waited
+                // for here and shows up as blocked time in the queue's report
+                shaderQueue.finish();
+            }
 
-            // Right side face (two triangles)
-            -0.25f, 0.6f,  -1.45f,  // Front bottom right
-            -0.25f, 0.8f,  -1.4f,  // Front top right
-            -0.25f, 0.6f,  -1.35f,  // Back bottom right
-            -0.25f, 0.8f,  -1.3f,  // Back top right
+            // settings
+            // --------
+            const float smoothedMs = dynamicResolution.smoothedMs;
+            dynamicResolution = frame->dynamicResolution;
+            dynamicResolution.smoothedMs = smoothedMs;
+            upscaler.preset = frame->upscalePreset;
+            autoExposure.enabled = frame->autoExposure;
+            autoExposure.compensation = frame->exposureCompensation;
+            autoExposure.adaptationSpeed = frame->adaptationSpeed;
+            const int interval = rg::FramePacer::swapInterval(frame->pacing, tearControl);
+            if (interval != swapInterval) {
+                swapInterval = interval;
+                glfwSwapInterval(swapInterval);
+            }
 
-            // Top face (two triangles)
-            -0.45f,  0.8f,  -1.4f,  // Front left
-            -0.25f,  0.8f,  -1.4f,  // Front right
-            -0.45f,  0.8f,  -1.3f,  // Back left
-            -0.25f,  0.8f,  -1.3f,  // Back right
+            // camera, replaced by a newer one if it gets late latched below
+            glm::mat4 view = frame->view;
+            glm::vec3 cameraPosition = frame->cameraPosition;
+            glm::mat4 vehicleShift = glm::mat4(1.0f);   // from the packet's truck frame to the latched one
+            double inputTime = frame->inputTime;
+
+            // resolution
+            // ----------
+            renderTargets.resize(frame->displayWidth, frame->displayHeight);
+            if (frame->requestedScale > 0.0f) {
+                renderTargets.setScale(frame->requestedScale);
+            }
+            float gpuFrameMs = 0.0f;
+            if (gpuTimer.poll(gpuFrameMs)) {
+                renderTargets.setScale(dynamicResolution.update(gpuFrameMs, renderTargets.scale));
+                std::lock_guard<std::mutex> lock(renderStatsMutex);
+                renderStats.gpuFrameMs = gpuFrameMs;
+            }
+            GLuint64 shadedSamples = 0;
+            if (overdrawCounter.poll(shadedSamples)) {
+                std::lock_guard<std::mutex> lock(renderStatsMutex);
+                renderStats.overdraw = (float) shadedSamples / (renderTargets.internalWidth * renderTargets.internalHeight);
+            }
+            const float uvScaleX = renderTargets.uvScaleX();
+            const float uvScaleY = renderTargets.uvScaleY();
+            gpuTimer.begin();
+
+            // instances, the packet's matrices back to back into this frame's region of the
+            // ---------  stream, then every model's instance attributes pointed at its part
+            if (char* mapped = instanceStream.map()) {
+                GLintptr offset = 0;
+                for (const InstanceBatch& batch : frame->instances) {
+                    std::memcpy(mapped + offset, batch.data(), batch.bytes());
+                    offset += batch.bytes();
+                }
+            }
+            instanceStream.unmap();
+            GLintptr instanceOffset = instanceStream.offset();
+            for (const InstanceBatch& batch : frame->instances) {
+                if (batch.count() == 0) {
+                    continue;
+                }
+                models[batch.model]->SetInstanceBuffer(instanceStream.buffer(), instanceOffset, batch.isCompact());
+                instanceOffset += batch.bytes();
+            }
 
-            // Bottom face (two triangles)
-            -0.45f, 0.6f,  -1.5f,  // Front left
-            -0.25f, 0.6f,  -1.5f,  // Front right
-            -0.45f, 0.6f,  -1.4f,  // Back left
-            -0.25f, 0.6f,  -1.4f   // Back right
-        };
+            // render graph
+            // ------------
+            // declared from scratch every frame, toggling bloom, auto exposure or the upscaler only
+            // changes which passes exist; the textures come out of the graph's pool
+            graph.reset();
+            typedef rg::RenderGraph::Resource Resource;
+            typedef rg::RenderGraph::Pass Pass;
+            Resource hdrColor = graph.create("hdrColor", renderTargets.hdr());
+            Resource brightColor = graph.create("brightColor", renderTargets.hdr());
+            Resource sceneDepth = graph.create("sceneDepth", renderTargets.depth());
+            Resource backbuffer = graph.importBackbuffer("backbuffer", renderTargets.displayWidth, renderTargets.displayHeight);
+
+            Pass scenePass = graph.addPass("scene", [&]() {
+                glClearColor(frame->clearColor.r, frame->clearColor.g, frame->clearColor.b, 1.0f);
+                glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
+                // scene goes into the scaled down corner of the targets
+                glViewport(0, 0, renderTargets.internalWidth, renderTargets.internalHeight);
+
+                // light uniforms, uploaded to every lit permutation that gets used this frame
+                // through locations cached per program and light
+                auto setLights = [&](Shader& shader) {
+                    auto found = litUniforms.find(shader.ID);
+                    if (found == litUniforms.end()) {
+                        LitUniforms added;
+                        added.viewPosition = glGetUniformLocation(shader.ID, "viewPosition");
+                        added.shininess = glGetUniformLocation(shader.ID, "material.shininess");
+                        found = litUniforms.insert(std::make_pair(shader.ID, added)).first;
+                    }
+                    LitUniforms& uniforms = found->second;
+                    for (const LightItem& item : frame->lights) {
+                        const rg::Light& light = item.light;
+                        auto cached = uniforms.lights.find(light.uniform);
+                        if (cached == uniforms.lights.end()) {
+                            auto location = [&](const char* member) {
+                                return glGetUniformLocation(shader.ID, (std::string(light.uniform) + "." + member).c_str());
+                            };
+                            const LightUniforms added = {
+                                location("position"), location("direction"), location("cutOff"), location("outerCutOff"),
+                                location("ambient"), location("diffuse"), location("specular"),
+                                location("constant"), location("linear"), location("quadratic")
+                            };
+                            cached = uniforms.lights.insert(std::make_pair(light.uniform, added)).first;
+                        }
+                        const LightUniforms& at = cached->second;
+                        const glm::vec3 position = item.vehicle ? glm::vec3(vehicleShift * glm::vec4(item.position, 1.0f)) : item.position;
+                        glUniform3fv(at.position, 1, &position[0]);
+                        if (light.type == rg::LightSpot) {
+                            const glm::vec3 direction = item.vehicle ? glm::mat3(vehicleShift) * light.direction : light.direction;
+                            glUniform3fv(at.direction, 1, &direction[0]);
+                            glUniform1f(at.cutOff, light.cutOff);
+                            glUniform1f(at.outerCutOff, light.outerCutOff);
+                        }
+                        glUniform3fv(at.ambient, 1, &light.ambient[0]);
+                        glUniform3fv(at.diffuse, 1, &light.diffuse[0]);
+                        glUniform3fv(at.specular, 1, &light.specular[0]);
+                        glUniform1f(at.constant, light.constant);
+                        glUniform1f(at.linear, light.linear);
+                        glUniform1f(at.quadratic, light.quadratic);
+                    }
+
+                    glUniform3fv(uniforms.viewPosition, 1, &cameraPosition[0]);
+
+                    glUniform1f(uniforms.shininess, 32.0f);
+                };
+
+                // opaque geometry, with the pre-pass it goes through twice: depth only, then shaded.
+                // Every object picks its permutation, the per-frame uniforms go to each program once.
+                const unsigned int sceneFeatures = frame->moonlight ? rg::FeatureMoonlight : 0;
+                auto drawOpaque = [&](bool depthOnly) {
+                    std::vector<unsigned int> prepared;
+                    auto bind = [&](unsigned int features) -> Shader& {
+                        // positions only in the pre-pass, the only feature that changes them is instancing
+                        Shader& shader = depthOnly ? depthPrograms.get(features & (rg::FeatureInstanced | rg::FeatureCompactInstance))
+                                                   : litPrograms.get(sceneFeatures | features);
+                        shader.use();
+                        if (std::find(prepared.begin(), prepared.end(), shader.ID) == prepared.end()) {
+                            prepared.push_back(shader.ID);
+                            shader.setMat4("projection", frame->projection);
+                            shader.setMat4("view", view);
+                            if (!depthOnly) {
+                                setLights(shader);
+                            }
+                        }
+                        return shader;
+                    };
+                    auto draw = [&](Model& m, unsigned int features, const glm::mat4& model) {
+                        Shader& shader = bind(features);
+                        shader.setMat4("model", model);
+                        if (depthOnly) {
+                            m.DrawDepth();
+                        } else {
+                            m.Draw(shader);
+                        }
+                    };
+
+                    for (const DrawItem& item : frame->drawItems) {
+                        if (item.flags & rg::RenderCullFace) {
+                            glEnable(GL_CULL_FACE);
+                        }
+                        draw(*models[item.model], item.features, item.vehicle ? vehicleShift * item.world : item.world);
+                        if (item.flags & rg::RenderCullFace) {
+                            glDisable(GL_CULL_FACE);
+                        }
+                    }
+
+                    // wottotachi, every model's instances in one draw
+                    for (const InstanceBatch& batch : frame->instances) {
+                        if (batch.count() == 0) {
+                            continue;
+                        }
+                        Shader& instancedShader = bind(batch.features | rg::FeatureInstanced);
+                        if (depthOnly) {
+                            models[batch.model]->DrawDepthInstanced((int) batch.count());
+                        } else {
+                            models[batch.model]->DrawInstanced(instancedShader, (int) batch.count());
+                        }
+                    }
+
+                    // ground
+                    Shader& shader = bind(0);
+                    shader.setMat4("model", glm::mat4(1.0f));
+
+                    glActiveTexture(GL_TEXTURE0);
+                    glBindTexture(GL_TEXTURE_2D, groundTextureID);
+                    shader.setInt("texture1", 0);
+
+                    glActiveTexture(GL_TEXTURE1);
+                    glBindTexture(GL_TEXTURE_2D, groundDiffuseTextureID);
+                    shader.setInt("texture_diffuse1", 1);
+
+                    glBindVertexArray(groundVAO);
+                    glDrawArrays(GL_TRIANGLES, 0, 6);
+                };
+
+                if (frame->depthPrepass) {
+                    // depth only, so the lighting shader below runs once per visible pixel
+                    glColorMask(GL_FALSE, GL_FALSE, GL_FALSE, GL_FALSE);
+                    drawOpaque(true);
+                    glColorMask(GL_TRUE, GL_TRUE, GL_TRUE, GL_TRUE);
+                }
+
+                // farovi
+                windshieldShader.use();
+                windshieldShader.setMat4("projection", frame->projection);
+                windshieldShader.setMat4("view", view);
+                windshieldShader.setMat4("model", vehicleShift * frame->headlightBoxes);
+                windshieldShader.setVec4("windshieldColor", glm::vec4(5.0f));
+                for (unsigned int headlightVAO : headlightVAOs) {
+                    glBindVertexArray(headlightVAO);
+                    glDrawArrays(GL_TRIANGLE_STRIP, 0, 4);   // Front face
+                    glDrawArrays(GL_TRIANGLE_STRIP, 4, 4);   // Back face
+                    glDrawArrays(GL_TRIANGLE_STRIP, 8, 4);   // Left side
+                    glDrawArrays(GL_TRIANGLE_STRIP, 12, 4);  // Right side
+                    glDrawArrays(GL_TRIANGLE_STRIP, 16, 4);  // Top face
+                    glDrawArrays(GL_TRIANGLE_STRIP, 20, 4);  // Bottom face
+                }
+
+                if (frame->depthPrepass) {
+                    glDepthFunc(GL_EQUAL);
+                    glDepthMask(GL_FALSE);
+                }
+                // only the lit opaque draws count, skybox, headlights and windshield are not overdraw
+                overdrawCounter.begin();
+                drawOpaque(false);
+                overdrawCounter.end();
+                glDepthFunc(GL_LESS);
+                glDepthMask(GL_TRUE);
+
+                // draw skybox
+                // last, it sits on the far plane and only fills what the scene left at the cleared depth
+                glDepthFunc(GL_LEQUAL);  // change depth function so depth test passes when values are equal to depth buffer's content
+                glDepthMask(GL_FALSE);
+                skyboxShader.use();
+                glm::mat4 skyboxView = glm::mat4(glm::mat3(view)); // remove translation from the view matrix
+                skyboxShader.setMat4("view", skyboxView);
+                skyboxShader.setMat4("projection", frame->projection);
+                // skybox cube
+                glBindVertexArray(skyboxVAO);
+                glActiveTexture(GL_TEXTURE0);
+                glBindTexture(GL_TEXTURE_CUBE_MAP, cubemapTexture);
+                glDrawArrays(GL_TRIANGLES, 0, 36);
+                glBindVertexArray(0);
+                glDepthMask(GL_TRUE);
+                glDepthFunc(GL_LESS); // set depth function back to default
+
+                // sofersajbna
+                glEnable(GL_BLEND);
+                glBlendFunc(GL_SRC_ALPHA, GL_ONE_MINUS_SRC_ALPHA);
+
+                windshieldShader.use();
+                windshieldShader.setMat4("projection", frame->projection);
+                windshieldShader.setMat4("view", view);
+                windshieldShader.setMat4("model", vehicleShift * frame->windshield);
+                windshieldShader.setVec4("windshieldColor", glm::vec4(0.7f, 0.7f, 0.9f, 0.1f));
+
+                glBindVertexArray(windshieldVAO);
+                glDrawArrays(GL_TRIANGLE_FAN, 0, 4);
+                glBindVertexArray(0);
+
+                glDisable(GL_BLEND);
+            });
+            graph.write(scenePass, hdrColor);
+            graph.write(scenePass, brightColor);
+            graph.write(scenePass, sceneDepth);
+
+            // bloom: every blur direction is its own pass into a new virtual texture,
+            // the graph ping-pongs them over the same couple of physical ones
+            const unsigned int blurAmount = 10;
+            Resource bloomBlur = brightColor;
+            for (unsigned int i = 0; i < blurAmount; i++) {
+                const bool horizontal = i % 2 == 0;
+                const Resource source = bloomBlur;
+                bloomBlur = graph.create("bloomBlur" + std::to_string(i), renderTargets.hdr());
+                Pass blurPass = graph.addPass("blur" + std::to_string(i), [&, horizontal, source]() {
+                    glViewport(0, 0, renderTargets.internalWidth, renderTargets.internalHeight);
+                    blurShader.use();
+                    blurShader.setVec2("uvScale", uvScaleX, uvScaleY);
+                    blurShader.setVec2("uvMax", uvScaleX - 0.5f / renderTargets.displayWidth, uvScaleY - 0.5f / renderTargets.displayHeight);
+                    blurShader.setBool("horizontal", horizontal);
+                    glActiveTexture(GL_TEXTURE0);
+                    glBindTexture(GL_TEXTURE_2D, graph.texture(source));
+                    renderQuad();
+                });
+                graph.read(blurPass, source);
+                graph.write(blurPass, bloomBlur);
+            }
 
-        float rightHeadlightVertices[] = {
-            // Front face (two triangles)
-            0.45f, 0.6f,  -1.5f,  // Bottom left
-            0.25f, 0.6f,  -1.5f,  // Bottom right
-            0.45f,  0.8f,  -1.45f,  // Top left
-            0.25f,  0.8f,  -1.45f,  // Top right
-
-            // Back face (two triangles)
-            0.45f, 0.6f,  -1.4f,  // Bottom left
-            0.25f, 0.6f,  -1.4f,  // Bottom right
-            0.45f,  0.8f,  -1.35f,  // Top left
-            0.25f,  0.8f,  -1.35f,  // Top right
-
-            // Left side face (two triangles)
-            0.45f, 0.6f,  -1.5f,  // Front bottom left
-            0.45f, 0.8f,  -1.45f,  // Front top left
-            0.45f, 0.6f,  -1.4f,  // Back bottom left
-            0.45f, 0.8f,  -1.35f,  // Back top left
-
-            // Right side face (two triangles)
-            0.25f, 0.6f,  -1.45f,  // Front bottom right
-            0.25f, 0.8f,  -1.4f,  // Front top right
-            0.25f, 0.6f,  -1.35f,  // Back bottom right
-            0.25f, 0.8f,  -1.3f,  // Back top right
-
-            // Top face (two triangles)
-            0.45f,  0.8f,  -1.4f,  // Front left
-            0.25f,  0.8f,  -1.4f,  // Front right
-            0.45f,  0.8f,  -1.3f,  // Back left
-            0.25f,  0.8f,  -1.3f,  // Back right
-
-            // Bottom face (two triangles)
-            0.45f, 0.6f,  -1.5f,  // Front left
-            0.25f, 0.6f,  -1.5f,  // Front right
-            0.45f, 0.6f,  -1.4f,  // Back left
-            0.25f, 0.6f,  -1.4f   // Back right
-        };
+            // auto exposure
+            // -------------
+            Resource exposureTexture = -1;
+            if (autoExposure.enabled) {
+                const float logRange = autoExposure.maxLogLuminance - autoExposure.minLogLuminance;
+                const Resource histogram = graph.create("luminanceHistogram", rg::AutoExposure::histogramDesc());
+                const Resource previousExposure = graph.import("previousExposure", autoExposure.swap(), rg::AutoExposure::exposureDesc());
+                exposureTexture = graph.import("exposure", autoExposure.exposureTexture(), rg::AutoExposure::exposureDesc());
+
+                Pass histogramPass = graph.addPass("histogram", [&, logRange]() {
+                    histogramShader.use();
+                    histogramShader.setVec2("uvScale", uvScaleX, uvScaleY);
+                    histogramShader.setFloat("minLogLuminance", autoExposure.minLogLuminance);
+                    histogramShader.setFloat("logLuminanceRange", logRange);
+                    glActiveTexture(GL_TEXTURE0);
+                    glBindTexture(GL_TEXTURE_2D, graph.texture(hdrColor));
+                    autoExposure.buildHistogram();
+                });
+                graph.read(histogramPass, hdrColor);
+                graph.write(histogramPass, histogram);
+
+                Pass exposurePass = graph.addPass("exposure", [&, logRange, histogram, previousExposure]() {
+                    exposureShader.use();
+                    exposureShader.setFloat("minLogLuminance", autoExposure.minLogLuminance);
+                    exposureShader.setFloat("logLuminanceRange", logRange);
+                    exposureShader.setFloat("lowPercent", autoExposure.lowPercent);
+                    exposureShader.setFloat("highPercent", autoExposure.highPercent);
+                    exposureShader.setFloat("compensation", autoExposure.compensation);
+                    exposureShader.setFloat("adaptationSpeed", autoExposure.adaptationSpeed);
+                    exposureShader.setFloat("deltaTime", frame->deltaTime);
+                    glActiveTexture(GL_TEXTURE0);
+                    glBindTexture(GL_TEXTURE_2D, graph.texture(histogram));
+                    glActiveTexture(GL_TEXTURE1);
+                    glBindTexture(GL_TEXTURE_2D, graph.texture(previousExposure));
+                    renderQuad();
+                    autoExposure.readback();
+                });
+                graph.read(exposurePass, histogram);
+                graph.read(exposurePass, previousExposure);
+                graph.write(exposurePass, exposureTexture);
+            }
 
-        glm::mat4 headlightPhysical = glm::mat4(1.0f);
-        headlightPhysical = glm::rotate(headlightPhysical, -truckRotOffsetZ, glm::vec3(0, 0, 1));
-        headlightPhysical = glm::rotate(headlightPhysical, -truckRotOffsetX, glm::vec3(1, 0, 0));
-        headlightPhysical = glm::scale(headlightPhysical, glm::vec3(10.0f));
-        headlightPhysical = truckModel * headlightPhysical;
+            // tone mapping, straight into the backbuffer or at internal resolution for the upscaler
+            Resource ldrScene = upscaler.enabled() ? graph.create("ldrScene", renderTargets.ldr()) : backbuffer;
+            Pass tonemapPass = graph.addPass("tonemap", [&]() {
+                if (upscaler.enabled()) {
+                    glViewport(0, 0, renderTargets.internalWidth, renderTargets.internalHeight);
+                } else {
+                    // upscale into the backbuffer, bilinear filtering of the hdr target does the work
+                    glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
+                }
+                bloomFinalShader.use();
+                bloomFinalShader.setVec2("uvScale", uvScaleX, uvScaleY);
+                glActiveTexture(GL_TEXTURE0);
+                glBindTexture(GL_TEXTURE_2D, graph.texture(hdrColor));
+                glActiveTexture(GL_TEXTURE1);
+                glBindTexture(GL_TEXTURE_2D, frame->bloom ? graph.texture(bloomBlur) : 0);
+                glActiveTexture(GL_TEXTURE2);
+                glBindTexture(GL_TEXTURE_2D, autoExposure.enabled ? graph.texture(exposureTexture) : 0);
+                bloomFinalShader.setBool("bloom", frame->bloom);
+                bloomFinalShader.setFloat("exposure", frame->exposure);
+                bloomFinalShader.setBool("autoExposure", autoExposure.enabled);
+                renderQuad();
+            });
+            graph.read(tonemapPass, hdrColor);
+            if (frame->bloom) {
+                graph.read(tonemapPass, bloomBlur);
+            }
+            if (autoExposure.enabled) {
+                graph.read(tonemapPass, exposureTexture);
+            }
+            graph.write(tonemapPass, ldrScene);
+
+            if (upscaler.enabled()) {
+                const Resource upscaled = graph.create("upscaled", renderTargets.ldr());
+                Pass upscalePass = graph.addPass("upscale", [&, ldrScene]() {
+                    upscaleShader.use();
+                    upscaleShader.setVec2("inputSize", (float) renderTargets.internalWidth, (float) renderTargets.internalHeight);
+                    upscaleShader.setVec2("outputSize", (float) renderTargets.displayWidth, (float) renderTargets.displayHeight);
+                    glActiveTexture(GL_TEXTURE0);
+                    glBindTexture(GL_TEXTURE_2D, graph.texture(ldrScene));
+                    renderQuad();
+                });
+                graph.read(upscalePass, ldrScene);
+                graph.write(upscalePass, upscaled);
+
+                Pass sharpenPass = graph.addPass("sharpen", [&, upscaled]() {
+                    sharpenShader.use();
+                    sharpenShader.setFloat("sharpness", upscaler.settings().sharpness);
+                    glActiveTexture(GL_TEXTURE0);
+                    glBindTexture(GL_TEXTURE_2D, graph.texture(upscaled));
+                    renderQuad();
+                });
+                graph.read(sharpenPass, upscaled);
+                graph.write(sharpenPass, backbuffer);
+            }
 
-        windshieldShader.use();
-        windshieldShader.setMat4("projection", projection);
-        windshieldShader.setMat4("view", view);
-        windshieldShader.setMat4("model", headlightPhysical);
-        windshieldShader.setVec4("windshieldColor", glm::vec4(5.0f));
+            graph.compile();
+
+            // late latching
+            // -------------
+            // by now the game thread has usually sampled input for the next frame, the camera and
+            // everything on the truck are drawn from that. The rest of the scene does not depend on
+            // input, culling was done for the packet's view and is off by at most a frame of motion.
+            LatchedView latched;
+            const bool lateLatched = frame->lateLatch && viewLatch.latest(frame->latchSequence, latched);
+            if (lateLatched) {
+                view = latched.view;
+                cameraPosition = latched.cameraPosition;
+                vehicleShift = latched.vehicle * glm::inverse(frame->vehicle);
+                inputTime = latched.inputTime;
+            }
+            graph.execute();
+            instanceStream.endFrame();
+            gpuTimer.end();
 
-        unsigned int VAO, VBO;
-        glGenVertexArrays(1, &VAO);
-        glGenBuffers(1, &VBO);
+            if (ImDrawData* drawData = frame->imgui.drawData()) {
+                ImGui_ImplOpenGL3_RenderDrawData(drawData);
+            }
+            // everything is submitted, the game thread can refill the packet while swap blocks
+            pipeline.release();
+
+            // glfw: swap buffers
+            // ------------------
+            glfwSwapBuffers(window);
+            latency.record(inputTime, glfwGetTime());
+
+            shaderQueue.poll();
+            if (!shaderReportPrinted && shaderQueue.idle()) {
+                shaderReportPrinted = true;
+                shaderQueue.report();
+            }
+            shaderReloader.poll();
+            if (shaderReloader.swaps() != shaderSwaps) {
+                // reloaded programs have new IDs and deleted ones may be reused
+                shaderSwaps = shaderReloader.swaps();
+                litUniforms.clear();
+            }
+            if (firstFrame) {
+                firstFrame = false;
+                const rg::ProgramBinaryCache& cache = rg::programBinaryCache();
+                std::cout << "[Startup] first frame after " << (int) (glfwGetTime() * 1000.0) << " ms, program binaries: ";
+                if (cache.enabled()) {
+                    std::cout << cache.hits << " loaded, " << cache.misses + cache.rejected << " compiled ("
+                              << cache.rejected << " rejected)" << std::endl;
+                } else {
+                    std::cout << "not supported by the driver" << std::endl;
+                }
+            }
 
-        glBindVertexArray(VAO);
+            std::lock_guard<std::mutex> lock(renderStatsMutex);
+            renderStats.smoothedMs = dynamicResolution.smoothedMs;
+            renderStats.exposure = autoExposure.lastExposure;
+            renderStats.internalWidth = renderTargets.internalWidth;
+            renderStats.internalHeight = renderTargets.internalHeight;
+            renderStats.displayWidth = renderTargets.displayWidth;
+            renderStats.displayHeight = renderTargets.displayHeight;
+            renderStats.scale = renderTargets.scale;
+            renderStats.tearControl = tearControl;
+            renderStats.persistentStream = instanceStream.persistent();
+            renderStats.streamWaitMs = instanceStream.waitMs();
+            renderStats.latencyMs = latency.lastMs();
+            renderStats.latencyAverageMs = latency.averageMs();
+            renderStats.latencyMaxMs = latency.maxMs();
+            renderStats.lateLatched = lateLatched;
+            renderStats.report = graph.report();
+            renderStats.passes = graph.passes();
+        }
+        glfwMakeContextCurrent(NULL);
+    };
+    glfwMakeContextCurrent(NULL);
+    std::thread renderThread(renderLoop);
+
+    // simulation
+    // ----------
+    // runs at a fixed rate whatever the frame rate is, so driving behaves the same with or without vsync
+    rg::FixedTimestep simulationClock(120.0);
+    programState->simulationHz = (int) simulationClock.hz();
+    programState->drivingCameraPrevious = programState->drivingCamera.Position;
+    auto simulationStep = [&](float dt) {
+        // the state this step starts from is what rendering blends from
+        scene.each<rg::Motion>([&](rg::TransformStore& transforms, const rg::Entity*, size_t count, rg::Motion* motion) {
+            for (size_t i = 0; i < count; i++) {
+                motion[i].previousPosition = transforms.position((uint32_t) i);
+                motion[i].previousRotation = transforms.rotation((uint32_t) i);
+            }
+        });
+        programState->drivingCameraPrevious = programState->drivingCamera.Position;
+
+        if (programState->isDrivingMode) {
+            const glm::vec3 truckMovement = simulateTruck(scene, programState->truck, readDriveInput(window), truckBodyForward, dt);
+            const double collisionStart = glfwGetTime();
+            const TruckContacts contacts = collideTruck(scene, programState->truck, crowdCollisions);
+            programState->collisionMs = (float) ((glfwGetTime() - collisionStart) * 1000.0);
+            programState->crowdHits += contacts.crowdStarted;
+            programState->crowdTouching = contacts.crowdTouching;
+            programState->wallContact = contacts.solid;
+            programState->drivingCamera.Position += truckMovement + contacts.pushed;
+
+            // cam
+            glm::vec3 targetPosition = glm::vec3(scene.matrix(programState->truck) * attachments.local(cameraMount)[3]);
+            programState->drivingCamera.Position = glm::mix(programState->drivingCamera.Position, targetPosition, 0.3f);
+        }
+    };
+    // vehicle frame between the last two simulated states
+    auto interpolatedMatrix = [&](rg::Entity entity, float alpha) {
+        const rg::Motion& motion = scene.get<rg::Motion>(entity);
+        rg::TransformStore::Handle row;
+        const rg::TransformStore& transforms = scene.transforms(entity, row);
+        glm::mat4 matrix = glm::translate(glm::mat4(1.0f), glm::mix(motion.previousPosition, transforms.position(row), alpha));
+        matrix = matrix * glm::mat4_cast(glm::slerp(motion.previousRotation, transforms.rotation(row), alpha));
+        return glm::scale(matrix, transforms.scale(row));
+    };
 
-        glBindBuffer(GL_ARRAY_BUFFER, VBO);
-        glBufferData(GL_ARRAY_BUFFER, sizeof(leftHeadlightVertices), leftHeadlightVertices, GL_STATIC_DRAW);
+    // game loop
+    // ---------
+    glm::mat4 lastView = glm::mat4(0.0f);
+    glm::mat4 lastVehicleFrame = glm::mat4(0.0f);
+    while (!glfwWindowShouldClose(window)) {
+        // pacing
+        // ------
+        // a still scene or a window in the background gets fewer frames, a minimized one none.
+        // The frame cap and the wait for a free packet come before input is sampled, so the
+        // input does not age while the game thread waits
+        programState->powerSaver.wait(window);
+        programState->pacer.waitForFrame();
+        FramePacket& frame = pipeline.beginWrite();
+
+        // poll IO events (keys pressed/released, mouse moved etc.)
+        glfwPollEvents();
+        const double inputTime = glfwGetTime();
 
-        glVertexAttribPointer(0, 3, GL_FLOAT, GL_FALSE, 3 * sizeof(float), (void*)0);
-        glEnableVertexAttribArray(0);
+        // per-frame time logic
+        // --------------------
+        float currentFrame = glfwGetTime();
+        deltaTime = currentFrame - lastFrame;
+        lastFrame = currentFrame;
 
-        glBindVertexArray(0);
-
-        glBindVertexArray(VAO);
-
-        glDrawArrays(GL_TRIANGLE_STRIP, 0, 4);   // Front face
-        glDrawArrays(GL_TRIANGLE_STRIP, 4, 4);   // Back face
-        glDrawArrays(GL_TRIANGLE_STRIP, 8, 4);   // Left side
-        glDrawArrays(GL_TRIANGLE_STRIP, 12, 4);  // Right side
-        glDrawArrays(GL_TRIANGLE_STRIP, 16, 4);  // Top face
-        glDrawArrays(GL_TRIANGLE_STRIP, 20, 4);  // Bottom face
-
-        glBufferData(GL_ARRAY_BUFFER, sizeof(rightHeadlightVertices), rightHeadlightVertices, GL_STATIC_DRAW);
-
-        glDrawArrays(GL_TRIANGLE_STRIP, 0, 4);   // Front face
-        glDrawArrays(GL_TRIANGLE_STRIP, 4, 4);   // Back face
-        glDrawArrays(GL_TRIANGLE_STRIP, 8, 4);   // Left side
-        glDrawArrays(GL_TRIANGLE_STRIP, 12, 4);  // Right side
-        glDrawArrays(GL_TRIANGLE_STRIP, 16, 4);  // Top face
-        glDrawArrays(GL_TRIANGLE_STRIP, 20, 4);  // Bottom face
-
-        ourShader.use();
-        ourShader.setVec3("leftHeadlight.position", leftHeadlight.position);
-        ourShader.setVec3("leftHeadlight.direction", leftHeadlight.direction);
-        ourShader.setVec3("leftHeadlight.ambient", leftHeadlight.ambient);
-        ourShader.setVec3("leftHeadlight.diffuse", leftHeadlight.diffuse);
-        ourShader.setVec3("leftHeadlight.specular", leftHeadlight.specular);
-        ourShader.setFloat("leftHeadlight.constant", leftHeadlight.constant);
-        ourShader.setFloat("leftHeadlight.linear", leftHeadlight.linear);
-        ourShader.setFloat("leftHeadlight.quadratic", leftHeadlight.quadratic);
-        ourShader.setFloat("leftHeadlight.cutOff", leftHeadlight.cutOff);
-        ourShader.setFloat("leftHeadlight.outerCutOff", leftHeadlight.outerCutOff);
-
-        ourShader.setVec3("rightHeadlight.position", rightHeadlight.position);
-        ourShader.setVec3("rightHeadlight.direction", rightHeadlight.direction);
-        ourShader.setVec3("rightHeadlight.ambient", rightHeadlight.ambient);
-        ourShader.setVec3("rightHeadlight.diffuse", rightHeadlight.diffuse);
-        ourShader.setVec3("rightHeadlight.specular", rightHeadlight.specular);
-        ourShader.setFloat("rightHeadlight.constant", rightHeadlight.constant);
-        ourShader.setFloat("rightHeadlight.linear", rightHeadlight.linear);
-        ourShader.setFloat("rightHeadlight.quadratic", rightHeadlight.quadratic);
-        ourShader.setFloat("rightHeadlight.cutOff", rightHeadlight.cutOff);
-        ourShader.setFloat("rightHeadlight.outerCutOff", rightHeadlight.outerCutOff);
-
-        // ovo treba i za farove da vratim ovde lmao (sem pozicije i smera)
-        ourShader.setVec3("tempSvetlo.position", tempSvetlo.position);
-        ourShader.setVec3("tempSvetlo.ambient", tempSvetlo.ambient);
-        ourShader.setVec3("tempSvetlo.diffuse", tempSvetlo.diffuse);
-        ourShader.setVec3("tempSvetlo.specular", tempSvetlo.specular);
-        ourShader.setFloat("tempSvetlo.constant", tempSvetlo.constant);
-        ourShader.setFloat("tempSvetlo.linear", tempSvetlo.linear);
-        ourShader.setFloat("tempSvetlo.quadratic", tempSvetlo.quadratic);
-
-        ourShader.setVec3("viewPosition", activeCamera.Position);
-
-        ourShader.setFloat("material.shininess", 32.0f);
-
-        glEnable(GL_CULL_FACE);
-
-        // wall
-        glm::mat4 model = glm::mat4(1.0f);
-        model = glm::translate(model, glm::vec3(0.0f, 0.0f, -2.5f));
-        model = glm::scale(model, glm::vec3(0.01));
-        model = glm::rotate(model, -3.14f*0.5f, glm::vec3(1, 0, 0));
-
-        ourShader.setMat4("model", model);
-        wall.Draw(ourShader);
-
-        glDisable(GL_CULL_FACE);
-
-        // ground
-        ourShader.setMat4("model", glm::mat4(1.0f));
-
-        glActiveTexture(GL_TEXTURE0);
-        glBindTexture(GL_TEXTURE_2D, groundTextureID);
-        ourShader.setInt("texture1", 0);
-
-        glActiveTexture(GL_TEXTURE1);
-        glBindTexture(GL_TEXTURE_2D, groundDiffuseTextureID);
-        ourShader.setInt("texture_diffuse1", 1);
-
-        glBindVertexArray(groundVAO);
-        glDrawArrays(GL_TRIANGLES, 0, 6);
-
-        // sofersajbna
-        std::vector<glm::vec3> windshieldVertices = {
-                glm::vec3(-0.35f, 0.9f, -1.35f),  // dole levo
-                glm::vec3(0.3f, 0.9f, -1.35f),   // dole desno
-                glm::vec3(0.3f, 1.35f, -1.2f),  // gore desno
-                glm::vec3(-0.35f, 1.35f, -1.2f)  // gore levo
-        };
+        // input
+        // -----
+        processInput(window);
 
-        unsigned int windshieldVAO, windshieldVBO;
-        glGenVertexArrays(1, &windshieldVAO);
-        glGenBuffers(1, &windshieldVBO);
-        glBindVertexArray(windshieldVAO);
-        glBindBuffer(GL_ARRAY_BUFFER, windshieldVBO);
-        glBufferData(GL_ARRAY_BUFFER, windshieldVertices.size() * sizeof(glm::vec3), &windshieldVertices[0], GL_STATIC_DRAW);
-        glVertexAttribPointer(0, 3, GL_FLOAT, GL_FALSE, sizeof(glm::vec3), (void*)0);
-        glEnableVertexAttribArray(0);
-        glBindBuffer(GL_ARRAY_BUFFER, 0);
-        glBindVertexArray(0);
+        // simulation
+        // ----------
+        // fixed steps, as many as the frame took; the frame is rendered between the last two states
+        const int steps = simulationClock.advance(deltaTime);
+        for (int step = 0; step < steps; step++) {
+            simulationStep(simulationClock.stepSeconds());
+        }
+        programState->simulationSteps = simulationClock.lastSteps();
+        const float alpha = simulationClock.alpha();
+
+        // scene systems
+        // -------------
+        // the interpolated vehicle frame drives the attachment hierarchy
+        attachments.setLocal(truckFrame, interpolatedMatrix(programState->truck, alpha));
+        attachments.update();
+        programState->transformsUpdated = attachments.lastUpdated();
+        const glm::vec3 truckForward = glm::normalize(glm::vec3(attachments.world(truckBody) * glm::vec4(1.0f, 0.0f, 0.0f, 0.0f)));
+
+        // neighbours come from the instance grids
+        const glm::vec3 truckPosition = scene.position(programState->truck);
+        programState->nearestInstance = -1.0f;
+        for (const auto& entry : instanceGrids) {
+            for (const rg::SpatialGrid::Item& item : entry.second.nearest(truckPosition, 1)) {
+                const float distance = glm::length(item.center - truckPosition);
+                if (programState->nearestInstance < 0.0f || distance < programState->nearestInstance) {
+                    programState->nearestInstance = distance;
+                }
+            }
+        }
 
-        glEnable(GL_BLEND);
-        glBlendFunc(GL_SRC_ALPHA, GL_ONE_MINUS_SRC_ALPHA);
+        // farovi, attached lights follow their node, spot lights look a bit down the road
+        const glm::mat4 headlightTilt = glm::rotate(glm::mat4(1.0f), -0.3f, glm::vec3(1.0f, 0.0f, 0.0f));
+        scene.each<rg::Light, rg::Attachment>([&](rg::TransformStore& transforms, const rg::Entity*, size_t count, rg::Light* lights, rg::Attachment* attached) {
+            for (size_t i = 0; i < count; i++) {
+                transforms.setPosition((uint32_t) i, glm::vec3(attachments.world(attached[i].node) * glm::vec4(attached[i].offset, 1.0f)));
+                if (lights[i].type == rg::LightSpot) {
+                    lights[i].direction = glm::normalize(glm::vec3(headlightTilt * glm::vec4(truckForward, 0.0f)));
+                }
+            }
+        });
+
+        // cam, the follow itself is simulated
+        Camera activeCamera = programState->isDrivingMode ? programState->drivingCamera : programState->worldCamera;
+        if (programState->isDrivingMode) {
+            activeCamera.Position = glm::mix(programState->drivingCameraPrevious, programState->drivingCamera.Position, alpha);
+            activeCamera.Front = truckForward;
+            activeCamera.Up = glm::vec3(0, 1, 0);
+        }
 
-        glm::mat4 windshieldModel = glm::mat4(1.0f);
-        windshieldModel = glm::rotate(windshieldModel, -truckRotOffsetZ, glm::vec3(0, 0, 1));
-        windshieldModel = glm::rotate(windshieldModel, -truckRotOffsetX, glm::vec3(1, 0, 0));
-        windshieldModel = glm::scale(windshieldModel, glm::vec3(10.0f));
-        windshieldModel = truckModel * windshieldModel;
+        // view/projection transformations
+        const float aspect = (float) std::max(1, programState->framebufferWidth) / (float) std::max(1, programState->framebufferHeight);
+        const glm::mat4 projection = glm::perspective(glm::radians(activeCamera.Zoom), aspect, 0.2f, 100.0f);
+        const glm::mat4 view = activeCamera.GetViewMatrix();
+        // the render thread may still be submitting the previous frame and picks this up if so
+        const glm::mat4 vehicleFrame = attachments.world(truckFrame);
+        const uint64_t latchSequence = viewLatch.publish({ view, activeCamera.Position, vehicleFrame, inputTime });
+        // anything that moved keeps the frame rate up, input is reported by the callbacks
+        programState->powerSaver.update(inputTime, view != lastView || vehicleFrame != lastVehicleFrame);
+        lastView = view;
+        lastVehicleFrame = vehicleFrame;
+
+        // jobs
+        // ----
+        // culling runs on the workers while the packet is filled
+        jobs.beginFrame();
+        const rg::Frustum frustum = rg::Frustum::fromMatrix(projection * view);
+        // batches keep their visible lists between frames, so the capacity is reused
+        size_t batchCount = 0;
+        scene.each<rg::Renderable, rg::Bounds, rg::Instanced>([&](rg::TransformStore& transforms, const rg::Entity*, size_t count,
+                                                                  rg::Renderable* renderables, rg::Bounds* bounds, rg::Instanced* instanced) {
+            const rg::SpatialGrid& grid = instanceGrid(transforms, bounds, count);
+            for (size_t begin = 0; begin < grid.cellCount(); begin += cullCells) {
+                if (batchCount == cullBatches.size()) {
+                    cullBatches.emplace_back();
+                }
+                CullBatch& batch = cullBatches[batchCount++];
+                batch.transforms = &transforms;
+                batch.renderables = renderables;
+                batch.instanced = instanced;
+                batch.grid = &grid;
+                batch.begin = begin;
+                batch.end = std::min(begin + cullCells, grid.cellCount());
+            }
+        });
+        cullBatches.resize(batchCount);
+        rg::JobCounter instancesCulled;
+        jobs.parallelFor("cull instances", (int) cullBatches.size(), 1, [&](int begin, int end) {
+            for (int b = begin; b < end; b++) {
+                CullBatch& batch = cullBatches[b];
+                batch.visible.clear();
+                batch.grid->queryFrustum(frustum, batch.begin, batch.end, [&](const rg::SpatialGrid::Item& item) {
+                    batch.visible.push_back(item.id);
+                });
+                std::sort(batch.visible.begin(), batch.visible.end(), [&](uint32_t a, uint32_t b) {
+                    return batch.renderables[a].model < batch.renderables[b].model;
+                });
+            }
+        }, instancesCulled);
+
+        // ray queries
+        // -----------
+        // traced here while the workers cull: the ground under each wheel, how far down the road
+        // each headlight reaches and, in free roam, what was clicked
+        rays.clear();
+        const rg::Collider& truckBox = scene.get<rg::Collider>(programState->truck);
+        for (int wheel = 0; wheel < 4; wheel++) {
+            // from the middle of the truck's height at each corner, to a bit below its bottom
+            const glm::vec3 corner = truckBox.center + truckBox.halfExtents * glm::vec3(wheel & 1 ? 1.0f : -1.0f, 0.0f, wheel & 2 ? 1.0f : -1.0f);
+            rays.push_back({ glm::vec3(vehicleFrame * glm::vec4(corner, 1.0f)), glm::vec3(0.0f, -1.0f, 0.0f), truckBox.halfExtents.y + 1.0f });
+        }
+        const float headlightRange = 30.0f;
+        scene.each<rg::Light>([&](rg::TransformStore& transforms, const rg::Entity*, size_t count, rg::Light* lights) {
+            for (uint32_t i = 0; i < count; i++) {
+                if (lights[i].type == rg::LightSpot) {
+                    rays.push_back({ transforms.position(i), lights[i].direction, headlightRange });
+                }
+            }
+        });
+        const size_t headlightRays = rays.size() - 4;
+        const bool picking = programState->pickRequested && !programState->isDrivingMode;
+        programState->pickRequested = false;
+        if (picking) {
+            // from the near plane to the far plane under the cursor
+            const glm::mat4 unproject = glm::inverse(projection * view);
+            const glm::vec2 ndc(programState->pickPoint.x * 2.0f - 1.0f, 1.0f - programState->pickPoint.y * 2.0f);
+            const glm::vec4 nearPoint = unproject * glm::vec4(ndc, -1.0f, 1.0f);
+            const glm::vec4 farPoint = unproject * glm::vec4(ndc, 1.0f, 1.0f);
+            const glm::vec3 origin = glm::vec3(nearPoint) / nearPoint.w;
+            rays.push_back({ origin, glm::vec3(farPoint) / farPoint.w - origin, 1.0f });
+        }
+        const double rayStart = glfwGetTime();
+        traceRays(rays, rayHits);
+        programState->rayMs = (float) ((glfwGetTime() - rayStart) * 1000.0);
+        programState->raysTraced = (int) rays.size();
+        for (int wheel = 0; wheel < 4; wheel++) {
+            programState->wheelGround[wheel] = rayHits[wheel].hit() ? rays[wheel].origin.y - rayHits[wheel].t : -1.0f;
+        }
+        for (size_t light = 0; light < std::min<size_t>(2, headlightRays); light++) {
+            programState->headlightReach[light] = rayHits[4 + light].t * glm::length(rays[4 + light].direction);
+        }
+        if (picking) {
+            const rg::RayHit& hit = rayHits.back();
+            programState->picked = nullptr;
+            if (hit.hit()) {
+                const rg::Entity entity = rayEntities[hit.instance];
+                programState->picked = entity == rg::Entity() ? "ground" : modelNames[scene.get<rg::Renderable>(entity).model];
+                programState->pickedDistance = hit.t * glm::length(rays.back().direction);
+            }
+        }
 
-        // cam
-        if (programState -> isDrivingMode)  {
-            glm::mat4 steeringRotation = glm::rotate(glm::mat4(1.0f), programState->currentTruckSteer, glm::vec3(0, 1, 0));
-            glm::vec3 targetPosition = programState->truckPosition + glm::vec3(steeringRotation * glm::vec4(0.0f, 1.1f, -0.8f, 1.0f));
+        // frame packet
+        // ------------
+        frame.deltaTime = deltaTime;
+        frame.displayWidth = programState->framebufferWidth;
+        frame.displayHeight = programState->framebufferHeight;
+        frame.view = view;
+        frame.projection = projection;
+        frame.cameraPosition = activeCamera.Position;
+        frame.vehicle = vehicleFrame;
+        frame.inputTime = inputTime;
+        frame.latchSequence = latchSequence;
+        frame.headlightBoxes = attachments.world(headlightBoxes);
+        frame.windshield = attachments.world(windshieldMount);
+
+        // single renderables, one matrix batch per archetype
+        frame.drawItems.clear();
+        scene.each<rg::Renderable>([&](rg::TransformStore& transforms, const rg::Entity*, size_t count, rg::Renderable* renderables) {
+            matrixScratch.resize(count);
+            transforms.computeMatrices(0, count, glm::value_ptr(matrixScratch[0]));
+            for (size_t i = 0; i < count; i++) {
+                frame.drawItems.push_back({ renderables[i].model, renderables[i].features, renderables[i].flags, matrixScratch[i], false });
+            }
+        }, rg::EntityWorld::maskOf<rg::Instanced, rg::Attachment>());
+        scene.each<rg::Renderable, rg::Attachment>([&](rg::TransformStore&, const rg::Entity*, size_t count, rg::Renderable* renderables, rg::Attachment* attached) {
+            for (size_t i = 0; i < count; i++) {
+                frame.drawItems.push_back({ renderables[i].model, renderables[i].features, renderables[i].flags,
+                                            attachments.world(attached[i].node) * glm::translate(glm::mat4(1.0f), attached[i].offset), true });
+            }
+        });
 
-            programState->drivingCamera.Position = glm::mix(programState->drivingCamera.Position, targetPosition, 0.3f);
-            programState->drivingCamera.Front = glm::normalize(programState->truckForward);
-            programState->drivingCamera.Up = glm::vec3(0, 1, 0);
+        frame.lights.clear();
+        scene.each<rg::Light>([&](rg::TransformStore& transforms, const rg::Entity* entities, size_t count, rg::Light* lights) {
+            for (size_t i = 0; i < count; i++) {
+                frame.lights.push_back({ lights[i], transforms.position((uint32_t) i), scene.has<rg::Attachment>(entities[i]) });
+            }
+        });
+
+        // the visible instances are built by the jobs straight into the packet, matrices or
+        // compact, each run of a batch at its offset in batch order
+        jobs.wait(instancesCulled);
+        frame.instances.resize(instancedModels.size());
+        std::vector<int> instanceCounts(instancedModels.size(), 0);
+        instanceRuns.clear();
+        for (const CullBatch& batch : cullBatches) {
+            for (size_t first = 0; first < batch.visible.size();) {
+                const uint32_t model = batch.renderables[batch.visible[first]].model;
+                size_t last = first + 1;
+                while (last < batch.visible.size() && batch.renderables[batch.visible[last]].model == model) {
+                    last++;
+                }
+                const size_t slot = std::find(instancedModels.begin(), instancedModels.end(), model) - instancedModels.begin();
+                instanceRuns.push_back({ &batch, (uint32_t) first, (uint32_t) (last - first), &frame.instances[slot], instanceCounts[slot] });
+                instanceCounts[slot] += (int) (last - first);
+                first = last;
+            }
         }
-
-        windshieldShader.use();
-        windshieldShader.setMat4("projection", projection);
-        windshieldShader.setMat4("view", view);
-        windshieldShader.setMat4("model", windshieldModel);
-        windshieldShader.setVec4("windshieldColor", glm::vec4(0.7f, 0.7f, 0.9f, 0.1f));
-
-        glBindVertexArray(windshieldVAO);
-        glDrawArrays(GL_TRIANGLE_FAN, 0, 4);
-        glBindVertexArray(0);
-
-        glDisable(GL_BLEND);
-
-        // tone mapping vreme
-        glBindFramebuffer(GL_FRAMEBUFFER, pingpongFBO[0]);
-        glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
-        ourShader.use();
-        glActiveTexture(GL_TEXTURE0);
-        glBindTexture(GL_TEXTURE_2D, colorBuffers[1]);
-        renderQuad();
-
-        bool horizontal = true, first_iteration = true;
-        unsigned int amount = 10;
-        blurShader.use();
-        for (unsigned int i = 0; i < amount; i++)
+        int instanceCount = 0;
+        for (size_t slot = 0; slot < instancedModels.size(); slot++) {
+            frame.instances[slot].model = instancedModels[slot];
+            frame.instances[slot].features = instancedFeatures[slot];
+            frame.instances[slot].matrices.resize(frame.instances[slot].isCompact() ? 0 : instanceCounts[slot]);
+            frame.instances[slot].compact.resize(frame.instances[slot].isCompact() ? instanceCounts[slot] : 0);
+            instanceCount += instanceCounts[slot];
+        }
+        rg::JobCounter instancesWritten;
+        jobs.parallelFor("instance matrices", (int) instanceRuns.size(), 1, [&](int begin, int end) {
+            for (int r = begin; r < end; r++) {
+                const InstanceRun& run = instanceRuns[r];
+                const uint32_t* rows = run.batch->visible.data() + run.first;
+                if (run.out->isCompact()) {
+                    for (uint32_t i = 0; i < run.count; i++) {
+                        run.out->compact[run.offset + i] = run.batch->transforms->compactInstance(rows[i], run.batch->instanced[rows[i]].variation);
+                    }
+                } else {
+                    run.batch->transforms->gatherMatrices(rows, run.count, glm::value_ptr(run.out->matrices[run.offset]));
+                }
+            }
+        }, instancesWritten);
+        jobs.wait(instancesWritten);
+        programState->instancesVisible = instanceCount;
+
+        // settings, the render thread applies them to its own objects
+        frame.clearColor = programState->clearColor;
+        frame.depthPrepass = programState->depthPrepass;
+        frame.bloom = bloom;
+        frame.moonlight = moonlight;
+        frame.exposure = exposure;
+        frame.dynamicResolution = programState->dynamicResolution;
+        frame.upscalePreset = programState->upscaler.preset;
+        frame.requestedScale = programState->requestedScale;
+        programState->requestedScale = 0.0f;
+        frame.autoExposure = programState->autoExposure;
+        frame.exposureCompensation = programState->exposureCompensation;
+        frame.adaptationSpeed = programState->adaptationSpeed;
+        frame.pacing = programState->pacer.mode;
+        frame.lateLatch = programState->lateLatch;
+
+        // ui, built here and drawn by the render thread from its own copy
+        programState->jobMarkers = jobs.markers();
+        programState->jobThreads = jobs.threadCount();
         {
-            glBindFramebuffer(GL_FRAMEBUFFER, pingpongFBO[horizontal]);
-            blurShader.setBool("horizontal", horizontal);
-            glBindTexture(GL_TEXTURE_2D, first_iteration ? colorBuffers[1] : pingpongColorbuffers[!horizontal]);
-            renderQuad();
-            horizontal = !horizontal;
-            if (first_iteration)
-                first_iteration = false;
+            std::lock_guard<std::mutex> lock(renderStatsMutex);
+            programState->renderStats = renderStats;
         }
-        glBindFramebuffer(GL_FRAMEBUFFER, 0);
-
-        glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
-        bloomFinalShader.use();
-        glActiveTexture(GL_TEXTURE0);
-        glBindTexture(GL_TEXTURE_2D, colorBuffers[0]);
-        glActiveTexture(GL_TEXTURE1);
-        glBindTexture(GL_TEXTURE_2D, pingpongColorbuffers[!horizontal]);
-        bloomFinalShader.setBool("bloom", bloom);
-        bloomFinalShader.setFloat("exposure", exposure);
-        renderQuad();
-
-        if (programState->ImGuiEnabled)
+        programState->gameWaitMs = pipeline.gameWaitMs();
+        programState->renderWaitMs = pipeline.renderWaitMs();
+        if (programState->ImGuiEnabled) {
             DrawImGui(programState);
-
-        // glfw: swap buffers and poll IO events (keys pressed/released, mouse moved etc.)
-        // -------------------------------------------------------------------------------
-        glfwSwapBuffers(window);
-        glfwPollEvents();
+            frame.imgui.capture(ImGui::GetDrawData());
+        } else {
+            frame.imgui.clear();
+        }
+        pipeline.submit();
     }
 
+    // the render thread finishes what was submitted and gives the context back
+    pipeline.stop();
+    renderThread.join();
+    glfwMakeContextCurrent(window);
+
+    jobs.shutdown();
+    shaderReloader.release();
+    graph.release();
+    autoExposure.release();
+    gpuTimer.release();
+    overdrawCounter.release();
     delete programState;
     ImGui_ImplOpenGL3_Shutdown();
     ImGui_ImplGlfw_Shutdown();
     ImGui::DestroyContext();
 
     // curenje memorije spreceno nadam se
-    glDeleteFramebuffers(1, &hdrFBO);
-    glDeleteRenderbuffers(1, &rboDepth);
     glDeleteTextures(1, &cubemapTexture);
     glDeleteTextures(1, &groundTextureID);
     glDeleteTextures(1, &groundDiffuseTextureID);
-    glDeleteProgram(ourShader.ID);
-    glDeleteProgram(windshieldShader.ID);
+    litPrograms.release();
+    depthPrograms.release();
+    windshieldPrograms.release();
+    instanceStream.release();
+    glDeleteVertexArrays(2, headlightVAOs);
+    glDeleteBuffers(2, headlightVBOs);
+    glDeleteVertexArrays(1, &windshieldVAO);
+    glDeleteBuffers(1, &windshieldVBO);
     glDeleteProgram(hdrShader.ID);
     glDeleteProgram(blurShader.ID);
     glDeleteProgram(bloomFinalShader.ID);
     glDeleteProgram(skyboxShader.ID);
+    glDeleteProgram(upscaleShader.ID);
+    glDeleteProgram(sharpenShader.ID);
+    glDeleteProgram(histogramShader.ID);
+    glDeleteProgram(exposureShader.ID);
 
     // glfw: terminate, clearing all previously allocated GLFW resources.
     // ------------------------------------------------------------------
@@ -838,46 +1836,7 @@ void processInput(GLFWwindow *window) {
     if (glfwGetKey(window, GLFW_KEY_ESCAPE) == GLFW_PRESS)
         glfwSetWindowShouldClose(window, true);
 
-    if (programState -> isDrivingMode) {
-        // constant
-        const float truckMaxSpeed = 6.0f;
-        const float truckAcceleration = 2.0f;
-        const float truckSteerSpeed = 1.0f;
-
-        // brm brm
-        //std::cout<<"Speed " << programState -> currentTruckSpeed <<std::endl;
-
-        if (glfwGetKey(window, GLFW_KEY_W) == GLFW_PRESS) {
-            programState -> currentTruckSpeed += truckAcceleration * deltaTime;
-        }
-        else if (glfwGetKey(window, GLFW_KEY_S) == GLFW_PRESS) {
-            if (programState -> currentTruckSpeed > 0) {
-                programState -> currentTruckSpeed -= 3.0f * truckAcceleration * deltaTime; // kocnice redovno servisirane
-            }
-            else {
-                programState -> currentTruckSpeed -= truckAcceleration * deltaTime;
-            }
-        }
-        else if (programState -> currentTruckSpeed > 0) {
-            programState -> currentTruckSpeed -= truckAcceleration * deltaTime; // uspori ako ga ne diramo
-        }
-        // ne sme brzo u rikverc to niko ne radi
-        programState -> currentTruckSpeed = glm::clamp(programState -> currentTruckSpeed, -truckMaxSpeed/5, truckMaxSpeed);
-
-        if (glm::abs(programState->currentTruckSpeed) > 0.1f) { // simpl fiks da se ne vrti u mestu
-            if (glfwGetKey(window, GLFW_KEY_A) == GLFW_PRESS) {
-                programState->currentTruckSteer += truckSteerSpeed * (programState -> currentTruckSpeed / truckMaxSpeed) * deltaTime;
-            }
-            if (glfwGetKey(window, GLFW_KEY_D) == GLFW_PRESS) {
-                programState->currentTruckSteer -= truckSteerSpeed * (programState -> currentTruckSpeed / truckMaxSpeed) * deltaTime;
-            }
-
-        }
-        glm::vec3 truckMovement = programState -> currentTruckSpeed * programState -> truckForward * deltaTime;
-        programState -> truckPosition += truckMovement;
-        programState -> drivingCamera.Position += truckMovement;
-        //programState -> drivingCamera.Front = programState -> truckForward;
-    } else {
+    if (!programState->isDrivingMode) {
         if (glfwGetKey(window, GLFW_KEY_W) == GLFW_PRESS)
             programState->worldCamera.ProcessKeyboard(FORWARD, deltaTime);
         if (glfwGetKey(window, GLFW_KEY_S) == GLFW_PRESS)
@@ -908,7 +1867,15 @@ void processInput(GLFWwindow *window) {
         moonlightKeyPressed = false;
     }
 
-    if (glfwGetKey(window, GLFW_KEY_Q) == GLFW_PRESS)
+    if (programState->autoExposure)
+    {
+        // with auto exposure on Q/E shift the metered value instead
+        if (glfwGetKey(window, GLFW_KEY_Q) == GLFW_PRESS)
+            programState->exposureCompensation -= deltaTime;
+        else if (glfwGetKey(window, GLFW_KEY_E) == GLFW_PRESS)
+            programState->exposureCompensation += deltaTime;
+    }
+    else if (glfwGetKey(window, GLFW_KEY_Q) == GLFW_PRESS)
     {
         if (exposure > 0.0f)
             exposure -= 0.001f;
@@ -924,9 +1891,13 @@ void processInput(GLFWwindow *window) {
 // glfw: whenever the window size changed (by OS or user resize) this callback function executes
 // ---------------------------------------------------------------------------------------------
 void framebuffer_size_callback(GLFWwindow *window, int width, int height) {
-    // make sure the viewport matches the new window dimensions; note that width and
-    // height will be significantly larger than specified on retina displays.
-    glViewport(0, 0, width, height);
+    // note that width and height will be significantly larger than specified on retina displays.
+    // render targets are reallocated by the render thread at the start of the next frame
+    if (programState) {
+        programState->framebufferWidth = width;
+        programState->framebufferHeight = height;
+        programState->powerSaver.inputEvent();
+    }
 }
 
 // glfw: whenever the mouse moves, this callback is called
@@ -943,6 +1914,7 @@ void mouse_callback(GLFWwindow *window, double xpos, double ypos) {
 
     lastX = xpos;
     lastY = ypos;
+    programState->powerSaver.inputEvent();
 
     if (programState->CameraMouseMovementUpdateEnabled) {
         Camera& activeCamera = programState->isDrivingMode ? programState->drivingCamera : programState->worldCamera;
@@ -955,6 +1927,25 @@ void mouse_callback(GLFWwindow *window, double xpos, double ypos) {
 void scroll_callback(GLFWwindow *window, double xoffset, double yoffset) {
     Camera& activeCamera = programState->isDrivingMode ? programState->drivingCamera : programState->worldCamera;
     activeCamera.ProcessMouseScroll(yoffset);
+    programState->powerSaver.inputEvent();
+}
+
+// ImGui gets clicks from its own callback, a left click anywhere else picks in free roam. With the
+// cursor captured the pick is in the middle of the screen.
+void mouse_button_callback(GLFWwindow *window, int button, int action, int mods) {
+    programState->powerSaver.inputEvent();
+    if (button != GLFW_MOUSE_BUTTON_LEFT || action != GLFW_PRESS || programState->isDrivingMode || ImGui::GetIO().WantCaptureMouse) {
+        return;
+    }
+    programState->pickPoint = glm::vec2(0.5f);
+    if (glfwGetInputMode(window, GLFW_CURSOR) == GLFW_CURSOR_NORMAL) {
+        double x, y;
+        int width, height;
+        glfwGetCursorPos(window, &x, &y);
+        glfwGetWindowSize(window, &width, &height);
+        programState->pickPoint = glm::vec2((float) x / std::max(1, width), (float) y / std::max(1, height));
+    }
+    programState->pickRequested = true;
 }
 
 void DrawImGui(ProgramState *programState) {
@@ -970,9 +1961,97 @@ void DrawImGui(ProgramState *programState) {
         ImGui::SliderFloat("Float slider", &f, 0.0, 1.0);
         ImGui::ColorEdit3("Background color", (float *) &programState->clearColor);
 
-        ImGui::DragFloat("leftHeadlight.constant", &programState->leftHeadlight.constant, 0.05, 0.0, 1.0);
-        ImGui::DragFloat("leftHeadlight.linear", &programState->leftHeadlight.linear, 0.05, 0.0, 1.0);
-        ImGui::DragFloat("leftHeadlight.quadratic", &programState->leftHeadlight.quadratic, 0.05, 0.0, 1.0);
+        rg::Light& leftHeadlight = programState->scene.get<rg::Light>(programState->leftHeadlight);
+        ImGui::DragFloat("leftHeadlight.constant", &leftHeadlight.constant, 0.05, 0.0, 1.0);
+        ImGui::DragFloat("leftHeadlight.linear", &leftHeadlight.linear, 0.05, 0.0, 1.0);
+        ImGui::DragFloat("leftHeadlight.quadratic", &leftHeadlight.quadratic, 0.05, 0.0, 1.0);
+        ImGui::End();
+    }
+
+    {
+        ImGui::Begin("Performance");
+        const RenderStats& stats = programState->renderStats;
+        ImGui::Text("GPU frame: %.2f ms (smoothed %.2f ms)", stats.gpuFrameMs, stats.smoothedMs);
+        ImGui::Text("Render thread: game waited %.2f ms, render waited %.2f ms", programState->gameWaitMs, programState->renderWaitMs);
+        ImGui::Text("Internal resolution: %dx%d (%.0f%%) -> %dx%d", stats.internalWidth, stats.internalHeight, stats.scale * 100.0f, stats.displayWidth, stats.displayHeight);
+        int preset = (int) programState->upscaler.preset;
+        if (ImGui::Combo("Upscaler", &preset, "Off\0Quality\0Balanced\0Performance\0")) {
+            // the preset caps the internal resolution, dynamic resolution can still go lower
+            programState->upscaler.preset = (rg::UpscalePreset) preset;
+            programState->dynamicResolution.maxScale = programState->upscaler.settings().scale;
+            programState->requestedScale = programState->upscaler.settings().scale;
+        }
+        ImGui::Checkbox("Depth pre-pass", &programState->depthPrepass);
+        ImGui::Text("Overdraw: %.2f opaque fragments shaded per pixel", stats.overdraw);
+        ImGui::Checkbox("Dynamic resolution", &programState->dynamicResolution.enabled);
+        ImGui::DragFloat("Frame budget (ms)", &programState->dynamicResolution.targetMs, 0.1f, 4.0f, 50.0f);
+        ImGui::SliderFloat("Min scale", &programState->dynamicResolution.minScale, 0.25f, 1.0f);
+        if (!programState->dynamicResolution.enabled) {
+            float scale = stats.scale;
+            if (ImGui::SliderFloat("Scale", &scale, programState->dynamicResolution.minScale, programState->dynamicResolution.maxScale)) {
+                programState->requestedScale = scale;
+            }
+        }
+        const rg::RenderGraph::Report& report = stats.report;
+        ImGui::Text("Render graph: %d/%d passes, %d textures for %d transient",
+                    report.passes - report.culledPasses, report.passes, report.physicalTextures, report.transientTextures);
+        ImGui::Text("VRAM: %.1f MiB (unaliased %.1f MiB, peak live %.1f MiB, pool %.1f MiB)",
+                    report.physicalBytes / 1048576.0, report.transientBytes / 1048576.0,
+                    report.peakLiveBytes / 1048576.0, report.pooledBytes / 1048576.0);
+        if (ImGui::TreeNode("Passes")) {
+            for (const rg::RenderGraph::PassInfo& pass : stats.passes) {
+                ImGui::Text("%s%s", pass.name.c_str(), pass.culled ? " (culled)" : "");
+            }
+            ImGui::TreePop();
+        }
+        ImGui::Text("Entities: %d in %d archetypes", (int) programState->scene.entityCount(), (int) programState->scene.archetypeCount());
+        ImGui::Text("Instances: %d visible, %s stream, waited %.2f ms", programState->instancesVisible,
+                    stats.persistentStream ? "persistent" : "mapped", stats.streamWaitMs);
+        ImGui::Text("Nearest instance to the truck: %.1f", programState->nearestInstance);
+        ImGui::Text("Collisions: %d hits, %d touching%s, %.3f ms per step", programState->crowdHits, programState->crowdTouching,
+                    programState->wallContact ? ", against the wall" : "", programState->collisionMs);
+        ImGui::Text("Rays: %d in %.3f ms", programState->raysTraced, programState->rayMs);
+        ImGui::Text("Ground under the wheels: %.2f %.2f %.2f %.2f", programState->wheelGround[0], programState->wheelGround[1],
+                    programState->wheelGround[2], programState->wheelGround[3]);
+        ImGui::Text("Headlights reach: %.1f, %.1f", programState->headlightReach[0], programState->headlightReach[1]);
+        if (programState->picked) {
+            ImGui::Text("Picked: %s, %.1f away", programState->picked, programState->pickedDistance);
+        } else {
+            ImGui::Text("Picked: nothing (click in free roam)");
+        }
+        ImGui::Text("Simulation: %d Hz, %d steps this frame", programState->simulationHz, programState->simulationSteps);
+        int pacing = (int) programState->pacer.mode;
+        if (ImGui::Combo("Frame pacing", &pacing, "VSync\0Adaptive\0Capped\0Uncapped\0")) {
+            programState->pacer.mode = (rg::PacingMode) pacing;
+        }
+        if (programState->pacer.mode == rg::PacingMode::Adaptive && !stats.tearControl) {
+            ImGui::Text("Adaptive vsync not supported by the driver, using vsync");
+        }
+        if (programState->pacer.mode == rg::PacingMode::Capped) {
+            ImGui::SliderInt("Frame cap", &programState->pacer.cappedFps, 20, 300);
+        }
+        ImGui::Checkbox("Late latching", &programState->lateLatch);
+        ImGui::Checkbox("Render on demand", &programState->powerSaver.enabled);
+        ImGui::SameLine();
+        const char* activities[] = { "active", "idle", "unfocused", "minimized" };
+        ImGui::Text("(%s)", activities[(int) programState->powerSaver.last()]);
+        ImGui::Text("Input to present: %.1f ms (avg %.1f, max %.1f)%s", stats.latencyMs, stats.latencyAverageMs,
+                    stats.latencyMaxMs, stats.lateLatched ? ", late latched" : "");
+        ImGui::Text("Attachment transforms updated: %d", programState->transformsUpdated);
+        if (ImGui::TreeNode("jobs", "Jobs: %d threads, %d jobs", programState->jobThreads, (int) programState->jobMarkers.size())) {
+            for (const rg::JobMarker& marker : programState->jobMarkers) {
+                ImGui::Text("[%d] %s %.3f - %.3f ms", marker.thread, marker.name, marker.start, marker.end);
+            }
+            ImGui::TreePop();
+        }
+        ImGui::Checkbox("Auto exposure", &programState->autoExposure);
+        if (programState->autoExposure) {
+            ImGui::Text("Exposure: %.4f", stats.exposure);
+            ImGui::DragFloat("Compensation (EV)", &programState->exposureCompensation, 0.05f, -8.0f, 8.0f);
+            ImGui::DragFloat("Adaptation speed", &programState->adaptationSpeed, 0.05f, 0.1f, 10.0f);
+        } else {
+            ImGui::DragFloat("Exposure", &exposure, 0.001f, 0.0f, 10.0f);
+        }
         ImGui::End();
     }
 
@@ -987,10 +2066,10 @@ void DrawImGui(ProgramState *programState) {
     }
 
     ImGui::Render();
-    ImGui_ImplOpenGL3_RenderDrawData(ImGui::GetDrawData());
 }
 
 void key_callback(GLFWwindow *window, int key, int scancode, int action, int mods) {
+    programState->powerSaver.inputEvent();
     if (key == GLFW_KEY_F1 && action == GLFW_PRESS) {
         programState->ImGuiEnabled = !programState->ImGuiEnabled;
         if (programState->ImGuiEnabled) {
@@ -1083,3 +2162,257 @@ unsigned int loadCubemap(vector<std::string> faces)
 
     return textureID;
 }
+
+DriveInput readDriveInput(GLFWwindow *window) {
+    return { glfwGetKey(window, GLFW_KEY_W) == GLFW_PRESS, glfwGetKey(window, GLFW_KEY_S) == GLFW_PRESS,
+             glfwGetKey(window, GLFW_KEY_A) == GLFW_PRESS, glfwGetKey(window, GLFW_KEY_D) == GLFW_PRESS };
+}
+
+// model je blesav pa ga rotiramo da bude lepo orijentisan
+glm::mat4 truckBodyTransform() {
+    glm::mat4 body = glm::scale(glm::mat4(1.0f), glm::vec3(0.1f));
+    body = glm::rotate(body, (float) (-M_PI * 0.5f), glm::vec3(1, 0, 0));
+    return glm::rotate(body, (float) (M_PI * 0.5f), glm::vec3(0, 0, 1));
+}
+
+// one fixed simulation step of the truck, the same for the window and headless runs; returns how far it moved
+glm::vec3 simulateTruck(rg::EntityWorld& scene, rg::Entity truck, const DriveInput& input, const glm::vec3& bodyForward, float dt) {
+    // constant
+    const float truckMaxSpeed = 6.0f;
+    const float truckAcceleration = 2.0f;
+    const float truckSteerSpeed = 1.0f;
+    rg::Vehicle& vehicle = scene.get<rg::Vehicle>(truck);
+
+    // brm brm
+    //std::cout<<"Speed " << vehicle.speed <<std::endl;
+
+    if (input.accelerate) {
+        vehicle.speed += truckAcceleration * dt;
+    }
+    else if (input.brake) {
+        if (vehicle.speed > 0) {
+            vehicle.speed -= 3.0f * truckAcceleration * dt; // kocnice redovno servisirane
+        }
+        else {
+            vehicle.speed -= truckAcceleration * dt;
+        }
+    }
+    else if (vehicle.speed > 0) {
+        vehicle.speed -= truckAcceleration * dt; // uspori ako ga ne diramo
+    }
+    // ne sme brzo u rikverc to niko ne radi
+    vehicle.speed = glm::clamp(vehicle.speed, -truckMaxSpeed/5, truckMaxSpeed);
+
+    if (glm::abs(vehicle.speed) > 0.1f) { // simpl fiks da se ne vrti u mestu
+        if (input.left) {
+            vehicle.steer += truckSteerSpeed * (vehicle.speed / truckMaxSpeed) * dt;
+        }
+        if (input.right) {
+            vehicle.steer -= truckSteerSpeed * (vehicle.speed / truckMaxSpeed) * dt;
+        }
+
+    }
+    glm::vec3 truckMovement = vehicle.speed * vehicle.forward * dt;
+    scene.setPosition(truck, scene.position(truck) + truckMovement);
+    const glm::quat rotation = glm::angleAxis(vehicle.steer, glm::vec3(0, 1, 0));
+    scene.setRotation(truck, rotation);
+    vehicle.forward = glm::normalize(rotation * bodyForward);
+    return truckMovement;
+}
+
+// one fixed step of truck collisions, right after simulateTruck. The truck's rg::Collider against
+// every other collider (the wall) is box against box, the truck is pushed back out along the
+// ground and stops if it was driving in. Against the crowd the grids are the broadphase, the
+// members of the cells under the truck's box are tested as spheres against it in batches; a
+// contact that starts slows the truck down, the crowd does not get pushed around.
+TruckContacts collideTruck(rg::EntityWorld& scene, rg::Entity truck, std::vector<CrowdCollisions>& crowds) {
+    TruckContacts result;
+    rg::Vehicle& vehicle = scene.get<rg::Vehicle>(truck);
+    rg::OrientedBox truckBox = rg::OrientedBox::fromCollider(scene.matrix(truck), scene.get<rg::Collider>(truck));
+
+    scene.each<rg::Collider>([&](rg::TransformStore& transforms, const rg::Entity*, size_t count, rg::Collider* colliders) {
+        for (uint32_t i = 0; i < count; i++) {
+            const rg::OrientedBox solid = rg::OrientedBox::fromCollider(transforms.matrix(i), colliders[i]);
+            rg::Contact contact;
+            if (!rg::boxesOverlap(truckBox, solid, contact)) {
+                continue;
+            }
+            // the truck stays on the ground, only the horizontal part of the normal can separate
+            // them; a contact from above or below is left alone
+            glm::vec3 away(contact.normal.x, 0.0f, contact.normal.z);
+            const float horizontal = glm::length(away);
+            if (horizontal < 0.3f) {
+                continue;
+            }
+            away /= horizontal;
+            const glm::vec3 push = away * (contact.depth / horizontal);
+            scene.setPosition(truck, scene.position(truck) + push);
+            truckBox.center += push;
+            result.pushed += push;
+            if (glm::dot(vehicle.forward * vehicle.speed, away) < 0.0f) {
+                vehicle.speed = 0.0f;
+            }
+            result.solid = true;
+        }
+    }, rg::EntityWorld::maskOf<rg::Vehicle>());
+
+    glm::vec3 min, max;
+    truckBox.bounds(min, max);
+    for (CrowdCollisions& crowd : crowds) {
+        crowd.hits.clear();
+        crowd.grid->queryCells(min, max, [&](const rg::SpatialGrid::Item* items, size_t count) {
+            rg::spheresTouchingBox(truckBox, items, count, crowd.hits);
+        });
+        crowd.contacts.begin();
+        for (uint32_t id : crowd.hits) {
+            if (crowd.contacts.add(id)) {
+                result.crowdStarted++;
+                vehicle.speed *= 0.6f;
+            }
+        }
+        crowd.contacts.end();
+        result.crowdTouching += (int) crowd.hits.size();
+    }
+    return result;
+}
+
+
+// headless runs
+// -------------
+// models are not loaded without GL, so the truck's box and the crowd's radius are rough
+// stand-ins for the real ones
+const rg::Collider headlessTruckBox = { glm::vec3(0.0f, 1.0f, 0.0f), glm::vec3(0.9f, 1.0f, 1.8f) };
+const float headlessCrowdRadius = 0.5f;
+
+struct HeadlessResult {
+    unsigned int seed = 0;
+    double distance = 0.0;     // driven, in world units
+    float topSpeed = 0.0f;
+    long encounters = 0;       // times the truck ran into a member of the crowd
+    glm::vec3 finalPosition = glm::vec3(0.0f);
+};
+
+// One independent run: its own world and random driver, everything follows from the seed.
+// The truck runs the same fixed step as the window build, the crowd is spawned like there.
+HeadlessResult simulateHeadless(unsigned int seed, int crowdCount, long steps, float dt) {
+    HeadlessResult result;
+    result.seed = seed;
+    std::mt19937 random(seed);
+    std::uniform_real_distribution<float> spawn(-pokemonSpawnZone, pokemonSpawnZone);
+    std::uniform_real_distribution<float> chance(0.0f, 1.0f);
+
+    rg::EntityWorld scene;
+    const glm::quat noRotation(1.0f, 0.0f, 0.0f, 0.0f);
+    for (int i = 0; i < crowdCount; i++) {
+        const float x = spawn(random);
+        const float z = spawn(random);
+        scene.create(glm::vec3(x, 0.0f, z), noRotation, glm::vec3(1.0f), rg::Bounds{ headlessCrowdRadius }, rg::Instanced{});
+    }
+    const glm::vec3 bodyForward = glm::normalize(glm::vec3(truckBodyTransform() * glm::vec4(1.0f, 0.0f, 0.0f, 0.0f)));
+    const rg::Entity truck = scene.create(glm::vec3(0.0f), noRotation, glm::vec3(1.0f), rg::Vehicle{ 0.0f, 0.0f, bodyForward }, headlessTruckBox);
+    rg::SpatialGrid crowd;
+    crowd.init(glm::vec2(-pokemonSpawnZone), glm::vec2(pokemonSpawnZone), instanceCellSize);
+    scene.each<rg::Bounds, rg::Instanced>([&](rg::TransformStore& transforms, const rg::Entity*, size_t count, rg::Bounds* bounds, rg::Instanced*) {
+        for (uint32_t i = 0; i < count; i++) {
+            crowd.insert(i, transforms.position(i), bounds[i].radius);
+        }
+    });
+    std::vector<CrowdCollisions> crowds(1);
+    crowds[0].grid = &crowd;
+
+    // the driver changes its mind about once a second
+    DriveInput input = { true, false, false, false };
+    const long decisionSteps = std::max(1L, (long) (1.0f / dt));
+    for (long step = 0; step < steps; step++) {
+        if (step % decisionSteps == 0) {
+            const float pedal = chance(random);
+            const float wheel = chance(random);
+            input.accelerate = pedal < 0.7f;
+            input.brake = pedal > 0.9f;
+            input.left = wheel < 0.25f;
+            input.right = wheel > 0.75f;
+        }
+        const glm::vec3 movement = simulateTruck(scene, truck, input, bodyForward, dt);
+        result.distance += glm::length(movement);
+        result.topSpeed = std::max(result.topSpeed, scene.get<rg::Vehicle>(truck).speed);
+
+        // an encounter starts when a member of the crowd begins to touch the truck's box
+        result.encounters += collideTruck(scene, truck, crowds).crowdStarted;
+    }
+    result.finalPosition = scene.position(truck);
+    return result;
+}
+
+// --headless [--runs N] [--minutes M] [--seed S] [--threads T] [--crowd C] [--per-run]
+int runHeadless(int argc, char **argv) {
+    int runs = 64;
+    double minutes = 10.0;
+    unsigned int seed = 1;
+    int threads = 0;
+    int crowdCount = pokemonCount;
+    bool perRun = false;
+    for (int i = 1; i < argc; i++) {
+        const std::string arg = argv[i];
+        const bool hasValue = i + 1 < argc;
+        if (arg == "--runs" && hasValue) {
+            runs = std::max(1, std::atoi(argv[++i]));
+        } else if (arg == "--minutes" && hasValue) {
+            minutes = std::max(0.0, std::atof(argv[++i]));
+        } else if (arg == "--seed" && hasValue) {
+            seed = (unsigned int) std::strtoul(argv[++i], NULL, 10);
+        } else if (arg == "--threads" && hasValue) {
+            threads = std::max(0, std::atoi(argv[++i]));
+        } else if (arg == "--crowd" && hasValue) {
+            crowdCount = std::max(0, std::atoi(argv[++i]));
+        } else if (arg == "--per-run") {
+            perRun = true;
+        } else if (arg != "--headless") {
+            std::cout << "[Headless] unknown argument " << arg << std::endl;
+            return 1;
+        }
+    }
+
+    rg::FixedTimestep clock(120.0);
+    const float dt = clock.stepSeconds();
+    const long steps = (long) (minutes * 60.0 * clock.hz());
+    rg::JobSystem jobs;
+    jobs.init(threads);
+    std::cout << "[Headless] " << runs << " runs of " << minutes << " simulated minutes (" << steps << " steps at "
+              << (int) clock.hz() << " Hz), crowd of " << crowdCount << ", seeds " << seed << ".." << seed + runs - 1
+              << ", " << jobs.threadCount() << " threads" << std::endl;
+
+    std::vector<HeadlessResult> results(runs);
+    const auto start = std::chrono::steady_clock::now();
+    rg::JobCounter done;
+    jobs.parallelFor("headless runs", runs, 1, [&](int begin, int end) {
+        for (int run = begin; run < end; run++) {
+            results[run] = simulateHeadless(seed + run, crowdCount, steps, dt);
+        }
+    }, done);
+    jobs.wait(done);
+    const double wallSeconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+    jobs.shutdown();
+
+    double distanceSum = 0.0, distanceMin = results[0].distance, distanceMax = results[0].distance;
+    long encounterSum = 0;
+    float topSpeed = 0.0f;
+    for (const HeadlessResult& result : results) {
+        if (perRun) {
+            std::cout << "[Headless] seed " << result.seed << ": " << result.distance << " driven, top speed " << result.topSpeed
+                      << ", " << result.encounters << " encounters, ends at (" << result.finalPosition.x << ", "
+                      << result.finalPosition.z << ")" << std::endl;
+        }
+        distanceSum += result.distance;
+        distanceMin = std::min(distanceMin, result.distance);
+        distanceMax = std::max(distanceMax, result.distance);
+        encounterSum += result.encounters;
+        topSpeed = std::max(topSpeed, result.topSpeed);
+    }
+    const double simulatedMinutes = minutes * runs;
+    std::cout << "[Headless] distance driven: mean " << distanceSum / runs << ", min " << distanceMin << ", max " << distanceMax
+              << "; encounters: mean " << (double) encounterSum / runs << "; top speed " << topSpeed << std::endl;
+    std::cout << "[Headless] " << simulatedMinutes << " simulated minutes in " << wallSeconds << " s: "
+              << (wallSeconds > 0.0 ? simulatedMinutes / (wallSeconds / 60.0) : 0.0) << " simulated minutes per minute, "
+              << (wallSeconds > 0.0 ? (double) steps * runs / wallSeconds : 0.0) << " steps/s" << std::endl;
+    return 0;
+}
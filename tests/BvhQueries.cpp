@@ -0,0 +1,162 @@
+//
+// SceneBvh against an exhaustive Möller–Trumbore over every triangle of every instance:
+// single rays, and batches of every length so the SSE packets run with 1 to 4 live lanes.
+//
+
+#include <rg/Bvh.h>
+
+#include <cmath>
+#include <iostream>
+#include <random>
+#include <vector>
+
+namespace {
+
+struct Mesh {
+    std::vector<glm::vec3> positions;
+    std::vector<uint32_t> indices;
+};
+
+// rotation about y, uniform scale, translation
+glm::mat4 place(float angle, const glm::vec3& position, float scale) {
+    const float c = std::cos(angle), s = std::sin(angle);
+    return glm::mat4(glm::vec4(c * scale, 0.0f, -s * scale, 0.0f), glm::vec4(0.0f, scale, 0.0f, 0.0f),
+                     glm::vec4(s * scale, 0.0f, c * scale, 0.0f), glm::vec4(position, 1.0f));
+}
+
+rg::RayHit exhaustive(const std::vector<const Mesh*>& meshes, const std::vector<glm::mat4>& worlds, const rg::Ray& ray) {
+    rg::RayHit best = { ray.tMax, rg::RayHit::None, rg::RayHit::None, 0.0f, 0.0f };
+    for (size_t i = 0; i < meshes.size(); i++) {
+        const Mesh& mesh = *meshes[i];
+        for (size_t t = 0; t < mesh.indices.size() / 3; t++) {
+            const glm::vec3 a(worlds[i] * glm::vec4(mesh.positions[mesh.indices[3 * t]], 1.0f));
+            const glm::vec3 b(worlds[i] * glm::vec4(mesh.positions[mesh.indices[3 * t + 1]], 1.0f));
+            const glm::vec3 c(worlds[i] * glm::vec4(mesh.positions[mesh.indices[3 * t + 2]], 1.0f));
+            const glm::vec3 e1 = b - a, e2 = c - a;
+            const glm::vec3 p = glm::cross(ray.direction, e2);
+            const float det = glm::dot(e1, p);
+            if (std::abs(det) < 1e-12f) {
+                continue;
+            }
+            const glm::vec3 s = ray.origin - a;
+            const float u = glm::dot(s, p) / det;
+            const glm::vec3 q = glm::cross(s, e1);
+            const float v = glm::dot(ray.direction, q) / det;
+            const float d = glm::dot(e2, q) / det;
+            if (u >= 0.0f && v >= 0.0f && u + v <= 1.0f && d >= 0.0f && d < best.t) {
+                best.t = d;
+                best.instance = (uint32_t) i;
+                best.triangle = (uint32_t) t;
+            }
+        }
+    }
+    return best;
+}
+
+}
+
+using rg::RayHit;
+
+int main() {
+    std::mt19937 random(7);
+    std::uniform_real_distribution<float> unit(-1.0f, 1.0f);
+    std::uniform_real_distribution<float> spread(-30.0f, 30.0f);
+
+    // a cloud of small triangles, a ground quad and a mesh with nothing in it
+    Mesh cloud, ground, empty;
+    for (int i = 0; i < 300; i++) {
+        const glm::vec3 center = glm::vec3(unit(random), unit(random) + 1.0f, unit(random)) * 0.5f;
+        for (int k = 0; k < 3; k++) {
+            cloud.positions.push_back(center + glm::vec3(unit(random), unit(random), unit(random)) * 0.1f);
+            cloud.indices.push_back((uint32_t) cloud.positions.size() - 1);
+        }
+    }
+    ground.positions = { glm::vec3(-40.0f, 0.0f, -40.0f), glm::vec3(40.0f, 0.0f, -40.0f),
+                         glm::vec3(40.0f, 0.0f, 40.0f), glm::vec3(-40.0f, 0.0f, 40.0f) };
+    ground.indices = { 0, 1, 2, 0, 2, 3 };
+    rg::TriangleBvh cloudBvh, groundBvh, emptyBvh;
+    cloudBvh.build(cloud.positions, cloud.indices);
+    groundBvh.build(ground.positions, ground.indices);
+    emptyBvh.build(empty.positions, empty.indices);
+
+    rg::SceneBvh scene;
+    std::vector<const Mesh*> meshes;
+    std::vector<glm::mat4> worlds;
+    auto add = [&](const rg::TriangleBvh& bvh, const Mesh& mesh, const glm::mat4& world) {
+        scene.add(bvh, world);
+        meshes.push_back(&mesh);
+        worlds.push_back(world);
+    };
+    for (int i = 0; i < 120; i++) {
+        add(cloudBvh, cloud, place(unit(random) * 3.0f, glm::vec3(spread(random), 0.0f, spread(random)), 1.0f + unit(random) * 0.3f));
+    }
+    add(emptyBvh, empty, place(0.0f, glm::vec3(0.0f, 1.0f, 0.0f), 1.0f));
+    add(groundBvh, ground, place(0.3f, glm::vec3(0.0f), 1.0f));
+    scene.build();
+
+    // sideways rays through the crowd of clouds, rays straight down (zero x and z) that end
+    // on the ground or short of it, and a few that start inside a cloud
+    std::vector<rg::Ray> rays;
+    for (int i = 0; i < 300; i++) {
+        const glm::vec3 direction(unit(random), -0.3f + unit(random) * 0.3f, unit(random));
+        rays.push_back({ glm::vec3(spread(random), 1.0f + unit(random), spread(random)), direction * 10.0f, 10.0f });
+    }
+    for (int i = 0; i < 80; i++) {
+        rays.push_back({ glm::vec3(spread(random), 3.0f, spread(random)), glm::vec3(0.0f, -1.0f, 0.0f), i % 2 ? 5.0f : 2.0f });
+    }
+    for (int i = 0; i < 23; i++) {
+        const glm::vec3 direction(unit(random), unit(random), unit(random));
+        rays.push_back({ glm::vec3(worlds[i][3]) + glm::vec3(0.0f, 0.5f, 0.0f), direction, 4.0f });
+    }
+
+    int failures = 0;
+    auto check = [&](const char* path, size_t ray, const RayHit& hit, const RayHit& expected) {
+        const bool same = hit.instance == expected.instance &&
+                          (!expected.hit() || (hit.triangle == expected.triangle && std::abs(hit.t - expected.t) <= 1e-3f * (1.0f + expected.t)));
+        if (!same && failures++ < 10) {
+            std::cerr << "BvhQueries: ray " << ray << " " << path << " hit instance " << (int) hit.instance << " triangle "
+                      << (int) hit.triangle << " at " << hit.t << ", exhaustive instance " << (int) expected.instance
+                      << " triangle " << (int) expected.triangle << " at " << expected.t << std::endl;
+        }
+    };
+
+    std::vector<RayHit> expected(rays.size());
+    int hits = 0;
+    for (size_t i = 0; i < rays.size(); i++) {
+        expected[i] = exhaustive(meshes, worlds, rays[i]);
+        hits += expected[i].hit();
+        check("single", i, scene.intersect(rays[i]), expected[i]);
+    }
+
+    // the whole batch, its length not a multiple of 4
+    std::vector<RayHit> batch(rays.size());
+    scene.intersect(rays.data(), batch.data(), rays.size());
+    for (size_t i = 0; i < rays.size(); i++) {
+        check("batched", i, batch[i], expected[i]);
+    }
+    // every short batch length from every offset within a packet
+    for (size_t offset = 0; offset < 4; offset++) {
+        for (size_t count = 0; count <= 9; count++) {
+            std::vector<RayHit> part(count + 1);
+            part[count].instance = 1234;   // must stay untouched
+            scene.intersect(rays.data() + offset, part.data(), count);
+            for (size_t i = 0; i < count; i++) {
+                check("short batch", offset + i, part[i], expected[offset + i]);
+            }
+            if (part[count].instance != 1234 && failures++ < 10) {
+                std::cerr << "BvhQueries: a batch of " << count << " wrote past its end" << std::endl;
+            }
+        }
+    }
+
+    if (hits == 0 || hits == (int) rays.size()) {
+        std::cerr << "BvhQueries: " << hits << " of " << rays.size() << " rays hit, the scene tests nothing" << std::endl;
+        return 1;
+    }
+    if (failures) {
+        std::cerr << "BvhQueries: " << failures << " mismatches" << std::endl;
+        return 1;
+    }
+    std::cout << "BvhQueries: " << rays.size() << " rays, " << hits << " hits" << std::endl;
+    return 0;
+}
@@ -0,0 +1,49 @@
+//
+// Counters created, waited on and destroyed in a tight loop, the way every frame uses them.
+// A counter freed while its last job still holds it shows up as a crash or, under
+// -fsanitize=address/thread, as a report.
+//
+
+#include <rg/JobSystem.h>
+
+#include <atomic>
+#include <iostream>
+#include <memory>
+
+int main() {
+    rg::JobSystem jobs;
+    // workers even on a single core machine, the race needs another thread to finish the job
+    jobs.init(4);
+
+    const int rounds = 20000;
+    std::atomic<long> work{0};
+    long expected = 0;
+    for (int round = 0; round < rounds; round++) {
+        // on the heap so a late access after delete is a use after free even without a sanitizer
+        std::unique_ptr<rg::JobCounter> counter(new rg::JobCounter());
+        const int count = 1 + round % 64;
+        jobs.parallelFor("stress", count, 1 + round % 4, [&](int begin, int end) {
+            work.fetch_add(end - begin, std::memory_order_relaxed);
+        }, *counter);
+        expected += count;
+
+        // a dependency on a counter that may be finishing at the same moment
+        if (round % 3 == 0) {
+            rg::JobCounter after;
+            jobs.runAfter(*counter, "stress continuation", [&]() {
+                work.fetch_add(1, std::memory_order_relaxed);
+            }, &after);
+            expected++;
+            jobs.wait(after);
+        }
+        jobs.wait(*counter);
+    }
+    jobs.shutdown();
+
+    if (work.load() != expected) {
+        std::cerr << "JobCounterStress: " << work.load() << " units of work done, " << expected << " expected" << std::endl;
+        return 1;
+    }
+    std::cout << "JobCounterStress: " << rounds << " rounds" << std::endl;
+    return 0;
+}
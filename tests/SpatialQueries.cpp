@@ -0,0 +1,268 @@
+//
+// SpatialGrid queries against a linear scan over every item, on a fresh grid and again after
+// items moved within and across cells, left the grid's area and were removed. Then the
+// collision narrowphase: the SSE sphere test against the scalar one, and box pairs with a
+// known answer.
+//
+
+#include <rg/Collision.h>
+#include <rg/SpatialGrid.h>
+
+#include <glm/gtc/matrix_transform.hpp>
+
+#include <algorithm>
+#include <iostream>
+#include <random>
+#include <vector>
+
+namespace {
+
+int failures = 0;
+
+void expectSame(const char* query, std::vector<uint32_t> found, std::vector<uint32_t> expected) {
+    std::sort(found.begin(), found.end());
+    std::sort(expected.begin(), expected.end());
+    if (found != expected && failures++ < 10) {
+        std::cerr << "SpatialQueries: " << query << " found " << found.size() << " items, the scan " << expected.size() << std::endl;
+    }
+}
+
+// spheresTouchingBox decides when a contact starts, its SSE body and its scalar tail must
+// agree on every item. Some items are placed exactly against a face.
+void checkSpheresTouchingBox(std::mt19937& random) {
+    std::uniform_real_distribution<float> unit(-1.0f, 1.0f);
+    for (int round = 0; round < 200; round++) {
+        rg::OrientedBox box;
+        box.center = glm::vec3(unit(random), unit(random), unit(random)) * 10.0f;
+        box.axes[0] = glm::normalize(glm::vec3(unit(random), unit(random), unit(random)));
+        box.axes[1] = glm::normalize(glm::cross(box.axes[0], glm::vec3(unit(random), unit(random), unit(random))));
+        box.axes[2] = glm::cross(box.axes[0], box.axes[1]);
+        box.halfExtents = glm::vec3(1.0f + unit(random) * 0.5f, 0.5f + unit(random) * 0.25f, 2.0f + unit(random));
+
+        // every length up to a few packets, then a long cell
+        const size_t count = round < 40 ? (size_t) round % 14 : 500;
+        std::vector<rg::SpatialGrid::Item> items(count);
+        for (size_t i = 0; i < count; i++) {
+            const float radius = 0.2f + (unit(random) + 1.0f) * 0.5f;
+            glm::vec3 center = box.center + glm::vec3(unit(random), unit(random), unit(random)) * 4.0f;
+            if (i % 7 == 3) {
+                const int axis = (int) i % 3;
+                center = box.center + box.axes[axis] * (box.halfExtents[axis] + radius);
+            }
+            items[i] = { center, radius, (uint32_t) i };
+        }
+        std::vector<uint32_t> batched, scalar;
+        rg::spheresTouchingBox(box, items.data(), count, batched);
+        for (const rg::SpatialGrid::Item& item : items) {
+            if (rg::sphereTouchesBox(box, item.center, item.radius)) {
+                scalar.push_back(item.id);
+            }
+        }
+        if (batched != scalar && failures++ < 10) {
+            std::cerr << "SpatialQueries: spheresTouchingBox over " << count << " items found " << batched.size()
+                      << ", sphereTouchesBox " << scalar.size() << std::endl;
+        }
+    }
+}
+
+rg::OrientedBox orientedBox(const glm::vec3& center, const glm::vec3& x, const glm::vec3& y, const glm::vec3& z, const glm::vec3& halfExtents) {
+    rg::OrientedBox box;
+    box.center = center;
+    box.axes[0] = x;
+    box.axes[1] = y;
+    box.axes[2] = z;
+    box.halfExtents = halfExtents;
+    return box;
+}
+
+void expectOverlap(const char* pair, const rg::OrientedBox& a, const rg::OrientedBox& b, bool overlap, float depth, const glm::vec3& normal) {
+    rg::Contact contact;
+    const bool found = rg::boxesOverlap(a, b, contact);
+    const bool same = found == overlap && (!overlap || (std::abs(contact.depth - depth) < 1e-5f && glm::length(contact.normal - normal) < 1e-5f));
+    if (!same && failures++ < 10) {
+        std::cerr << "SpatialQueries: boxesOverlap " << pair << " gave " << found << ", depth " << contact.depth << std::endl;
+    }
+}
+
+void checkBoxesOverlap() {
+    const glm::vec3 x(1.0f, 0.0f, 0.0f), y(0.0f, 1.0f, 0.0f), z(0.0f, 0.0f, 1.0f), one(1.0f);
+    const rg::OrientedBox unit = orientedBox(glm::vec3(0.0f), x, y, z, one);
+    expectOverlap("apart on x", unit, orientedBox(glm::vec3(2.5f, 0.0f, 0.0f), x, y, z, one), false, 0.0f, x);
+    // sharing a face counts, with nothing to push apart
+    expectOverlap("touching", unit, orientedBox(glm::vec3(2.0f, 0.0f, 0.0f), x, y, z, one), true, 0.0f, -x);
+    // the least way out of the big box for the small one is along x, away from the big one's center
+    expectOverlap("nested", orientedBox(glm::vec3(0.2f, 0.0f, 0.0f), x, y, z, glm::vec3(0.5f)),
+                  orientedBox(glm::vec3(0.0f), x, y, z, glm::vec3(3.0f)), true, 3.3f, x);
+
+    // a turned 45 degrees about y, b about x: every face axis overlaps at both distances,
+    // only the cross of a's y edge and b's x edge (the z axis) separates the far pair
+    const float h = std::sqrt(0.5f);
+    const rg::OrientedBox a = orientedBox(glm::vec3(0.0f), glm::vec3(h, 0.0f, -h), y, glm::vec3(h, 0.0f, h), one);
+    auto b = [&](float distance) {
+        return orientedBox(glm::vec3(0.0f, 0.0f, distance), x, glm::vec3(0.0f, h, h), glm::vec3(0.0f, -h, h), one);
+    };
+    expectOverlap("apart on an edge cross axis", a, b(3.2f), false, 0.0f, z);
+    expectOverlap("crossing edges", a, b(2.6f), true, 4.0f * h - 2.6f, -z);
+}
+
+}
+
+int main() {
+    std::mt19937 random(3);
+    std::uniform_real_distribution<float> unit(-1.0f, 1.0f);
+    std::uniform_real_distribution<float> radius(0.1f, 2.0f);
+    const glm::vec2 areaMin(-50.0f), areaMax(50.0f);
+    const float cellSize = 8.0f;
+
+    // some of them outside [min, max], clamped into the border cells
+    const uint32_t count = 2000;
+    std::vector<glm::vec3> centers(count);
+    std::vector<float> radii(count);
+    std::vector<bool> alive(count, true);
+    rg::SpatialGrid grid;
+    grid.init(areaMin, areaMax, cellSize);
+    for (uint32_t id = 0; id < count; id++) {
+        centers[id] = glm::vec3(unit(random) * 60.0f, unit(random), unit(random) * 60.0f);
+        radii[id] = radius(random);
+        grid.insert(id, centers[id], radii[id]);
+    }
+
+    // a camera straight above the middle sees whole cells, one low at the edge looking across
+    // the grid only ever cuts through them
+    const glm::mat4 projection = glm::perspective(glm::radians(60.0f), 1.5f, 0.5f, 200.0f);
+    const rg::Frustum above = rg::Frustum::fromMatrix(projection * glm::lookAt(glm::vec3(0.0f, 40.0f, 0.0f), glm::vec3(0.0f), glm::vec3(0.0f, 0.0f, 1.0f)));
+    const rg::Frustum across = rg::Frustum::fromMatrix(projection * glm::lookAt(glm::vec3(-55.0f, 2.0f, -55.0f), glm::vec3(0.0f), glm::vec3(0.0f, 1.0f, 0.0f)));
+
+    // cells the view from above holds entirely, from the items' own boxes; on the fresh grid
+    // those are exactly the grid's cell bounds
+    int insideCells = 0;
+    const int cellsX = (int) std::ceil((areaMax.x - areaMin.x) / cellSize), cellsZ = (int) std::ceil((areaMax.y - areaMin.y) / cellSize);
+    for (int z = 0; z < cellsZ; z++) {
+        for (int x = 0; x < cellsX; x++) {
+            glm::vec3 min(1e30f), max(-1e30f);
+            bool empty = true;
+            for (uint32_t id = 0; id < count; id++) {
+                const int cx = std::min(cellsX - 1, std::max(0, (int) std::floor((centers[id].x - areaMin.x) / cellSize)));
+                const int cz = std::min(cellsZ - 1, std::max(0, (int) std::floor((centers[id].z - areaMin.y) / cellSize)));
+                if (cx == x && cz == z) {
+                    min = glm::min(min, centers[id] - glm::vec3(radii[id]));
+                    max = glm::max(max, centers[id] + glm::vec3(radii[id]));
+                    empty = false;
+                }
+            }
+            insideCells += !empty && above.classifyBox(min, max) == rg::Frustum::Inside;
+        }
+    }
+    if (insideCells == 0) {
+        std::cerr << "SpatialQueries: no cell is inside the frustum, the Inside shortcut goes untested" << std::endl;
+        return 1;
+    }
+
+    auto check = [&](const char* stage) {
+        std::vector<uint32_t> found, expected;
+        for (const rg::Frustum* frustum : { &above, &across }) {
+            found.clear();
+            expected.clear();
+            grid.queryFrustum(*frustum, [&](const rg::SpatialGrid::Item& item) { found.push_back(item.id); });
+            for (uint32_t id = 0; id < count; id++) {
+                if (alive[id] && frustum->intersectsSphere(centers[id], radii[id])) {
+                    expected.push_back(id);
+                }
+            }
+            expectSame(frustum == &above ? "queryFrustum from above" : "queryFrustum across", found, expected);
+        }
+
+        for (int q = 0; q < 100; q++) {
+            const glm::vec3 point(unit(random) * 70.0f, unit(random), unit(random) * 70.0f);
+            const float reach = radius(random) * 5.0f;
+            found.clear();
+            expected.clear();
+            grid.querySphere(point, reach, [&](const rg::SpatialGrid::Item& item) { found.push_back(item.id); });
+            for (uint32_t id = 0; id < count; id++) {
+                const glm::vec3 d = centers[id] - point;
+                if (alive[id] && glm::dot(d, d) <= (reach + radii[id]) * (reach + radii[id])) {
+                    expected.push_back(id);
+                }
+            }
+            expectSame("querySphere", found, expected);
+
+            const glm::vec3 min = point - glm::vec3(reach), max = point + glm::vec3(reach * 0.5f);
+            found.clear();
+            expected.clear();
+            grid.queryBox(min, max, [&](const rg::SpatialGrid::Item& item) { found.push_back(item.id); });
+            for (uint32_t id = 0; id < count; id++) {
+                const glm::vec3 d = glm::clamp(centers[id], min, max) - centers[id];
+                if (alive[id] && glm::dot(d, d) <= radii[id] * radii[id]) {
+                    expected.push_back(id);
+                }
+            }
+            expectSame("queryBox", found, expected);
+        }
+
+        // inside the grid, just outside it and far away; one, a few, all of them and more
+        const glm::vec3 points[] = { glm::vec3(3.0f, 0.0f, -7.0f), glm::vec3(-49.5f, 0.0f, 49.5f), glm::vec3(-80.0f, 0.0f, 70.0f),
+                                     glm::vec3(500.0f, 0.0f, -20.0f), glm::vec3(unit(random) * 40.0f, 0.0f, unit(random) * 40.0f) };
+        std::vector<float> distances;
+        for (const glm::vec3& point : points) {
+            distances.clear();
+            for (uint32_t id = 0; id < count; id++) {
+                if (alive[id]) {
+                    const glm::vec3 d = centers[id] - point;
+                    distances.push_back(glm::dot(d, d));
+                }
+            }
+            std::sort(distances.begin(), distances.end());
+            for (size_t k : { (size_t) 1, (size_t) 7, grid.size(), grid.size() + 5 }) {
+                const std::vector<rg::SpatialGrid::Item> nearest = grid.nearest(point, k);
+                bool same = nearest.size() == std::min(k, grid.size());
+                for (size_t i = 0; same && i < nearest.size(); i++) {
+                    const glm::vec3 d = nearest[i].center - point;
+                    same = alive[nearest[i].id] && glm::dot(d, d) == distances[i];
+                }
+                if (!same && failures++ < 10) {
+                    std::cerr << "SpatialQueries: nearest " << k << " to (" << point.x << ", " << point.z << ") " << stage
+                              << " differs from the scan" << std::endl;
+                }
+            }
+        }
+    };
+    check("on the fresh grid");
+
+    // moves within a cell, across cells and out of the area, removals and returns
+    for (int n = 0; n < 3000; n++) {
+        const uint32_t id = random() % count;
+        if (!alive[id]) {
+            centers[id] = glm::vec3(unit(random) * 60.0f, 0.0f, unit(random) * 60.0f);
+            grid.insert(id, centers[id], radii[id]);
+            alive[id] = true;
+        } else if (n % 5 == 0) {
+            grid.remove(id);
+            alive[id] = false;
+        } else {
+            const float step = n % 2 ? 0.5f : 30.0f;
+            centers[id] += glm::vec3(unit(random), 0.0f, unit(random)) * step;
+            grid.move(id, centers[id]);
+        }
+    }
+    size_t living = 0;
+    for (uint32_t id = 0; id < count; id++) {
+        living += alive[id];
+        if (grid.contains(id) != alive[id] && failures++ < 10) {
+            std::cerr << "SpatialQueries: contains(" << id << ") is wrong" << std::endl;
+        }
+    }
+    if (grid.size() != living && failures++ < 10) {
+        std::cerr << "SpatialQueries: size() " << grid.size() << ", " << living << " items alive" << std::endl;
+    }
+    check("after moves");
+
+    checkSpheresTouchingBox(random);
+    checkBoxesOverlap();
+
+    if (failures) {
+        std::cerr << "SpatialQueries: " << failures << " mismatches" << std::endl;
+        return 1;
+    }
+    std::cout << "SpatialQueries: grid queries match the scan, " << insideCells << " cells inside the frustum, collision tests agree" << std::endl;
+    return 0;
+}
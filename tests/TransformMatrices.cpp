@@ -0,0 +1,78 @@
+//
+// TransformStore's batched kernel against matrix(h), one entry at a time through the scalar
+// code. Every count from 0 to 17 runs the 8 wide (on CPUs with AVX), 4 wide and scalar parts
+// in every combination, over a range and over gathered indices. The results must be bit exact.
+//
+
+#include <rg/TransformStore.h>
+
+#include <cmath>
+#include <cstring>
+#include <iostream>
+#include <random>
+#include <vector>
+
+int main() {
+    std::mt19937 random(11);
+    std::uniform_real_distribution<float> unit(-1.0f, 1.0f);
+
+    rg::TransformStore store;
+    for (int i = 0; i < 64; i++) {
+        glm::quat rotation(unit(random), unit(random), unit(random), unit(random));
+        const float length = std::sqrt(rotation.w * rotation.w + rotation.x * rotation.x + rotation.y * rotation.y + rotation.z * rotation.z);
+        rotation = glm::quat(rotation.w / length, rotation.x / length, rotation.y / length, rotation.z / length);
+        store.add(glm::vec3(unit(random), unit(random), unit(random)) * 100.0f, rotation,
+                  glm::vec3(1.0f + unit(random) * 0.5f, 1.0f + unit(random) * 0.5f, 1.0f + unit(random) * 0.5f));
+    }
+
+    // out of order, repeated and far apart, the way culling survivors come
+    std::vector<uint32_t> indices;
+    for (int i = 0; i < 18; i++) {
+        indices.push_back((uint32_t) ((i * 37 + 5) % store.size()));
+    }
+    indices[7] = indices[3];
+
+    int failures = 0;
+    auto check = [&](const char* path, size_t count, const float* out, const uint32_t* handles) {
+        for (size_t i = 0; i < count; i++) {
+            glm::mat4 expected = store.matrix(handles[i]);
+            if (std::memcmp(out + 16 * i, &expected[0][0], 16 * sizeof(float)) != 0 && failures++ < 10) {
+                std::cerr << "TransformMatrices: " << path << " of " << count << ", matrix " << i << " (entry "
+                          << handles[i] << ") differs from matrix()" << std::endl;
+            }
+        }
+        // nothing past the last matrix is written
+        for (int k = 0; k < 16; k++) {
+            if (out[16 * count + k] != -7.0f && failures++ < 10) {
+                std::cerr << "TransformMatrices: " << path << " of " << count << " wrote past its end" << std::endl;
+                break;
+            }
+        }
+    };
+
+    for (size_t count = 0; count <= 17; count++) {
+        for (size_t first : { (size_t) 0, (size_t) 3 }) {
+            std::vector<float> out(16 * (count + 1), -7.0f);
+            std::vector<uint32_t> handles;
+            for (size_t i = 0; i < count; i++) {
+                handles.push_back((uint32_t) (first + i));
+            }
+            store.computeMatrices(first, count, out.data());
+            check("computeMatrices", count, out.data(), handles.data());
+        }
+        std::vector<float> out(16 * (count + 1), -7.0f);
+        store.gatherMatrices(indices.data(), count, out.data());
+        check("gatherMatrices", count, out.data(), indices.data());
+    }
+
+    if (failures) {
+        std::cerr << "TransformMatrices: " << failures << " mismatches" << std::endl;
+        return 1;
+    }
+#if defined(__x86_64__) || defined(__i386__)
+    std::cout << "TransformMatrices: counts 0 to 17 match, " << (__builtin_cpu_supports("avx") ? "with" : "without") << " AVX" << std::endl;
+#else
+    std::cout << "TransformMatrices: counts 0 to 17 match" << std::endl;
+#endif
+    return 0;
+}